@@ -0,0 +1,456 @@
+#include "AssetPackFunctions.h"
+#include "Lz4Functions.h"
+#include "JobSystemFunctions.h"
+
+#include <GLFW/glfw3.h>
+#include <atomic>
+#include <cstring>
+
+namespace AssetPack
+{
+    struct MountedPack
+    {
+        MappedFile             file;
+        const AssetPackHeader* header;
+        const AssetPackEntry*  entries;
+        const u32*             slots;
+        const char*            paths;
+    };
+
+    static MountedPack pack = {};
+
+    static std::atomic<u32> packReads(0);
+    static std::atomic<u32> looseReads(0);
+    static std::atomic<u64> decompressedBytes(0);
+    static std::atomic<u64> decompressMicroseconds(0);
+
+    std::string NormalizePath(const char* filepath)
+    {
+        // Split on both separators, drop "." and resolve ".." so every spelling of a path hashes the same
+        std::vector<std::string> parts;
+        std::string part;
+        for (const char* c = filepath;; ++c)
+        {
+            if (*c == '/' || *c == '\\' || *c == '\0')
+            {
+                if (part == "..")
+                {
+                    if (!parts.empty() && parts.back() != "..")
+                        parts.pop_back();
+                    else
+                        parts.push_back(part);
+                }
+                else if (!part.empty() && part != ".")
+                {
+                    parts.push_back(part);
+                }
+                part.clear();
+
+                if (*c == '\0')
+                    break;
+            }
+            else
+            {
+                part += *c;
+            }
+        }
+
+        std::string normalized;
+        for (u32 i = 0; i < parts.size(); ++i)
+        {
+            if (i > 0)
+                normalized += '/';
+            normalized += parts[i];
+        }
+        return normalized;
+    }
+
+    static char ToLower(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+    }
+
+    // Lookups ignore case like the Windows file system, the path table keeps it for the tools
+    static u64 HashPath(const std::string& path)
+    {
+        std::string lowercase = path;
+        for (char& c : lowercase)
+            c = ToLower(c);
+        return HashBytes(lowercase.data(), lowercase.size());
+    }
+
+    static bool IsSamePath(const char* a, const char* b, u32 length)
+    {
+        for (u32 i = 0; i < length; ++i)
+        {
+            if (ToLower(a[i]) != ToLower(b[i]))
+                return false;
+        }
+        return true;
+    }
+
+    static u32 FindEntry(const char* filepath)
+    {
+        if (pack.header == NULL)
+            return UINT32_MAX;
+
+        const std::string path = NormalizePath(filepath);
+        const u64 hash = HashPath(path);
+        const u32 mask = pack.header->slotCount - 1;
+        u32 slot = (u32)hash & mask;
+        for (u32 probe = 0; probe < pack.header->slotCount; ++probe, slot = (slot + 1) & mask)
+        {
+            const u32 entryIdx = pack.slots[slot];
+            if (entryIdx >= pack.header->entryCount)
+                return UINT32_MAX;
+
+            const AssetPackEntry& entry = pack.entries[entryIdx];
+            if (entry.pathHash == hash && entry.pathLength == path.size() &&
+                IsSamePath(pack.paths + entry.pathOffset, path.data(), path.size()))
+                return entryIdx;
+        }
+        return UINT32_MAX;
+    }
+
+    static bool IsPackValid(const MappedFile& file)
+    {
+        if (file.size < sizeof(AssetPackHeader))
+            return false;
+
+        const AssetPackHeader& header = *(const AssetPackHeader*)file.data;
+        if (header.magic != ASSET_PACK_MAGIC || header.version != ASSET_PACK_VERSION)
+            return false;
+
+        const bool powerOfTwo = header.slotCount > 0 && (header.slotCount & (header.slotCount - 1)) == 0;
+        if (!powerOfTwo || header.slotCount < header.entryCount ||
+            header.entriesOffset + (u64)header.entryCount * sizeof(AssetPackEntry) > file.size ||
+            header.slotsOffset + (u64)header.slotCount * sizeof(u32) > file.size ||
+            header.pathsOffset > file.size)
+            return false;
+
+        const AssetPackEntry* entries = (const AssetPackEntry*)(file.data + header.entriesOffset);
+        for (u32 i = 0; i < header.entryCount; ++i)
+        {
+            const AssetPackEntry& entry = entries[i];
+            if (entry.offset + entry.storedSize > file.size ||
+                header.pathsOffset + entry.pathOffset + entry.pathLength > file.size ||
+                entry.compression > AssetPackCompression_LZ4 ||
+                (entry.compression == AssetPackCompression_Stored && entry.size != entry.storedSize))
+                return false;
+        }
+        return true;
+    }
+
+    bool Mount(const char* packPath)
+    {
+        Unmount();
+
+        MappedFile file = MapFile(packPath);
+        if (file.data == NULL)
+            return false;
+
+        if (!IsPackValid(file))
+        {
+            ELOG("Asset pack %s is invalid, using loose files", packPath);
+            UnmapFile(file);
+            return false;
+        }
+
+        pack.file = file;
+        pack.header = (const AssetPackHeader*)file.data;
+        pack.entries = (const AssetPackEntry*)(file.data + pack.header->entriesOffset);
+        pack.slots = (const u32*)(file.data + pack.header->slotsOffset);
+        pack.paths = (const char*)(file.data + pack.header->pathsOffset);
+
+        ILOG("Mounted asset pack %s: %u entries, %.2f MB", packPath, pack.header->entryCount, file.size / (1024.0 * 1024.0));
+        return true;
+    }
+
+    void Unmount()
+    {
+        if (pack.header != NULL)
+            UnmapFile(pack.file);
+        pack = {};
+    }
+
+    bool IsMounted()
+    {
+        return pack.header != NULL;
+    }
+
+    bool OpenAsset(const char* filepath, AssetFile& asset)
+    {
+        CloseAsset(asset);
+
+        const u32 entryIdx = FindEntry(filepath);
+        if (entryIdx == UINT32_MAX)
+        {
+            asset.looseFile = MapFile(filepath);
+            if (asset.looseFile.data == NULL)
+                return false;
+
+            asset.data = asset.looseFile.data;
+            asset.size = asset.looseFile.size;
+            looseReads++;
+            return true;
+        }
+
+        const AssetPackEntry& entry = pack.entries[entryIdx];
+        const u8* storedData = pack.file.data + entry.offset;
+        asset.fromPack = true;
+        packReads++;
+
+        if (entry.compression == AssetPackCompression_Stored)
+        {
+            if (entry.size != entry.storedSize)
+            {
+                ELOG("Asset pack entry %s is corrupt", filepath);
+                CloseAsset(asset);
+                return false;
+            }
+            asset.data = storedData;
+            asset.size = entry.size;
+            return true;
+        }
+
+        const f64 startTime = glfwGetTime();
+        asset.decompressed.resize(entry.size);
+        if (!Lz4::Decompress(storedData, entry.storedSize, asset.decompressed.data(), entry.size))
+        {
+            ELOG("Asset pack entry %s is corrupt", filepath);
+            CloseAsset(asset);
+            return false;
+        }
+        decompressedBytes += entry.size;
+        decompressMicroseconds += (u64)((glfwGetTime() - startTime) * 1.0e6);
+
+        asset.data = asset.decompressed.data();
+        asset.size = entry.size;
+        return true;
+    }
+
+    void CloseAsset(AssetFile& asset)
+    {
+        if (asset.looseFile.data != NULL)
+            UnmapFile(asset.looseFile);
+        asset = AssetFile{};
+    }
+
+    String ReadTextAsset(const char* filepath)
+    {
+        String text = {};
+
+        AssetFile asset = {};
+        if (OpenAsset(filepath, asset))
+        {
+            text.len = (u32)asset.size;
+            text.str = (char*)PushSize(text.len + 1);
+            memcpy(text.str, asset.data, text.len);
+            text.str[text.len] = '\0';
+            CloseAsset(asset);
+        }
+        else
+        {
+            ELOG("Could not read text asset %s", filepath);
+        }
+
+        return text;
+    }
+
+    bool GetSourceStamp(const char* filepath, SourceStamp& stamp)
+    {
+        const u32 entryIdx = FindEntry(filepath);
+        if (entryIdx == UINT32_MAX)
+            return ::GetSourceStamp(filepath, stamp);
+
+        stamp = pack.entries[entryIdx].source;
+        return true;
+    }
+
+    bool IsSourceUnchanged(const char* filepath, const SourceStamp& stamp)
+    {
+        const u32 entryIdx = FindEntry(filepath);
+        if (entryIdx == UINT32_MAX)
+            return ::IsSourceUnchanged(filepath, stamp);
+
+        const SourceStamp& source = pack.entries[entryIdx].source;
+        return source.size == stamp.size && source.hash == stamp.hash;
+    }
+
+    AssetPackStats GetStats()
+    {
+        AssetPackStats stats = {};
+        if (pack.header != NULL)
+        {
+            stats.entryCount = pack.header->entryCount;
+            stats.packSize = pack.file.size;
+        }
+        stats.packReads = packReads;
+        stats.looseReads = looseReads;
+        stats.decompressedBytes = decompressedBytes;
+        stats.decompressMs = decompressMicroseconds / 1000.0;
+        return stats;
+    }
+
+    std::vector<std::string> GetEntryPaths()
+    {
+        std::vector<std::string> paths;
+        if (pack.header == NULL)
+            return paths;
+
+        for (u32 i = 0; i < pack.header->entryCount; ++i)
+            paths.push_back(std::string(pack.paths + pack.entries[i].pathOffset, pack.entries[i].pathLength));
+        return paths;
+    }
+
+    struct PackedFile
+    {
+        std::string     path; // normalized
+        AssetPackEntry  entry;
+        std::vector<u8> data; // as stored in the pack
+        bool            valid;
+    };
+
+    static u64 Align(u64 value, u64 alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    static bool WritePadded(FILE* file, u64& cursor, u64 offset, const void* data, u64 size)
+    {
+        static const u8 zeros[ASSET_PACK_ALIGNMENT] = {};
+        while (cursor < offset)
+        {
+            const u64 padding = offset - cursor < sizeof(zeros) ? offset - cursor : sizeof(zeros);
+            if (fwrite(zeros, 1, padding, file) != padding)
+                return false;
+            cursor += padding;
+        }
+        if (size > 0 && fwrite(data, 1, size, file) != size)
+            return false;
+        cursor += size;
+        return true;
+    }
+
+    bool Build(const char* packPath, const std::vector<std::string>& filepaths, AssetPackBuildStats& stats)
+    {
+        stats = {};
+
+        std::vector<PackedFile> files(filepaths.size());
+        JobSystem::ParallelFor(files.size(), [&](u32 i)
+        {
+            PackedFile& packed = files[i];
+            packed.path = NormalizePath(filepaths[i].c_str());
+
+            MappedFile source = MapFile(filepaths[i].c_str());
+            if (source.data == NULL)
+                return;
+
+            AssetPackEntry& entry = packed.entry;
+            entry.size = source.size;
+            entry.source.timestamp = GetFileLastWriteTimestamp(filepaths[i].c_str());
+            entry.source.size = source.size;
+            entry.source.hash = HashBytes(source.data, source.size);
+            entry.pathHash = HashPath(packed.path);
+
+            packed.data.resize(Lz4::GetMaxCompressedSize(source.size));
+            const u64 compressedSize = Lz4::Compress(source.data, source.size, packed.data.data(), packed.data.size());
+            if (compressedSize > 0 && compressedSize < source.size * ASSET_PACK_MIN_SAVING)
+            {
+                entry.compression = AssetPackCompression_LZ4;
+                packed.data.resize(compressedSize);
+            }
+            else
+            {
+                entry.compression = AssetPackCompression_Stored;
+                packed.data.assign(source.data, source.data + source.size);
+            }
+            packed.data.shrink_to_fit();
+            entry.storedSize = packed.data.size();
+            packed.valid = true;
+
+            UnmapFile(source);
+        });
+
+        AssetPackHeader header = {};
+        header.magic = ASSET_PACK_MAGIC;
+        header.version = ASSET_PACK_VERSION;
+        header.entryCount = files.size();
+        header.slotCount = 1;
+        while (header.slotCount < header.entryCount * 2)
+            header.slotCount *= 2;
+
+        // Table of contents: entries, hash slots and paths, then the data
+        std::vector<u32> slots(header.slotCount, UINT32_MAX);
+        std::string paths;
+        for (u32 i = 0; i < files.size(); ++i)
+        {
+            PackedFile& packed = files[i];
+            if (!packed.valid)
+            {
+                ELOG("Could not read %s, the pack was not written", filepaths[i].c_str());
+                return false;
+            }
+
+            u32 slot = (u32)packed.entry.pathHash & (header.slotCount - 1);
+            while (slots[slot] != UINT32_MAX)
+            {
+                const std::string& other = files[slots[slot]].path;
+                if (other.size() == packed.path.size() && IsSamePath(other.data(), packed.path.data(), other.size()))
+                {
+                    ELOG("%s is listed twice, the pack was not written", filepaths[i].c_str());
+                    return false;
+                }
+                slot = (slot + 1) & (header.slotCount - 1);
+            }
+            slots[slot] = i;
+
+            packed.entry.pathOffset = paths.size();
+            packed.entry.pathLength = packed.path.size();
+            paths += packed.path;
+        }
+
+        header.entriesOffset = sizeof(AssetPackHeader);
+        header.slotsOffset = header.entriesOffset + files.size() * sizeof(AssetPackEntry);
+        header.pathsOffset = header.slotsOffset + slots.size() * sizeof(u32);
+
+        u64 dataOffset = header.pathsOffset + paths.size();
+        for (PackedFile& packed : files)
+        {
+            dataOffset = Align(dataOffset, ASSET_PACK_ALIGNMENT);
+            packed.entry.offset = dataOffset;
+            dataOffset += packed.entry.storedSize;
+
+            stats.entryCount++;
+            stats.compressedCount += packed.entry.compression == AssetPackCompression_LZ4 ? 1 : 0;
+            stats.sourceBytes += packed.entry.size;
+        }
+
+        FILE* file = fopen(packPath, "wb");
+        if (file == NULL)
+        {
+            ELOG("fopen() failed writing file %s", packPath);
+            return false;
+        }
+
+        u64 cursor = 0;
+        bool success = WritePadded(file, cursor, 0, &header, sizeof(header));
+        for (const PackedFile& packed : files)
+            success &= WritePadded(file, cursor, cursor, &packed.entry, sizeof(packed.entry));
+        success &= WritePadded(file, cursor, header.slotsOffset, slots.data(), slots.size() * sizeof(u32));
+        success &= WritePadded(file, cursor, header.pathsOffset, paths.data(), paths.size());
+        for (const PackedFile& packed : files)
+            success &= WritePadded(file, cursor, packed.entry.offset, packed.data.data(), packed.data.size());
+
+        success &= fclose(file) == 0;
+        if (!success)
+        {
+            ELOG("Could not write asset pack %s", packPath);
+            remove(packPath);
+            return false;
+        }
+
+        stats.packBytes = cursor;
+        return true;
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef ASSET_PACK_FUNC
+#define ASSET_PACK_FUNC
+
+#include "Globals.h"
+#include "platform.h"
+#include <vector>
+#include <string>
+
+// Single file holding the assets, mapped once at startup instead of opening
+// every loose file. A table of contents indexed by an open addressing hash of
+// the normalized path (forward slashes, case insensitive) locates the entries. Each
+// entry is LZ4 compressed, or stored when compression doesn't pay off; stored
+// entries are handed out as views of the mapping, without copies. Every loader
+// reads through OpenAsset, which falls back to loose files for anything the
+// pack doesn't hold, so the pack is optional. Packs are built by the Packer tool.
+#define ASSET_PACK_FILENAME   "Assets.pak"
+#define ASSET_PACK_MAGIC      0x4b415041 // "APAK"
+#define ASSET_PACK_VERSION    1
+#define ASSET_PACK_ALIGNMENT  16   // entry data, matches the blob alignment of the mesh cache
+#define ASSET_PACK_MIN_SAVING 0.9  // entries compressed above this fraction of their size are stored
+
+enum AssetPackCompression
+{
+    AssetPackCompression_Stored,
+    AssetPackCompression_LZ4,
+};
+
+struct AssetPackHeader
+{
+    u32 magic;
+    u32 version;
+    u32 entryCount;
+    u32 slotCount;     // power of two, at least twice entryCount
+    u64 entriesOffset; // AssetPackEntry[entryCount]
+    u64 slotsOffset;   // u32[slotCount], entry index or UINT32_MAX
+    u64 pathsOffset;   // normalized paths, not null terminated
+};
+
+struct AssetPackEntry
+{
+    u64         pathHash;
+    u64         offset;     // from the start of the pack
+    u64         storedSize;
+    u64         size;       // decompressed
+    SourceStamp source;     // of the file it was built from, used by the caches to tell if they are stale
+    u32         pathOffset; // from pathsOffset
+    u32         pathLength;
+    u32         compression; // AssetPackCompression
+    u32         padding;
+};
+
+// Contents of an asset, from the pack or from a loose file. Move it, don't copy
+// it: data may point into decompressed.
+struct AssetFile
+{
+    const u8*       data;
+    u64             size;
+    bool            fromPack;
+    std::vector<u8> decompressed; // LZ4 entries
+    MappedFile      looseFile;
+};
+
+struct AssetPackStats
+{
+    u32 entryCount;
+    u64 packSize;
+    u32 packReads;
+    u32 looseReads;
+    u64 decompressedBytes;
+    f64 decompressMs;
+};
+
+struct AssetPackBuildStats
+{
+    u32 entryCount;
+    u32 compressedCount;
+    u64 sourceBytes;
+    u64 packBytes;
+};
+
+namespace AssetPack
+{
+    // Returns false when the pack is missing or invalid, assets are then read from loose files
+    bool Mount(const char* packPath);
+
+    void Unmount();
+
+    bool IsMounted();
+
+    // Forward slashes, without "." nor ".." parts
+    std::string NormalizePath(const char* filepath);
+
+    // Thread safe once mounted
+    bool OpenAsset(const char* filepath, AssetFile& asset);
+
+    void CloseAsset(AssetFile& asset);
+
+    // Same as ReadTextFile: the text lives in the frame arena, main thread only
+    String ReadTextAsset(const char* filepath);
+
+    // Pack aware GetSourceStamp and IsSourceUnchanged: packed assets answer with the stamp
+    // the packer recorded, so the caches don't need the loose source
+    bool GetSourceStamp(const char* filepath, SourceStamp& stamp);
+
+    bool IsSourceUnchanged(const char* filepath, const SourceStamp& stamp);
+
+    AssetPackStats GetStats();
+
+    // Paths of the mounted pack's entries, as normalized when it was built
+    std::vector<std::string> GetEntryPaths();
+
+    // Compresses the files on the JobSystem and writes the pack. Entries are named after
+    // the paths as given, so they must be relative to the working directory of the engine.
+    bool Build(const char* packPath, const std::vector<std::string>& filepaths, AssetPackBuildStats& stats);
+}
+
+#endif // !ASSET_PACK_FUNC
@@ -0,0 +1,234 @@
+#include "AssetRegistryFunctions.h"
+#include "platform.h"
+
+#define ASSET_REGISTRY_MIN_CAPACITY 256
+#define ASSET_SUBNAME_SEPARATOR     ':'
+#define ASSET_TYPE_SHIFT            61
+#define ASSET_NO_PATH               UINT32_MAX // content entries, their id is the content hash itself
+
+namespace AssetRegistryManager
+{
+    static char NormalizePathChar(char c)
+    {
+        if (c == '\\')
+            return '/';
+        if (c >= 'A' && c <= 'Z')
+            return c - 'A' + 'a';
+        return c;
+    }
+
+    static u64 HashPath(const char* path, u64 hash)
+    {
+        for (const char* c = path; *c; ++c)
+        {
+            hash ^= (u8)NormalizePathChar(*c);
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    AssetId MakeAssetId(AssetType type, const char* path, const char* subName)
+    {
+        u64 hash = HashBytes(&type, sizeof(type));
+        hash = HashPath(path, hash);
+        if (subName)
+        {
+            const char separator = ASSET_SUBNAME_SEPARATOR;
+            hash = HashBytes(&separator, 1, hash);
+            hash = HashBytes(subName, strlen(subName), hash);
+        }
+
+        // The type goes in the top bits so the entries of a type can be told apart without their path
+        AssetId id = (hash & ((1ull << ASSET_TYPE_SHIFT) - 1)) | ((u64)type << ASSET_TYPE_SHIFT);
+
+        // 0 marks the empty slots
+        return id == INVALID_ASSET_ID ? 1ull : id;
+    }
+
+    static AssetType GetAssetType(AssetId id)
+    {
+        return (AssetType)(id >> ASSET_TYPE_SHIFT);
+    }
+
+    static u32 GetHomeSlot(const AssetRegistry& registry, AssetId id)
+    {
+        // Mix the high bits in, FNV leaves the low ones poorly distributed for similar paths
+        u64 mixed = id ^ (id >> 29) ^ (id >> 47);
+        return (u32)(mixed & (registry.slots.size() - 1));
+    }
+
+    static u32 FindSlot(const AssetRegistry& registry, AssetId id)
+    {
+        if (registry.slots.empty())
+            return UINT32_MAX;
+
+        const u32 mask = registry.slots.size() - 1;
+        for (u32 slot = GetHomeSlot(registry, id);; slot = (slot + 1) & mask)
+        {
+            if (registry.slots[slot].id == id)
+                return slot;
+            if (registry.slots[slot].id == INVALID_ASSET_ID)
+                return UINT32_MAX;
+        }
+    }
+
+    u32 Find(const AssetRegistry& registry, AssetId id)
+    {
+        u32 slot = FindSlot(registry, id);
+        return slot == UINT32_MAX ? UINT32_MAX : registry.slots[slot].index;
+    }
+
+#ifndef NDEBUG
+    static bool SamePath(const char* registered, const char* path, const char* subName)
+    {
+        while (*path && NormalizePathChar(*registered) == NormalizePathChar(*path))
+        {
+            ++registered;
+            ++path;
+        }
+        if (*path)
+            return false;
+
+        if (subName)
+        {
+            if (*registered++ != ASSET_SUBNAME_SEPARATOR)
+                return false;
+            return strcmp(registered, subName) == 0;
+        }
+        return *registered == '\0';
+    }
+#endif
+
+    u32 Find(const AssetRegistry& registry, AssetType type, const char* path, const char* subName)
+    {
+        u32 slot = FindSlot(registry, MakeAssetId(type, path, subName));
+        if (slot == UINT32_MAX)
+            return UINT32_MAX;
+
+        ASSERT(SamePath(&registry.pathPool[registry.slots[slot].pathOffset], path, subName), "Asset id collision");
+        return registry.slots[slot].index;
+    }
+
+    static void InsertSlot(AssetRegistry& registry, const AssetSlot& newSlot)
+    {
+        const u32 mask = registry.slots.size() - 1;
+        u32 slot = GetHomeSlot(registry, newSlot.id);
+        while (registry.slots[slot].id != INVALID_ASSET_ID && registry.slots[slot].id != newSlot.id)
+            slot = (slot + 1) & mask;
+
+        if (registry.slots[slot].id == INVALID_ASSET_ID)
+            registry.count++;
+        registry.slots[slot] = newSlot;
+    }
+
+    static void Grow(AssetRegistry& registry)
+    {
+        std::vector<AssetSlot> oldSlots;
+        oldSlots.swap(registry.slots);
+
+        u32 capacity = oldSlots.empty() ? ASSET_REGISTRY_MIN_CAPACITY : oldSlots.size() * 2;
+        registry.slots.assign(capacity, AssetSlot{});
+        registry.count = 0;
+
+        for (const AssetSlot& slot : oldSlots)
+            if (slot.id != INVALID_ASSET_ID)
+                InsertSlot(registry, slot);
+    }
+
+    static u32 AppendPath(AssetRegistry& registry, const char* path, const char* subName)
+    {
+        u32 pathOffset = registry.pathPool.size();
+        registry.pathPool.insert(registry.pathPool.end(), path, path + strlen(path));
+        if (subName)
+        {
+            registry.pathPool.push_back(ASSET_SUBNAME_SEPARATOR);
+            registry.pathPool.insert(registry.pathPool.end(), subName, subName + strlen(subName));
+        }
+        registry.pathPool.push_back('\0');
+        return pathOffset;
+    }
+
+    static void InsertNew(AssetRegistry& registry, AssetId id, u32 index, u32 pathOffset)
+    {
+        // Keep the load factor under 1/2 so probe sequences stay short
+        if ((registry.count + 1) * 2 > registry.slots.size())
+            Grow(registry);
+
+        AssetSlot slot = {};
+        slot.id = id;
+        slot.index = index;
+        slot.pathOffset = pathOffset;
+        InsertSlot(registry, slot);
+    }
+
+    void Insert(AssetRegistry& registry, AssetId id, u32 index, const char* path, const char* subName)
+    {
+        // Updates keep the path already interned for the id
+        u32 slot = FindSlot(registry, id);
+        if (slot != UINT32_MAX)
+        {
+            ASSERT(SamePath(&registry.pathPool[registry.slots[slot].pathOffset], path, subName), "Asset id collision");
+            registry.slots[slot].index = index;
+            return;
+        }
+
+        InsertNew(registry, id, index, AppendPath(registry, path, subName));
+    }
+
+    void Remove(AssetRegistry& registry, AssetId id)
+    {
+        u32 slot = FindSlot(registry, id);
+        if (slot == UINT32_MAX)
+            return;
+
+        // Backward shift deletion, no tombstones needed
+        const u32 mask = registry.slots.size() - 1;
+        u32 hole = slot;
+        for (u32 next = (hole + 1) & mask; registry.slots[next].id != INVALID_ASSET_ID; next = (next + 1) & mask)
+        {
+            u32 home = GetHomeSlot(registry, registry.slots[next].id);
+            bool canMove = (next > hole) ? (home <= hole || home > next) : (home <= hole && home > next);
+            if (canMove)
+            {
+                registry.slots[hole] = registry.slots[next];
+                hole = next;
+            }
+        }
+
+        registry.slots[hole] = AssetSlot{};
+        registry.count--;
+    }
+
+    void RemapIndices(AssetRegistry& registry, AssetType type, const std::vector<u32>& remappedIndices)
+    {
+        for (AssetSlot& slot : registry.slots)
+            if (slot.id != INVALID_ASSET_ID && GetAssetType(slot.id) == type && slot.index < remappedIndices.size())
+                slot.index = remappedIndices[slot.index];
+    }
+
+    static AssetId MakeContentId(AssetType type, u64 contentHash)
+    {
+        AssetId id = (contentHash & ((1ull << ASSET_TYPE_SHIFT) - 1)) | ((u64)type << ASSET_TYPE_SHIFT);
+        return id == INVALID_ASSET_ID ? 1ull : id;
+    }
+
+    u32 FindContent(const AssetRegistry& registry, AssetType type, u64 contentHash)
+    {
+        return Find(registry, MakeContentId(type, contentHash));
+    }
+
+    void InsertContent(AssetRegistry& registry, AssetType type, u64 contentHash, u32 index)
+    {
+        const AssetId id = MakeContentId(type, contentHash);
+        u32 slot = FindSlot(registry, id);
+        if (slot != UINT32_MAX)
+            registry.slots[slot].index = index;
+        else
+            InsertNew(registry, id, index, ASSET_NO_PATH);
+    }
+
+    void RemoveContent(AssetRegistry& registry, AssetType type, u64 contentHash)
+    {
+        Remove(registry, MakeContentId(type, contentHash));
+    }
+}
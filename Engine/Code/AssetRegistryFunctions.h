@@ -0,0 +1,67 @@
+#ifndef ASSET_REGISTRY_FUNC
+#define ASSET_REGISTRY_FUNC
+
+#include "Globals.h"
+#include <vector>
+
+// Asset paths are interned into 64-bit ids (the type in the top 3 bits, then a
+// hash of the type and the normalized path) and resolved to indices of the App
+// arrays through an open addressing hash table with linear probing. Lookups
+// hash the C string in place and never allocate. Content hashes of deduplicated
+// assets go through the same table, keyed by their type and the hash itself,
+// with no path.
+typedef u64 AssetId;
+
+#define INVALID_ASSET_ID 0ull
+
+enum AssetType
+{
+    AssetType_Texture,
+    AssetType_Model,
+    AssetType_Material,
+    AssetType_Program,
+    AssetType_TextureContent,  // hash of the level data -> texture index
+    AssetType_MaterialContent, // hash of the parameters and texture indices -> material index
+    AssetType_Count
+};
+
+struct AssetSlot
+{
+    AssetId id;
+    u32     index;
+    u32     pathOffset; // into AssetRegistry::pathPool, used to detect id collisions. UINT32_MAX for content entries
+};
+
+struct AssetRegistry
+{
+    std::vector<AssetSlot> slots; // capacity is always a power of 2
+    std::vector<char>      pathPool;
+    u32                    count;
+};
+
+namespace AssetRegistryManager
+{
+    // subName distinguishes several assets coming from the same file (e.g. the
+    // materials of a model or the programs of a shader file). It may be NULL.
+    AssetId MakeAssetId(AssetType type, const char* path, const char* subName = NULL);
+
+    // Returns UINT32_MAX if the asset is not registered
+    u32 Find(const AssetRegistry& registry, AssetId id);
+
+    u32 Find(const AssetRegistry& registry, AssetType type, const char* path, const char* subName = NULL);
+
+    void Insert(AssetRegistry& registry, AssetId id, u32 index, const char* path, const char* subName = NULL);
+
+    void Remove(AssetRegistry& registry, AssetId id);
+
+    // Points every entry of the type registered at index i to remappedIndices[i]
+    void RemapIndices(AssetRegistry& registry, AssetType type, const std::vector<u32>& remappedIndices);
+
+    u32 FindContent(const AssetRegistry& registry, AssetType type, u64 contentHash);
+
+    void InsertContent(AssetRegistry& registry, AssetType type, u64 contentHash, u32 index);
+
+    void RemoveContent(AssetRegistry& registry, AssetType type, u64 contentHash);
+}
+
+#endif // !ASSET_REGISTRY_FUNC
@@ -0,0 +1,316 @@
+#include "engine.h"
+#include "GeometryPoolFunctions.h"
+
+namespace GeometryPoolManager
+{
+    static bool IsSameLayout(const VertexBufferLayout& a, const VertexBufferLayout& b)
+    {
+        if (a.stride != b.stride || a.attributes.size() != b.attributes.size())
+            return false;
+
+        for (u32 i = 0; i < a.attributes.size(); ++i)
+        {
+            const VertexBufferAttribute& attributeA = a.attributes[i];
+            const VertexBufferAttribute& attributeB = b.attributes[i];
+            if (attributeA.location != attributeB.location ||
+                attributeA.componentCount != attributeB.componentCount ||
+                attributeA.offset != attributeB.offset ||
+                attributeA.normalized != attributeB.normalized ||
+                attributeA.type != attributeB.type)
+                return false;
+        }
+        return true;
+    }
+
+    static GLuint CreateBuffer(u64 size)
+    {
+        GLuint handle;
+        glGenBuffers(1, &handle);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, handle);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return handle;
+    }
+
+    // VAOs keep the buffers they were built with
+    static void ReleaseVAOs(GeometryPool& pool)
+    {
+        for (const VAO& vao : pool.vaos)
+            glDeleteVertexArrays(1, &vao.handle);
+        pool.vaos.clear();
+    }
+
+    // Doubles the allocator until the allocation fits, then its buffers, which share it with unitSizes bytes per unit
+    static u32 AllocateOrGrow(GeometryPool& pool, TlsfAllocator& allocator, GLuint* const bufferHandles[], const u32 unitSizes[], u32 bufferCount, u32 size)
+    {
+        u32 allocation = Tlsf::Allocate(allocator, size);
+        if (allocation != UINT32_MAX)
+            return allocation;
+
+        const u32 oldCapacity = allocator.capacity;
+        u32 newCapacity = oldCapacity;
+        while (allocation == UINT32_MAX)
+        {
+            newCapacity = newCapacity * 2 > newCapacity + size ? newCapacity * 2 : newCapacity + size;
+            Tlsf::Grow(allocator, newCapacity);
+            allocation = Tlsf::Allocate(allocator, size);
+        }
+
+        for (u32 i = 0; i < bufferCount; ++i)
+        {
+            GLuint& bufferHandle = *bufferHandles[i];
+            const GLuint newHandle = CreateBuffer((u64)newCapacity * unitSizes[i]);
+            glBindBuffer(GL_COPY_READ_BUFFER, bufferHandle);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, newHandle);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (u64)oldCapacity * unitSizes[i]);
+            glDeleteBuffers(1, &bufferHandle);
+            bufferHandle = newHandle;
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        ReleaseVAOs(pool);
+
+        ILOG("Geometry pool grown to %u %s", newCapacity, &allocator == &pool.vertexAllocator ? "vertices" : "indices");
+        return allocation;
+    }
+
+    // The created streams of the pool, as buffers sharing the vertex allocator
+    static u32 GetVertexBuffers(GeometryPool& pool, GLuint* bufferHandles[GEOMETRY_MAX_STREAMS], u32 strides[GEOMETRY_MAX_STREAMS])
+    {
+        u32 count = 0;
+        for (GeometryStream& stream : pool.streams)
+        {
+            if (stream.handle == 0)
+                continue;
+            bufferHandles[count] = &stream.handle;
+            strides[count] = stream.layout.stride;
+            count++;
+        }
+        return count;
+    }
+
+    static u32 GetAttributeSize(const VertexBufferAttribute& attribute)
+    {
+        switch (attribute.type)
+        {
+        case GL_HALF_FLOAT:            return attribute.componentCount * 2;
+        case GL_INT_2_10_10_10_REV:    return 4;
+        default:                       return attribute.componentCount * 4;
+        }
+    }
+
+    u32 GetReadLocations(const std::vector<Program>& programs)
+    {
+        u32 locations = 0;
+        for (const Program& program : programs)
+        {
+            for (const VertexShaderAttribute& attribute : program.shaderLayout.attributes)
+                locations |= 1u << attribute.location;
+        }
+        return locations;
+    }
+
+    u32 FindOrCreatePool(std::vector<GeometryPool>& pools, const VertexBufferLayout& layout, GLenum indexType, u32 readLocations)
+    {
+        for (u32 i = 0; i < pools.size(); ++i)
+        {
+            if (pools[i].indexType == indexType && IsSameLayout(pools[i].vertexBufferLayout, layout))
+                return i;
+        }
+
+        GeometryPool pool = {};
+        pool.vertexBufferLayout = layout;
+        pool.indexType = indexType;
+
+        // Attributes keep their interleaved order inside their stream
+        const u8 streamOfLocation[GEOMETRY_MAX_LOCATIONS] = GEOMETRY_STREAM_OF_LOCATION;
+        bool isRead[GEOMETRY_MAX_STREAMS] = {};
+        for (const VertexBufferAttribute& attribute : layout.attributes)
+        {
+            ASSERT(attribute.location < GEOMETRY_MAX_LOCATIONS, "FindOrCreatePool() - Attribute location without a stream");
+            const u8 streamIdx = streamOfLocation[attribute.location];
+            VertexBufferLayout& streamLayout = pool.streams[streamIdx].layout;
+            streamLayout.attributes.push_back(VertexBufferAttribute{ attribute.location, attribute.componentCount, streamLayout.stride, attribute.normalized, attribute.type });
+            streamLayout.stride += GetAttributeSize(attribute);
+            isRead[streamIdx] |= (readLocations & (1u << attribute.location)) != 0;
+        }
+        for (u32 i = 0; i < GEOMETRY_MAX_STREAMS; ++i)
+        {
+            if (isRead[i])
+                pool.streams[i].handle = CreateBuffer((u64)GEOMETRY_POOL_INITIAL_VERTICES * pool.streams[i].layout.stride);
+        }
+
+        pool.indexBufferHandle = CreateBuffer((u64)GEOMETRY_POOL_INITIAL_INDICES * ModelLoader::GetIndexSize(indexType));
+        Tlsf::Init(pool.vertexAllocator, GEOMETRY_POOL_INITIAL_VERTICES);
+        Tlsf::Init(pool.indexAllocator, GEOMETRY_POOL_INITIAL_INDICES);
+
+        pools.push_back(pool);
+        return pools.size() - 1;
+    }
+
+    void WriteStreams(const GeometryPool& pool, const u8* vertices, u32 vertexCount, u8* const streamData[GEOMETRY_MAX_STREAMS])
+    {
+        const u8 streamOfLocation[GEOMETRY_MAX_LOCATIONS] = GEOMETRY_STREAM_OF_LOCATION;
+        const u32 srcStride = pool.vertexBufferLayout.stride;
+        for (const VertexBufferAttribute& attribute : pool.vertexBufferLayout.attributes)
+        {
+            const u8 streamIdx = streamOfLocation[attribute.location];
+            const GeometryStream& stream = pool.streams[streamIdx];
+            if (stream.handle == 0)
+                continue;
+
+            u32 dstOffset = 0;
+            for (const VertexBufferAttribute& streamAttribute : stream.layout.attributes)
+            {
+                if (streamAttribute.location == attribute.location)
+                    dstOffset = streamAttribute.offset;
+            }
+
+            const u32 size = GetAttributeSize(attribute);
+            const u32 dstStride = stream.layout.stride;
+            const u8* src = vertices + attribute.offset;
+            u8* dst = streamData[streamIdx] + dstOffset;
+            for (u32 v = 0; v < vertexCount; ++v)
+                memcpy(dst + (u64)v * dstStride, src + (u64)v * srcStride, size);
+        }
+    }
+
+    u32 GetStreamedVertexSize(const GeometryPool& pool)
+    {
+        u32 size = 0;
+        for (const GeometryStream& stream : pool.streams)
+            size += stream.handle ? stream.layout.stride : 0;
+        return size;
+    }
+
+    void AllocateMesh(std::vector<GeometryPool>& pools, Mesh& mesh, u32 readLocations)
+    {
+        mesh.geometryRanges.clear();
+
+        // One range per pool, large enough for all the submeshes that use it
+        for (SubMesh& submesh : mesh.submeshes)
+        {
+            submesh.poolIdx = FindOrCreatePool(pools, submesh.vertexBufferLayout, submesh.indexType, readLocations);
+
+            GeometryRange* range = nullptr;
+            for (GeometryRange& existing : mesh.geometryRanges)
+            {
+                if (existing.poolIdx == submesh.poolIdx)
+                    range = &existing;
+            }
+            if (!range)
+            {
+                mesh.geometryRanges.push_back(GeometryRange{ submesh.poolIdx, UINT32_MAX, UINT32_MAX, 0, 0 });
+                range = &mesh.geometryRanges.back();
+            }
+            range->vertexCount += submesh.vertexCount;
+            range->indexCount += submesh.indexCount;
+        }
+
+        for (GeometryRange& range : mesh.geometryRanges)
+        {
+            GeometryPool& pool = pools[range.poolIdx];
+            GLuint* vertexBuffers[GEOMETRY_MAX_STREAMS];
+            u32 strides[GEOMETRY_MAX_STREAMS];
+            const u32 vertexBufferCount = GetVertexBuffers(pool, vertexBuffers, strides);
+            range.vertexAllocation = AllocateOrGrow(pool, pool.vertexAllocator, vertexBuffers, strides, vertexBufferCount, range.vertexCount);
+
+            GLuint* const indexBuffers[] = { &pool.indexBufferHandle };
+            const u32 indexSize = ModelLoader::GetIndexSize(pool.indexType);
+            range.indexAllocation = AllocateOrGrow(pool, pool.indexAllocator, indexBuffers, &indexSize, 1, range.indexCount);
+        }
+
+        UpdateSubMeshRanges(pools, mesh);
+    }
+
+    void FreeMesh(std::vector<GeometryPool>& pools, Mesh& mesh)
+    {
+        for (const GeometryRange& range : mesh.geometryRanges)
+        {
+            GeometryPool& pool = pools[range.poolIdx];
+            Tlsf::Free(pool.vertexAllocator, range.vertexAllocation);
+            Tlsf::Free(pool.indexAllocator, range.indexAllocation);
+        }
+        mesh.geometryRanges.clear();
+    }
+
+    void UpdateSubMeshRanges(const std::vector<GeometryPool>& pools, Mesh& mesh)
+    {
+        // Submeshes follow each other inside their range, in submesh order
+        std::vector<u32> vertexCursors(mesh.geometryRanges.size());
+        std::vector<u32> indexCursors(mesh.geometryRanges.size());
+        for (u32 i = 0; i < mesh.geometryRanges.size(); ++i)
+        {
+            const GeometryRange& range = mesh.geometryRanges[i];
+            vertexCursors[i] = Tlsf::GetOffset(pools[range.poolIdx].vertexAllocator, range.vertexAllocation);
+            indexCursors[i] = Tlsf::GetOffset(pools[range.poolIdx].indexAllocator, range.indexAllocation);
+        }
+
+        for (SubMesh& submesh : mesh.submeshes)
+        {
+            u32 rangeIdx = 0;
+            while (mesh.geometryRanges[rangeIdx].poolIdx != submesh.poolIdx)
+                rangeIdx++;
+
+            submesh.baseVertex = vertexCursors[rangeIdx];
+            submesh.firstIndex = indexCursors[rangeIdx];
+            vertexCursors[rangeIdx] += submesh.vertexCount;
+            indexCursors[rangeIdx] += submesh.indexCount;
+        }
+    }
+
+    // Copies every allocation to its packed offset in a new buffer
+    static void CompactBuffer(GLuint& bufferHandle, u32 capacity, const std::vector<TlsfMove>& moves, u32 unitSize, GeometryPoolDefragStats& stats)
+    {
+        const GLuint newHandle = CreateBuffer((u64)capacity * unitSize);
+        glBindBuffer(GL_COPY_READ_BUFFER, bufferHandle);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newHandle);
+        for (const TlsfMove& move : moves)
+        {
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (u64)move.srcOffset * unitSize, (u64)move.dstOffset * unitSize, (u64)move.size * unitSize);
+            if (move.srcOffset != move.dstOffset)
+                stats.movedBytes += (u64)move.size * unitSize;
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glDeleteBuffers(1, &bufferHandle);
+        bufferHandle = newHandle;
+    }
+
+    static u32 CountMoved(const std::vector<TlsfMove>& moves)
+    {
+        u32 count = 0;
+        for (const TlsfMove& move : moves)
+            count += move.srcOffset != move.dstOffset ? 1 : 0;
+        return count;
+    }
+
+    GeometryPoolDefragStats Defragment(std::vector<GeometryPool>& pools, std::vector<Mesh>& meshes)
+    {
+        const f64 startTime = glfwGetTime();
+        GeometryPoolDefragStats stats = {};
+
+        for (GeometryPool& pool : pools)
+        {
+            // Every stream follows the same moves
+            const std::vector<TlsfMove> vertexMoves = Tlsf::Defragment(pool.vertexAllocator);
+            for (GeometryStream& stream : pool.streams)
+            {
+                if (stream.handle)
+                    CompactBuffer(stream.handle, pool.vertexAllocator.capacity, vertexMoves, stream.layout.stride, stats);
+            }
+
+            const std::vector<TlsfMove> indexMoves = Tlsf::Defragment(pool.indexAllocator);
+            CompactBuffer(pool.indexBufferHandle, pool.indexAllocator.capacity, indexMoves, ModelLoader::GetIndexSize(pool.indexType), stats);
+            stats.movedAllocations += CountMoved(vertexMoves) + CountMoved(indexMoves);
+            ReleaseVAOs(pool);
+        }
+
+        for (Mesh& mesh : meshes)
+            UpdateSubMeshRanges(pools, mesh);
+
+        stats.ms = (glfwGetTime() - startTime) * 1000.0;
+        ILOG("Geometry pools defragmented: %u allocations, %u KB moved in %.2f ms", stats.movedAllocations, (u32)(stats.movedBytes / 1024), stats.ms);
+        return stats;
+    }
+}
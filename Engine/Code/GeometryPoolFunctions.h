@@ -0,0 +1,79 @@
+#ifndef GEOMETRY_POOL_FUNC
+#define GEOMETRY_POOL_FUNC
+
+#include "Globals.h"
+#include "TlsfAllocatorFunctions.h"
+#include <vector>
+
+// The geometry of every mesh lives in a few large buffers, one vertex and one
+// index buffer per vertex format and index type, sub-allocated with TLSF. The
+// submeshes of a mesh that share a pool get one contiguous range of it and
+// draw with a base vertex and a first index, so any draws of a pool share its
+// VAO and buffers. Pools grow by reallocating their buffers when full, and
+// can be compacted on request.
+//
+// The vertices of a pool are split by attribute location into streams, each
+// in its own buffer with its own stride, all indexed by the same vertex
+// allocation: positions alone, so depth only passes fetch nothing else, the
+// shading attributes, and the tangent frame. A stream is only created when a
+// program loaded by then reads one of its attributes, and a VAO only binds the
+// streams of its program. Submeshes, the mesh cache and the optimizer keep
+// working on interleaved vertices, they are split on upload.
+#define GEOMETRY_POOL_INITIAL_VERTICES (1 << 18)
+#define GEOMETRY_POOL_INITIAL_INDICES  (1 << 20)
+#define GEOMETRY_MAX_STREAMS           3
+#define GEOMETRY_STREAM_OF_LOCATION    { 0, 1, 1, 2, 2 } // stream of each attribute location
+#define GEOMETRY_MAX_LOCATIONS         5
+
+struct GeometryStream
+{
+    VertexBufferLayout layout; // attributes of the stream, offsets within its own stride
+    GLuint             handle; // 0 when the layout has none of its attributes, or no program reads them
+};
+
+struct GeometryPool
+{
+    VertexBufferLayout vertexBufferLayout; // interleaved, as the submeshes hold their vertices
+    GLenum             indexType;
+    GeometryStream     streams[GEOMETRY_MAX_STREAMS];
+    GLuint             indexBufferHandle;
+    TlsfAllocator      vertexAllocator; // in vertices
+    TlsfAllocator      indexAllocator;  // in indices
+    std::vector<VAO>   vaos;            // one per program, invalidated when the buffers are reallocated
+};
+
+struct GeometryPoolDefragStats
+{
+    u32 movedAllocations;
+    u64 movedBytes;
+    f64 ms;
+};
+
+namespace GeometryPoolManager
+{
+    // Bit per attribute location read by any of the programs
+    u32 GetReadLocations(const std::vector<Program>& programs);
+
+    // Pool of the format, created on first use with the streams of readLocations
+    u32 FindOrCreatePool(std::vector<GeometryPool>& pools, const VertexBufferLayout& layout, GLenum indexType, u32 readLocations);
+
+    // Reserves the ranges of the mesh and places its submeshes in them.
+    // Expects vertexCount, indexCount and indexType of every submesh.
+    void AllocateMesh(std::vector<GeometryPool>& pools, Mesh& mesh, u32 readLocations);
+
+    // Splits interleaved vertices into the created streams of the pool, streamData[i] for streams[i]
+    void WriteStreams(const GeometryPool& pool, const u8* vertices, u32 vertexCount, u8* const streamData[GEOMETRY_MAX_STREAMS]);
+
+    // Bytes of a vertex over the created streams
+    u32 GetStreamedVertexSize(const GeometryPool& pool);
+
+    void FreeMesh(std::vector<GeometryPool>& pools, Mesh& mesh);
+
+    // Recomputes baseVertex and firstIndex of the submeshes from their ranges
+    void UpdateSubMeshRanges(const std::vector<GeometryPool>& pools, Mesh& mesh);
+
+    // Packs the allocations of every pool and moves the submeshes of every mesh accordingly
+    GeometryPoolDefragStats Defragment(std::vector<GeometryPool>& pools, std::vector<Mesh>& meshes);
+}
+
+#endif // !GEOMETRY_POOL_FUNC
@@ -60,9 +60,11 @@ struct Input {
 
 struct VertexBufferAttribute
 {
-    u8 location;
-    u8 componentCount;
-    u8 offset;
+    u8        location;
+    u8        componentCount;
+    u8        offset;
+    GLboolean normalized;
+    GLenum    type; // GL_FLOAT, GL_HALF_FLOAT, GL_INT_2_10_10_10_REV...
 };
 
 struct VertexBufferLayout
@@ -88,22 +90,69 @@ struct VAO
     GLuint programHandle;
 };
 
+// A cluster of a submesh's triangles, small enough to be culled on its own. It
+// is a contiguous range of the submesh indices, so drawing it needs no extra
+// index data. Laid out for std430 so the same array can live in a GPU buffer.
+struct Meshlet
+{
+    vec4 boundingSphere; // xyz center, w radius, model space
+    vec4 aabbMin;        // w unused
+    vec4 aabbMax;        // w unused
+    vec4 cone;           // xyz axis, w cutoff: backfacing for views inside the cone, 1 disables
+    u32  firstTriangle;  // relative to the submesh
+    u32  triangleCount;
+    u32  vertexCount;
+    u32  padding;
+};
+
+#define MESH_LOD_MAX_LEVELS 5
+
+struct SubMeshLod
+{
+    u32 firstIndex; // relative to the first index of the submesh
+    u32 indexCount;
+    f32 error;      // model space, 0 for the full detail level
+};
+
 struct SubMesh
 {
     VertexBufferLayout vertexBufferLayout;
-    std::vector<float> vertices;
+    std::vector<u8> vertices; // interleaved, as laid out by vertexBufferLayout
     std::vector<u32> indices;
-    u32 vertexOffset;
+    GLenum indexType; // GL_UNSIGNED_SHORT when every vertex index fits in 16 bits
+    u32 vertexCount;
+    u32 indexCount;   // every level of detail, back to back
+    u32 vertexOffset; // bytes, in the mesh cache blobs
     u32 indexOffset;
 
-    std::vector<VAO> vaos;
+    u32 poolIdx;    // GeometryPool holding the vertices and indices
+    u32 baseVertex; // in the pool, added to every index
+    u32 firstIndex; // in the pool, where lods[0] starts
+
+    std::vector<vec3> positions; // decoded, only kept with GeometryResidency_PositionsOnly
+
+    std::vector<Meshlet> meshlets;
+
+    SubMeshLod lods[MESH_LOD_MAX_LEVELS]; // lods[0] is the full detail mesh the meshlets cover
+    u32 lodCount;
+};
+
+// What a mesh holds in one GeometryPool: the submeshes using that pool, back to back
+struct GeometryRange
+{
+    u32 poolIdx;
+    u32 vertexAllocation;
+    u32 indexAllocation;
+    u32 vertexCount;
+    u32 indexCount;
 };
 
 struct Mesh
 {
     std::vector<SubMesh>    submeshes;
-    GLuint                  vertexBufferHandle;
-    GLuint                  indexBufferHandle;
+    std::vector<GeometryRange> geometryRanges; // one per GeometryPool its submeshes use
+    vec3                    boundsMin;
+    vec3                    boundsMax;
 };
 
 struct Image
@@ -114,10 +163,22 @@ struct Image
     i32   stride;
 };
 
+enum TextureState
+{
+    TextureState_Resident,
+    TextureState_Loading,
+    TextureState_Failed,
+    TextureState_Duplicate // same content as another texture, the references were moved there
+};
+
 struct Texture
 {
-    GLuint      handle;
-    std::string filepath;
+    u32          arrayIdx;    // into App::textureArrays, a streamed texture points to a placeholder until resident
+    u32          layer;
+    std::string  filepath;
+    TextureState state;
+    u32          sizeInBytes; // GPU memory, including the mip chain
+    u32          streamIdx;   // into App::streamedTextures, UINT32_MAX when every level is always resident
 };
 
 struct Program
@@ -169,6 +230,74 @@ struct Material
     u32             bumpTextureIdx;
 };
 
+enum MaterialTextureSlot
+{
+    MaterialTexture_Albedo,
+    MaterialTexture_Emissive,
+    MaterialTexture_Specular,
+    MaterialTexture_Normals,
+    MaterialTexture_Bump,
+    MaterialTexture_Count
+};
+
+// Material as described by the source asset, before its textures are loaded.
+struct MaterialSource
+{
+    std::string     name;
+    vec3            albedo;
+    vec3            emissive;
+    f32             smoothness;
+    std::string     texturePaths[MaterialTexture_Count];
+};
+
+// Cost and accuracy of the vertex quantization of an import
+struct VertexQuantizationStats
+{
+    u32 rawVertexBytes; // the same vertices as 32-bit floats
+    u32 vertexBytes;
+    f32 maxPositionError;
+    f32 maxNormalErrorDegrees;
+    f32 maxTexCoordError;
+};
+
+// Post-transform cache and overdraw metrics before/after the mesh optimizer
+struct MeshOptimizationStats
+{
+    u32 triangleCount;
+    f32 acmrBefore;
+    f32 acmrAfter;
+    f32 atvrBefore;
+    f32 atvrAfter;
+    f32 overdrawBefore;
+    f32 overdrawAfter;
+};
+
+struct ModelLoadStats
+{
+    std::string             filepath;
+    f64                     loadMs;
+    f64                     coldLoadMs;
+    f64                     uploadMs;   // GL buffer creation and copies, part of loadMs
+    bool                    fromCache;
+    u32                     vertexQuantization;
+    u32                     residency;  // GeometryResidency
+    u64                     residentGeometryBytes;  // CPU copies left after the upload
+    u64                     reclaimedGeometryBytes; // compared to keeping every vertex and index
+    VertexQuantizationStats quantization;
+    MeshOptimizationStats   optimization;
+    u32                     materialCount;
+    u32                     sharedMaterialCount;    // same content as a material already loaded
+};
+
+// Assets merged into one with the same content, since startup
+struct DeduplicationStats
+{
+    u32 duplicateTextures;
+    u32 duplicateMaterials;
+    u64 savedTextureBytes;  // level data of the duplicates, in memory and on the GPU once fully resident
+    u64 savedMaterialBytes;
+};
+
 struct Buffer {
     GLsizei size;
     GLenum type;
@@ -181,8 +310,6 @@ struct Entity
 {
     glm::mat4 worldMatrix;
     u32 modelIndex;
-    u32 localParamsOffset;
-    u32 localParamsSize;
 };
 
 enum LightType 
@@ -0,0 +1,307 @@
+#include "engine.h"
+#include "InstancingFunctions.h"
+
+#include <algorithm>
+
+namespace InstanceBatcher
+{
+    // Orphans the storage every frame so the previous frame's draws keep reading the old one
+    static void UploadBuffer(GLuint& handle, u32& capacity, const void* data, u32 count, u32 elementSize)
+    {
+        if (handle == 0)
+            glGenBuffers(1, &handle);
+
+        while (capacity < count)
+            capacity = capacity ? capacity * 2 : INSTANCE_INITIAL_ENTRIES;
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, handle);
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)capacity * elementSize, NULL, GL_STREAM_DRAW);
+        if (count > 0)
+            glBufferSubData(GL_COPY_WRITE_BUFFER, 0, (GLsizeiptr)count * elementSize, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    static bool IsSphereVisible(const vec4 planes[6], const vec3& center, f32 radius)
+    {
+        for (u32 i = 0; i < 6; ++i)
+        {
+            if (glm::dot(vec3(planes[i]), center) + planes[i].w < -radius)
+                return false;
+        }
+        return true;
+    }
+
+    // The whole level, or the visible meshlet ranges of a single full detail instance
+    static void BuildCommands(App* app, const Entity& entity, const SubMesh& submesh, InstanceBatch& batch)
+    {
+        InstanceBuffers& buffers = app->instanceBuffers;
+        LodSelectionStats& lodStats = app->lodStats;
+        MeshletCullingStats& meshletStats = app->meshletStats;
+
+        batch.firstCommand = buffers.commands.size();
+
+        const SubMeshLod& lod = submesh.lods[batch.lodLevel];
+        lodStats.submeshesPerLevel[batch.lodLevel] += batch.instanceCount;
+        lodStats.trianglesFullDetail += submesh.lods[0].indexCount / 3 * batch.instanceCount;
+
+        // Meshlets only cover the full detail level, and are culled for a single entity at a time
+        meshletStats.totalMeshlets += submesh.meshlets.size() * batch.instanceCount;
+        if (!app->useMeshletCulling || submesh.meshlets.empty() || batch.lodLevel > 0 || batch.instanceCount > 1)
+        {
+            meshletStats.visibleMeshlets += batch.lodLevel == 0 ? submesh.meshlets.size() * batch.instanceCount : 0;
+            lodStats.trianglesDrawn += lod.indexCount / 3 * batch.instanceCount;
+            const DrawElementsIndirectCommand command = { lod.indexCount, batch.instanceCount, submesh.firstIndex + lod.firstIndex, (i32)submesh.baseVertex, batch.firstInstance };
+            buffers.commands.push_back(command);
+            batch.commandCount = 1;
+            return;
+        }
+
+        // Meshlet bounds are in model space, so bring the frustum and the camera there
+        vec4 frustumPlanes[6];
+        MeshletBuilder::ExtractFrustumPlanes(app->viewProjection * entity.worldMatrix, frustumPlanes);
+        const vec3 cameraModelSpace = vec3(glm::inverse(entity.worldMatrix) * vec4(app->cameraPosition, 1.0f));
+
+        // Visible meshlets next to each other are merged into a single range
+        bool previousVisible = false;
+        for (const Meshlet& meshlet : submesh.meshlets)
+        {
+            const bool visible = MeshletBuilder::IsMeshletVisible(meshlet, frustumPlanes, cameraModelSpace, meshletStats);
+            if (visible && previousVisible)
+            {
+                buffers.commands.back().count += meshlet.triangleCount * 3;
+            }
+            else if (visible)
+            {
+                const DrawElementsIndirectCommand command = { meshlet.triangleCount * 3, 1, submesh.firstIndex + meshlet.firstTriangle * 3, (i32)submesh.baseVertex, batch.firstInstance };
+                buffers.commands.push_back(command);
+            }
+            if (visible)
+                lodStats.trianglesDrawn += meshlet.triangleCount;
+            previousVisible = visible;
+        }
+        batch.commandCount = buffers.commands.size() - batch.firstCommand;
+    }
+
+    // Splits the commands where the pool changes or a texture array must take the unit of another
+    static void BuildRuns(App* app)
+    {
+        InstanceBuffers& buffers = app->instanceBuffers;
+        buffers.runs.clear();
+
+        // The units as TextureArrayManager::BindArrays leaves them at the start of the pass
+        u32 unitArrays[TEXTURE_ARRAY_BOUND_UNITS];
+        for (u32 i = 0; i < TEXTURE_ARRAY_BOUND_UNITS; ++i)
+            unitArrays[i] = i < app->textureArrays.size() ? i : UINT32_MAX;
+
+        for (const InstanceBatch& batch : buffers.batches)
+        {
+            if (batch.commandCount == 0)
+                continue; // every meshlet culled
+
+            const u32 poolIdx = app->meshes[app->models[batch.modelIdx].meshIdx].submeshes[batch.submeshIdx].poolIdx;
+            const u32 unit = batch.arrayIdx % TEXTURE_ARRAY_BOUND_UNITS;
+            const bool rebind = unitArrays[unit] != batch.arrayIdx;
+            if (buffers.runs.empty() || buffers.runs.back().poolIdx != poolIdx || rebind)
+            {
+                const IndirectRun run = { poolIdx, rebind ? batch.arrayIdx : UINT32_MAX, batch.firstCommand, 0 };
+                buffers.runs.push_back(run);
+                unitArrays[unit] = batch.arrayIdx;
+            }
+            buffers.runs.back().commandCount += batch.commandCount;
+        }
+    }
+
+    void BuildBatches(App* app)
+    {
+        InstanceBuffers& buffers = app->instanceBuffers;
+        InstancingStats& stats = app->instancingStats;
+        stats.visibleEntities = 0;
+        stats.culledEntities = 0;
+        app->lodStats = {};
+        app->meshletStats = {};
+
+        // World space planes, the bounds are brought to world space below
+        vec4 frustumPlanes[6];
+        MeshletBuilder::ExtractFrustumPlanes(app->viewProjection, frustumPlanes);
+
+        buffers.entityParams.resize(app->entities.size());
+        buffers.entries.clear();
+        for (u32 e = 0; e < app->entities.size(); ++e)
+        {
+            const Entity& entity = app->entities[e];
+            EntityParams& params = buffers.entityParams[e];
+            params.worldMatrix = entity.worldMatrix;
+            params.worldViewProjectionMatrix = app->viewProjection * entity.worldMatrix;
+
+            const Model& model = app->models[entity.modelIndex];
+            if (model.meshIdx == UINT32_MAX)
+                continue; // still loading
+
+            const Mesh& mesh = app->meshes[model.meshIdx];
+            const f32 worldScale = std::max(glm::length(vec3(entity.worldMatrix[0])), std::max(glm::length(vec3(entity.worldMatrix[1])), glm::length(vec3(entity.worldMatrix[2]))));
+            const vec3 boundsCenter = vec3(entity.worldMatrix * vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+            const f32 boundsRadius = glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f * worldScale;
+            if (!IsSphereVisible(frustumPlanes, boundsCenter, boundsRadius))
+            {
+                stats.culledEntities++;
+                continue;
+            }
+            stats.visibleEntities++;
+
+            // Screen space size of a model space unit at the closest point of the bounds
+            const f32 distance = std::max(glm::length(boundsCenter - app->cameraPosition) - boundsRadius, 0.1f);
+            const f32 pixelsPerUnit = MeshSimplifier::GetPixelsPerUnit(worldScale, distance, app->verticalFov, (f32)app->displaySize.y);
+
+            // Depth of the near side of the bounds, 16 bits in the entry
+            const f32 viewDepth = glm::dot(boundsCenter - app->cameraPosition, app->camFront) - boundsRadius;
+            const u64 depth = (u64)(std::min(std::max(viewDepth, 0.0f), RENDER_QUEUE_MAX_DEPTH) / RENDER_QUEUE_MAX_DEPTH * 65535.0f);
+
+            ASSERT(entity.modelIndex < (1u << 24) && mesh.submeshes.size() <= (1u << 16), "BuildBatches() - Entry key overflow");
+            for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+            {
+                const u32 lodLevel = app->useLods ? MeshSimplifier::SelectLod(mesh.submeshes[i], pixelsPerUnit, app->lodErrorThreshold) : 0;
+                const u64 batchKey = (u64)entity.modelIndex << 24 | (u64)i << 8 | lodLevel;
+                const RenderQueueItem entry = { batchKey << 16 | depth, e };
+                buffers.entries.push_back(entry);
+            }
+        }
+
+        // Batches come out in runs, their instances front to back. The scratch grows with
+        // the scene, so it is kept across frames rather than taken from the frame arena
+        buffers.sortScratch.resize(std::max(buffers.sortScratch.size(), buffers.entries.size()));
+        RenderQueue::Sort(buffers.entries.data(), buffers.entries.size(), buffers.sortScratch.data());
+
+        buffers.instances.resize(buffers.entries.size());
+        buffers.unsortedBatches.clear();
+        for (u32 i = 0; i < buffers.entries.size(); ++i)
+        {
+            const RenderQueueItem& entry = buffers.entries[i];
+            const u64 batchKey = entry.key >> 16;
+            if (!app->useInstancing || i == 0 || batchKey != buffers.entries[i - 1].key >> 16)
+            {
+                InstanceBatch batch = {};
+                batch.modelIdx = (u32)(batchKey >> 24);
+                batch.submeshIdx = (u32)(batchKey >> 8) & 0xffff;
+                batch.lodLevel = (u32)batchKey & 0xff;
+                batch.firstInstance = i;
+                buffers.unsortedBatches.push_back(batch);
+            }
+            buffers.unsortedBatches.back().instanceCount++;
+            buffers.instances[i].entityIdx = entry.value;
+        }
+
+        // Batches drawn in the order of their render queue keys, the nearest instance gives the depth
+        const u32 batchCount = buffers.unsortedBatches.size();
+        RenderQueueItem* queue = RenderQueue::PushItems(batchCount);
+        for (u32 i = 0; i < batchCount; ++i)
+        {
+            InstanceBatch& batch = buffers.unsortedBatches[i];
+            const Model& model = app->models[batch.modelIdx];
+            const SubMesh& submesh = app->meshes[model.meshIdx].submeshes[batch.submeshIdx];
+            batch.materialIdx = model.materialIdx[batch.submeshIdx];
+            batch.arrayIdx = app->textures[app->materials[batch.materialIdx].albedoTextureIdx].arrayIdx;
+
+            const f32 viewDepth = (f32)(buffers.entries[batch.firstInstance].key & 0xffff) / 65535.0f * RENDER_QUEUE_MAX_DEPTH;
+            queue[i].key = RenderQueue::MakeKey(RENDER_PASS_OPAQUE, viewDepth, submesh.poolIdx, batch.arrayIdx, batch.materialIdx, model.meshIdx);
+            queue[i].value = i;
+        }
+
+        RenderQueueStats& queueStats = app->renderQueueStats;
+        queueStats.items = batchCount;
+        RenderQueue::CountStateChanges(queue, batchCount, queueStats.unsorted);
+        const f64 sortStartTime = glfwGetTime();
+        RenderQueue::Sort(queue, batchCount, buffers.sortScratch.data());
+        queueStats.sortMs = (glfwGetTime() - sortStartTime) * 1000.0;
+        RenderQueue::CountStateChanges(queue, batchCount, queueStats.sorted);
+
+        buffers.batches.resize(batchCount);
+        for (u32 i = 0; i < batchCount; ++i)
+            buffers.batches[i] = buffers.unsortedBatches[queue[i].value];
+
+        // Draw parameters and commands of every batch, in queue order
+        buffers.drawParams.resize(batchCount);
+        buffers.commands.clear();
+        stats.instancedBatches = 0;
+        for (u32 i = 0; i < batchCount; ++i)
+        {
+            InstanceBatch& batch = buffers.batches[i];
+            const Model& model = app->models[batch.modelIdx];
+            const SubMesh& submesh = app->meshes[model.meshIdx].submeshes[batch.submeshIdx];
+            for (u32 j = batch.firstInstance; j < batch.firstInstance + batch.instanceCount; ++j)
+                buffers.instances[j].batchIdx = i;
+
+            const u32 materialIdx = batch.materialIdx;
+            const u32 albedoIdx = app->materials[materialIdx].albedoTextureIdx;
+            const Texture& albedo = app->textures[albedoIdx];
+
+            DrawParams& params = buffers.drawParams[i];
+            params.textureUnit = albedo.arrayIdx % TEXTURE_ARRAY_BOUND_UNITS;
+            params.textureLayer = albedo.layer;
+            params.materialIdx = materialIdx;
+            params.padding = 0;
+            params.textureSize = TextureStreamer::GetFeedbackTextureSize(app, app->materials[materialIdx]);
+
+            // The single instance case culls the meshlets of this entity
+            const Entity& entity = app->entities[buffers.instances[batch.firstInstance].entityIdx];
+            BuildCommands(app, entity, submesh, batch);
+            stats.instancedBatches += batch.instanceCount > 1 ? 1 : 0;
+        }
+        BuildRuns(app);
+
+        stats.batches = buffers.batches.size();
+        stats.commands = buffers.commands.size();
+
+        UploadBuffer(buffers.entityBufferHandle, buffers.entityCapacity, buffers.entityParams.data(), buffers.entityParams.size(), sizeof(EntityParams));
+        UploadBuffer(buffers.drawBufferHandle, buffers.drawCapacity, buffers.drawParams.data(), buffers.drawParams.size(), sizeof(DrawParams));
+        UploadBuffer(buffers.instanceBufferHandle, buffers.instanceCapacity, buffers.instances.data(), buffers.instances.size(), sizeof(InstanceRef));
+        UploadBuffer(buffers.commandBufferHandle, buffers.commandCapacity, buffers.commands.data(), buffers.commands.size(), sizeof(DrawElementsIndirectCommand));
+    }
+
+    void BindBuffers(const InstanceBuffers& buffers)
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_ENTITY_BINDING, buffers.entityBufferHandle);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_DRAW_BINDING, buffers.drawBufferHandle);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffers.commandBufferHandle);
+    }
+
+    void BindInstanceAttribute(const InstanceBuffers& buffers)
+    {
+        // The buffer keeps its name when it grows, so VAOs never need to be rebuilt
+        glBindBuffer(GL_ARRAY_BUFFER, buffers.instanceBufferHandle);
+        glVertexAttribIPointer(INSTANCE_ATTRIBUTE_LOCATION, 2, GL_UNSIGNED_INT, sizeof(InstanceRef), (void*)0);
+        glVertexAttribDivisor(INSTANCE_ATTRIBUTE_LOCATION, 1);
+        glEnableVertexAttribArray(INSTANCE_ATTRIBUTE_LOCATION);
+    }
+
+    void SpawnBenchmarkEntities(App* app, u32 count)
+    {
+        if (app->entities.empty())
+        {
+            ELOG("SpawnBenchmarkEntities() - No entity to copy");
+            return;
+        }
+
+        const Entity source = app->entities[0];
+        const vec3 right = glm::normalize(glm::cross(app->camFront, vec3(0.0f, 1.0f, 0.0f)));
+        const vec3 up = glm::cross(right, app->camFront);
+        const u32 side = (u32)ceil(sqrt((f64)count));
+        const vec3 origin = app->cameraPosition + app->camFront * 20.0f - (right + up) * (f32)side;
+        for (u32 i = 0; i < count; ++i)
+        {
+            Entity entity = source;
+            entity.worldMatrix[3] = vec4(origin + right * (f32)(i % side) * 2.0f + up * (f32)(i / side) * 2.0f, 1.0f);
+            app->entities.push_back(entity);
+        }
+
+        ILOG("Spawned %u benchmark entities", count);
+    }
+
+    void Release(InstanceBuffers& buffers)
+    {
+        glDeleteBuffers(1, &buffers.entityBufferHandle);
+        glDeleteBuffers(1, &buffers.drawBufferHandle);
+        glDeleteBuffers(1, &buffers.instanceBufferHandle);
+        glDeleteBuffers(1, &buffers.commandBufferHandle);
+        buffers = {};
+    }
+}
@@ -0,0 +1,147 @@
+#ifndef INSTANCING_FUNC
+#define INSTANCING_FUNC
+
+#include "Globals.h"
+#include "TextureArrayFunctions.h"
+#include "RenderQueueFunctions.h"
+#include <vector>
+
+struct App;
+
+// Every frame the visible entities are grouped by (model, submesh, level of
+// detail) into batches drawn as instances of a single draw, their instances
+// front to back. The material comes with the submesh and the program with the
+// pass, so a batch shares all of its state. The world matrices of every entity
+// live in a shader storage buffer indexed by entity. The instance buffer lists
+// (entity, batch) for every instance, the batches back to back, and is a per
+// instance vertex attribute: draws start at the first instance of their batch
+// with their base instance and the vertex shader fetches the matrices of the
+// entity and the draw parameters (texture layer, material) of the batch from
+// it. Entities outside the frustum are left out, a batch of a single instance
+// is split into its visible meshlet ranges. The batches are drawn in the order
+// of a RenderQueue keyed by their state and nearest instance.
+//
+// The draws of a frame are built once as DrawElementsIndirectCommands. The
+// indirect path submits them with one glMultiDrawElementsIndirect per run of
+// draws sharing a geometry pool and texture units, the direct path issues one
+// glDrawElementsInstancedBaseVertexBaseInstance per command, both from the
+// same buffers and shaders.
+#define INSTANCE_ENTITY_BINDING     1 // shader storage bindings, 0 is the texture feedback
+#define INSTANCE_DRAW_BINDING       2
+#define INSTANCE_ATTRIBUTE_LOCATION 5 // uvec2 (entity, batch) of the instance
+#define INSTANCE_INITIAL_ENTRIES    1024
+#define INSTANCE_BENCHMARK_ENTITIES 10000 // added by the GUI to compare the submission paths
+
+// Layout of EntityParams in the shaders (std430)
+struct EntityParams
+{
+    glm::mat4 worldMatrix;
+    glm::mat4 worldViewProjectionMatrix;
+};
+
+// Layout of DrawParams in the shaders (std430)
+struct DrawParams
+{
+    u32  textureUnit; // in uTextures[]
+    u32  textureLayer;
+    u32  materialIdx; // mip feedback slot
+    u32  padding;
+    vec2 textureSize; // largest level 0 size of the streamed textures of the material, 0 when none is
+};
+
+// Per instance vertex attribute
+struct InstanceRef
+{
+    u32 entityIdx;
+    u32 batchIdx;
+};
+
+// Layout fixed by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    u32 count;
+    u32 instanceCount;
+    u32 firstIndex;
+    i32 baseVertex;
+    u32 baseInstance;
+};
+
+struct InstanceBatch
+{
+    u32 modelIdx;
+    u32 submeshIdx;
+    u32 lodLevel;
+    u32 materialIdx;
+    u32 arrayIdx;      // texture array of the albedo
+    u32 firstInstance; // in InstanceBuffers::instances
+    u32 instanceCount;
+    u32 firstCommand;  // in InstanceBuffers::commands, more than one for culled meshlets
+    u32 commandCount;
+};
+
+// Consecutive commands submitted by a single glMultiDrawElementsIndirect
+struct IndirectRun
+{
+    u32 poolIdx;
+    u32 bindArrayIdx; // texture array to bind before the run, UINT32_MAX when they are all bound
+    u32 firstCommand;
+    u32 commandCount;
+};
+
+struct InstanceBuffers
+{
+    GLuint entityBufferHandle;   // EntityParams per entity
+    GLuint drawBufferHandle;     // DrawParams per batch
+    GLuint instanceBufferHandle; // InstanceRef per instance
+    GLuint commandBufferHandle;  // DrawElementsIndirectCommand
+    u32    entityCapacity;
+    u32    drawCapacity;
+    u32    instanceCapacity;
+    u32    commandCapacity;
+
+    // CPU side of this frame, kept to reuse their storage
+    std::vector<EntityParams>                entityParams;
+    std::vector<RenderQueueItem>             entries; // visible (entity, submesh), see BuildBatches for the key
+    std::vector<RenderQueueItem>             sortScratch;
+    std::vector<InstanceRef>                 instances;
+    std::vector<InstanceBatch>               batches;
+    std::vector<InstanceBatch>               unsortedBatches;
+    std::vector<DrawParams>                  drawParams;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<IndirectRun>                 runs;
+};
+
+struct InstancingStats
+{
+    u32 visibleEntities;
+    u32 culledEntities;
+    u32 batches;
+    u32 instancedBatches;  // batches of more than one instance
+    u32 commands;
+    u32 drawCalls;         // of the last RenderGeometry, counted there
+    f64 directSubmitMs;    // CPU time of the last pass submitted by each path
+    f64 indirectSubmitMs;
+};
+
+namespace InstanceBatcher
+{
+    // Writes the entity matrices, culls the entities against the frustum of
+    // app->viewProjection, groups the visible ones, sorts the batches and
+    // builds their commands and indirect runs into app->instanceBuffers. Also
+    // fills app->lodStats, app->meshletStats and app->renderQueueStats.
+    // Without app->useInstancing every submesh of an entity is its own batch.
+    void BuildBatches(App* app);
+
+    // Binds the shader storage buffers and the indirect command buffer
+    void BindBuffers(const InstanceBuffers& buffers);
+
+    // Binds the instance buffer to INSTANCE_ATTRIBUTE_LOCATION of the bound VAO
+    void BindInstanceAttribute(const InstanceBuffers& buffers);
+
+    // Copies of the first entity's model in a grid in front of the camera
+    void SpawnBenchmarkEntities(App* app, u32 count);
+
+    void Release(InstanceBuffers& buffers);
+}
+
+#endif // !INSTANCING_FUNC
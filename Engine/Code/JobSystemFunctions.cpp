@@ -0,0 +1,183 @@
+#include "JobSystemFunctions.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace JobSystem
+{
+    static std::vector<std::thread>              workers;
+    static std::deque<std::packaged_task<void()>> queue;
+    static std::deque<std::packaged_task<void()>> backgroundQueue;
+    static std::mutex                            queueMutex;
+    static std::condition_variable               queueCondition;
+    static bool                                  stopping = false;
+
+    static void WorkerLoop()
+    {
+        for (;;)
+        {
+            std::packaged_task<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [] { return stopping || !queue.empty() || !backgroundQueue.empty(); });
+
+                std::deque<std::packaged_task<void()>>& source = queue.empty() ? backgroundQueue : queue;
+                if (source.empty())
+                    return;
+
+                task = std::move(source.front());
+                source.pop_front();
+            }
+            task();
+        }
+    }
+
+    // Submit jobs only, background ones are left to the workers
+    static bool RunPendingJob()
+    {
+        std::packaged_task<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (queue.empty())
+                return false;
+
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+        task();
+        return true;
+    }
+
+    void Init(u32 workerCount)
+    {
+        ASSERT(workers.empty(), "The job system is already running");
+
+        if (workerCount == 0)
+            workerCount = std::max(1u, std::thread::hardware_concurrency());
+
+        stopping = false;
+        for (u32 i = 0; i < workerCount; ++i)
+            workers.emplace_back(WorkerLoop);
+    }
+
+    void Shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+
+        for (std::thread& worker : workers)
+            worker.join();
+        workers.clear();
+    }
+
+    u32 GetWorkerCount()
+    {
+        return workers.size();
+    }
+
+    static std::future<void> Enqueue(std::deque<std::packaged_task<void()>>& target, std::function<void()> job)
+    {
+        std::packaged_task<void()> task(std::move(job));
+        std::future<void> future = task.get_future();
+
+        if (workers.empty())
+        {
+            // No pool, run inline so callers behave the same
+            task();
+            return future;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            target.push_back(std::move(task));
+        }
+        queueCondition.notify_one();
+
+        return future;
+    }
+
+    std::future<void> Submit(std::function<void()> job)
+    {
+        return Enqueue(queue, std::move(job));
+    }
+
+    std::future<void> SubmitBackground(std::function<void()> job)
+    {
+        return Enqueue(backgroundQueue, std::move(job));
+    }
+
+    // Batches of a ParallelFor, claimed by its caller and by the helper jobs it queued
+    struct ParallelForState
+    {
+        std::atomic<u32>        nextBatch;
+        u32                     doneBatches;
+        std::mutex              doneMutex;
+        std::condition_variable doneCondition;
+    };
+
+    // Returns false once every batch is claimed. A helper that only starts after the
+    // ParallelFor returned claims nothing, so it never touches job.
+    static bool RunNextBatch(ParallelForState& state, u32 count, u32 batchCount, u32 batchSize, const std::function<void(u32 index)>& job)
+    {
+        const u32 batch = state.nextBatch.fetch_add(1);
+        if (batch >= batchCount)
+            return false;
+
+        const u32 end = std::min(count, (batch + 1) * batchSize);
+        for (u32 i = batch * batchSize; i < end; ++i)
+            job(i);
+
+        {
+            std::lock_guard<std::mutex> lock(state.doneMutex);
+            state.doneBatches++;
+        }
+        state.doneCondition.notify_one();
+        return true;
+    }
+
+    void ParallelFor(u32 count, const std::function<void(u32 index)>& job)
+    {
+        if (count == 0)
+            return;
+
+        const u32 batchCount = std::min(count, std::max(1u, GetWorkerCount()));
+        const u32 batchSize = (count + batchCount - 1) / batchCount;
+
+        // The helpers may outlive the call while queued behind other jobs, hence the shared state
+        std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+        state->nextBatch = 0;
+        state->doneBatches = 0;
+        for (u32 i = 1; i < batchCount && !workers.empty(); ++i)
+        {
+            Submit([state, count, batchCount, batchSize, &job]()
+            {
+                while (RunNextBatch(*state, count, batchCount, batchSize, job)) {}
+            });
+        }
+
+        // The caller only runs batches of this loop, never unrelated queued jobs,
+        // then waits for the ones the helpers took
+        while (RunNextBatch(*state, count, batchCount, batchSize, job)) {}
+
+        std::unique_lock<std::mutex> lock(state->doneMutex);
+        state->doneCondition.wait(lock, [&] { return state->doneBatches == batchCount; });
+    }
+
+    void Wait(std::future<void>& future)
+    {
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            if (!RunPendingJob())
+                future.wait_for(std::chrono::microseconds(100));
+        }
+        future.get();
+    }
+}
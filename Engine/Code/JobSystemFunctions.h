@@ -0,0 +1,35 @@
+#ifndef JOB_SYSTEM_FUNC
+#define JOB_SYSTEM_FUNC
+
+#include "Globals.h"
+#include <functional>
+#include <future>
+
+// Fixed pool of worker threads fed from a FIFO queue, and from a background
+// queue when that one is empty. Jobs must not touch the GL context nor the
+// frame arena (MakeString, MakePath...), both belong to the main thread.
+namespace JobSystem
+{
+    // workerCount == 0 uses one worker per hardware thread
+    void Init(u32 workerCount = 0);
+
+    void Shutdown();
+
+    u32 GetWorkerCount();
+
+    std::future<void> Submit(std::function<void()> job);
+
+    // Low priority work nobody waits on soon (background compression...): workers
+    // only take it when no Submit job is queued, and Wait never runs it
+    std::future<void> SubmitBackground(std::function<void()> job);
+
+    // Splits [0, count) across the workers and blocks until every index is processed.
+    // The caller works on the batches meanwhile, it never runs other queued jobs.
+    void ParallelFor(u32 count, const std::function<void(u32 index)>& job);
+
+    // Blocks until the job is done, running queued Submit jobs meanwhile so it is
+    // safe to wait from inside another job
+    void Wait(std::future<void>& future);
+}
+
+#endif // !JOB_SYSTEM_FUNC
@@ -0,0 +1,199 @@
+#include "Lz4Functions.h"
+
+#include <vector>
+#include <cstring>
+
+namespace Lz4
+{
+    static u32 Read32(const u8* p)
+    {
+        u32 value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static u32 Hash(u32 sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - LZ4_HASH_LOG);
+    }
+
+    // Lengths that don't fit the 4 bits of the token continue in bytes of 255
+    static u8* WriteLength(u8* op, u64 length)
+    {
+        while (length >= 255)
+        {
+            *op++ = 255;
+            length -= 255;
+        }
+        *op++ = (u8)length;
+        return op;
+    }
+
+    static bool ReadLength(const u8*& ip, const u8* ipEnd, u64& length)
+    {
+        u8 byte;
+        do
+        {
+            if (ip >= ipEnd)
+                return false;
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    // Token, lengths and literals of one sequence; the match offset is written by the caller
+    static u8* WriteLiterals(u8* op, u8* opEnd, const u8* literals, u64 literalLength, u64 matchLength, u8*& token)
+    {
+        if ((u64)(opEnd - op) < 1 + literalLength / 255 + 1 + literalLength + 2 + matchLength / 255 + 1)
+            return NULL;
+
+        token = op++;
+        if (literalLength >= 15)
+        {
+            *token = 15 << 4;
+            op = WriteLength(op, literalLength - 15);
+        }
+        else
+        {
+            *token = (u8)(literalLength << 4);
+        }
+        memcpy(op, literals, literalLength);
+        return op + literalLength;
+    }
+
+    u64 GetMaxCompressedSize(u64 size)
+    {
+        return size + size / 255 + 16;
+    }
+
+    u64 Compress(const u8* src, u64 srcSize, u8* dst, u64 dstCapacity)
+    {
+        const u8* ip = src;
+        const u8* anchor = src;
+        const u8* end = src + srcSize;
+        u8* op = dst;
+        u8* opEnd = dst + dstCapacity;
+
+        if (srcSize > LZ4_MATCH_LIMIT)
+        {
+            const u8* matchStartLimit = end - LZ4_MATCH_LIMIT;
+            const u8* matchEndLimit = end - LZ4_LAST_LITERALS;
+            std::vector<u32> table(1 << LZ4_HASH_LOG, 0); // position of the last occurrence of every hashed sequence
+
+            u32 misses = 0;
+            ip++;
+            while (ip <= matchStartLimit)
+            {
+                const u32 sequence = Read32(ip);
+                const u32 h = Hash(sequence);
+                const u8* match = src + table[h];
+                table[h] = (u32)(ip - src);
+
+                if (match >= ip || ip - match > LZ4_MAX_OFFSET || Read32(match) != sequence)
+                {
+                    // Step further the longer nothing matches, incompressible data goes through quickly
+                    ip += 1 + (misses++ >> 6);
+                    continue;
+                }
+                misses = 0;
+
+                while (ip > anchor && match > src && ip[-1] == match[-1])
+                {
+                    ip--;
+                    match--;
+                }
+
+                u64 matchLength = LZ4_MIN_MATCH;
+                while (ip + matchLength < matchEndLimit && ip[matchLength] == match[matchLength])
+                    matchLength++;
+
+                u8* token;
+                op = WriteLiterals(op, opEnd, anchor, ip - anchor, matchLength, token);
+                if (op == NULL)
+                    return 0;
+
+                const u16 offset = (u16)(ip - match);
+                *op++ = (u8)offset;
+                *op++ = (u8)(offset >> 8);
+
+                const u64 extraLength = matchLength - LZ4_MIN_MATCH;
+                if (extraLength >= 15)
+                {
+                    *token |= 15;
+                    op = WriteLength(op, extraLength - 15);
+                }
+                else
+                {
+                    *token |= (u8)extraLength;
+                }
+
+                ip += matchLength;
+                anchor = ip;
+                if (ip <= matchStartLimit)
+                    table[Hash(Read32(ip - 2))] = (u32)(ip - 2 - src);
+            }
+        }
+
+        u8* token;
+        op = WriteLiterals(op, opEnd, anchor, end - anchor, 0, token);
+        if (op == NULL)
+            return 0;
+        return op - dst;
+    }
+
+    bool Decompress(const u8* src, u64 srcSize, u8* dst, u64 dstSize)
+    {
+        const u8* ip = src;
+        const u8* ipEnd = src + srcSize;
+        u8* op = dst;
+        u8* opEnd = dst + dstSize;
+
+        while (ip < ipEnd)
+        {
+            const u8 token = *ip++;
+
+            u64 literalLength = token >> 4;
+            if (literalLength == 15 && !ReadLength(ip, ipEnd, literalLength))
+                return false;
+            if (literalLength > (u64)(ipEnd - ip) || literalLength > (u64)(opEnd - op))
+                return false;
+            memcpy(op, ip, literalLength);
+            ip += literalLength;
+            op += literalLength;
+
+            // The last sequence has no match
+            if (ip == ipEnd)
+                break;
+
+            if (ipEnd - ip < 2)
+                return false;
+            const u64 offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            if (offset == 0 || offset > (u64)(op - dst))
+                return false;
+
+            u64 matchLength = token & 15;
+            if (matchLength == 15 && !ReadLength(ip, ipEnd, matchLength))
+                return false;
+            matchLength += LZ4_MIN_MATCH;
+            if (matchLength > (u64)(opEnd - op))
+                return false;
+
+            // Overlapping matches repeat the bytes just written
+            const u8* match = op - offset;
+            if (offset >= matchLength)
+            {
+                memcpy(op, match, matchLength);
+                op += matchLength;
+            }
+            else
+            {
+                for (u64 i = 0; i < matchLength; ++i)
+                    *op++ = *match++;
+            }
+        }
+
+        return op == opEnd;
+    }
+}
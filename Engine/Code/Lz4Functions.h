@@ -0,0 +1,29 @@
+#ifndef LZ4_FUNC
+#define LZ4_FUNC
+
+#include "Globals.h"
+
+// LZ4 block format (no frame, no checksums): sequences of literals followed by
+// a back reference of at least 4 bytes within the previous 64 KB. Compression
+// is the greedy single-probe hash table search of the reference fast mode, with
+// the same skip acceleration over incompressible data. Decompression checks
+// every length and offset, so corrupt data fails instead of overrunning.
+#define LZ4_MIN_MATCH     4
+#define LZ4_MAX_OFFSET    65535
+#define LZ4_LAST_LITERALS 5  // the block always ends with at least this many literals
+#define LZ4_MATCH_LIMIT   12 // no match starts in the last bytes of the block
+#define LZ4_HASH_LOG      16
+
+namespace Lz4
+{
+    // Worst case compressed size, for incompressible input
+    u64 GetMaxCompressedSize(u64 size);
+
+    // Returns the compressed size, or 0 when the result doesn't fit in dstCapacity
+    u64 Compress(const u8* src, u64 srcSize, u8* dst, u64 dstCapacity);
+
+    // dstSize must be the exact decompressed size
+    bool Decompress(const u8* src, u64 srcSize, u8* dst, u64 dstSize);
+}
+
+#endif // !LZ4_FUNC
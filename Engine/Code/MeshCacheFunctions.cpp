@@ -0,0 +1,395 @@
+#include "engine.h"
+#include "MeshCacheFunctions.h"
+
+#include <algorithm>
+
+#define MESH_CACHE_MAX_ATTRIBUTES 8
+#define MESH_CACHE_NAME_LENGTH    128
+#define MESH_CACHE_PATH_LENGTH    256
+#define MESH_CACHE_BLOB_ALIGNMENT 16
+
+namespace MeshCache
+{
+    struct FileHeader
+    {
+        u32 magic;
+        u32 version;
+        SourceStamp source;
+        u32 vertexQuantization;
+        VertexQuantizationStats quantizationStats;
+        MeshOptimizationStats optimizationStats;
+        f64 coldLoadMs;
+        u32 submeshCount;
+        u32 materialCount;
+        u32 dependencyCount;
+        u64 vertexBlobOffset;
+        u64 vertexBlobSize;
+        u64 indexBlobOffset;
+        u64 indexBlobSize;
+        u64 meshletBlobOffset;
+        u32 meshletCount;
+    };
+
+    struct FileSubMesh
+    {
+        VertexBufferAttribute attributes[MESH_CACHE_MAX_ATTRIBUTES];
+        u32 attributeCount;
+        u32 stride;
+        u32 materialIdx; // relative to the first material of the model
+        u32 vertexOffset;
+        u32 indexOffset;
+        u32 indexCount;
+        u32 indexType;
+        u32 meshletOffset; // in meshlets, relative to the start of the meshlet blob
+        u32 meshletCount;
+        SubMeshLod lods[MESH_LOD_MAX_LEVELS];
+        u32 lodCount;
+    };
+
+    struct FileMaterial
+    {
+        char name[MESH_CACHE_NAME_LENGTH];
+        vec3 albedo;
+        vec3 emissive;
+        f32  smoothness;
+        char texturePaths[MaterialTexture_Count][MESH_CACHE_PATH_LENGTH];
+    };
+
+    // Other file the import read, the cache is stale as soon as one changes
+    struct FileDependency
+    {
+        char        path[MESH_CACHE_PATH_LENGTH];
+        SourceStamp stamp;
+    };
+
+    static void CopyString(char* dst, u32 dstSize, const std::string& src)
+    {
+        ASSERT(src.size() < dstSize, "String too long for the mesh cache");
+        strncpy(dst, src.c_str(), dstSize - 1);
+        dst[dstSize - 1] = '\0';
+    }
+
+    // Zero fills up to offset, which can't be behind the cursor, then writes the data
+    static bool WriteAt(FILE* file, u64& cursor, u64 offset, const void* data, u64 size)
+    {
+        static const u8 zeros[MESH_CACHE_BLOB_ALIGNMENT] = {};
+        ASSERT(offset >= cursor, "Mesh cache blobs must be written in order");
+        while (cursor < offset)
+        {
+            const u64 padding = std::min<u64>(offset - cursor, sizeof(zeros));
+            if (fwrite(zeros, 1, padding, file) != padding)
+                return false;
+            cursor += padding;
+        }
+
+        cursor += size;
+        return size == 0 || fwrite(data, 1, size, file) == size;
+    }
+
+    std::string GetCachePath(const char* sourcePath)
+    {
+        return std::string(sourcePath) + MESH_CACHE_EXTENSION;
+    }
+
+    static bool IsRangeInside(u64 offset, u64 size, u64 limit)
+    {
+        return offset <= limit && size <= limit - offset;
+    }
+
+    // Bounds every table and blob by the file, and every submesh range by its blob, before ReadModel touches them
+    static bool IsLayoutValid(const FileHeader& header, const AssetFile& cacheFile)
+    {
+        const u64 tablesSize = (u64)header.submeshCount * sizeof(FileSubMesh) + (u64)header.materialCount * sizeof(FileMaterial) +
+                               (u64)header.dependencyCount * sizeof(FileDependency);
+        if (!IsRangeInside(sizeof(FileHeader), tablesSize, cacheFile.size) ||
+            !IsRangeInside(header.vertexBlobOffset, header.vertexBlobSize, cacheFile.size) ||
+            !IsRangeInside(header.indexBlobOffset, header.indexBlobSize, cacheFile.size) ||
+            !IsRangeInside(header.meshletBlobOffset, (u64)header.meshletCount * sizeof(Meshlet), cacheFile.size))
+            return false;
+
+        const FileSubMesh* fileSubmeshes = (const FileSubMesh*)(cacheFile.data + sizeof(FileHeader));
+        const FileDependency* fileDependencies = (const FileDependency*)((const FileMaterial*)(fileSubmeshes + header.submeshCount) + header.materialCount);
+        for (u32 i = 0; i < header.dependencyCount; ++i)
+        {
+            if (fileDependencies[i].path[MESH_CACHE_PATH_LENGTH - 1] != '\0')
+                return false;
+        }
+
+        const Meshlet* fileMeshlets = (const Meshlet*)(cacheFile.data + header.meshletBlobOffset);
+        for (u32 i = 0; i < header.submeshCount; ++i)
+        {
+            const FileSubMesh& fileSubmesh = fileSubmeshes[i];
+            if (fileSubmesh.attributeCount > MESH_CACHE_MAX_ATTRIBUTES || fileSubmesh.stride == 0 ||
+                fileSubmesh.materialIdx >= header.materialCount || fileSubmesh.lodCount > MESH_LOD_MAX_LEVELS ||
+                (fileSubmesh.indexType != GL_UNSIGNED_SHORT && fileSubmesh.indexType != GL_UNSIGNED_INT))
+                return false;
+
+            // Vertices of consecutive submeshes are packed, so a submesh ends where the next one starts
+            const u64 vertexEnd = i + 1 < header.submeshCount ? fileSubmeshes[i + 1].vertexOffset : header.vertexBlobSize;
+            if (fileSubmesh.vertexOffset > vertexEnd || vertexEnd > header.vertexBlobSize)
+                return false;
+
+            const u64 indexSize = ModelLoader::GetIndexSize(fileSubmesh.indexType);
+            if (!IsRangeInside(fileSubmesh.indexOffset, (u64)fileSubmesh.indexCount * indexSize, header.indexBlobSize) ||
+                !IsRangeInside(fileSubmesh.meshletOffset, fileSubmesh.meshletCount, header.meshletCount))
+                return false;
+
+            for (u32 l = 0; l < fileSubmesh.lodCount; ++l)
+            {
+                if (!IsRangeInside(fileSubmesh.lods[l].firstIndex, fileSubmesh.lods[l].indexCount, fileSubmesh.indexCount))
+                    return false;
+            }
+
+            for (u32 m = fileSubmesh.meshletOffset; m < fileSubmesh.meshletOffset + fileSubmesh.meshletCount; ++m)
+            {
+                if (!IsRangeInside((u64)fileMeshlets[m].firstTriangle * 3, (u64)fileMeshlets[m].triangleCount * 3, fileSubmesh.indexCount))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    static bool IsCacheValid(const FileHeader& header, const AssetFile& cacheFile, const ModelImport& import)
+    {
+        if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION)
+            return false;
+
+        if (header.vertexQuantization != import.vertexQuantization)
+            return false;
+
+        if (!IsLayoutValid(header, cacheFile))
+        {
+            ELOG("Mesh cache of %s is truncated or corrupt", import.filepath.c_str());
+            return false;
+        }
+
+        // Material libraries and other files the import read
+        const FileSubMesh* fileSubmeshes = (const FileSubMesh*)(cacheFile.data + sizeof(FileHeader));
+        const FileDependency* fileDependencies = (const FileDependency*)((const FileMaterial*)(fileSubmeshes + header.submeshCount) + header.materialCount);
+        for (u32 i = 0; i < header.dependencyCount; ++i)
+        {
+            if (!AssetPack::IsSourceUnchanged(fileDependencies[i].path, fileDependencies[i].stamp))
+                return false;
+        }
+
+        return AssetPack::IsSourceUnchanged(import.filepath.c_str(), header.source);
+    }
+
+    bool ReadModel(ModelImport& import)
+    {
+        const char* sourcePath = import.filepath.c_str();
+        std::string cachePath = GetCachePath(sourcePath);
+        AssetFile cacheFile = {};
+        if (!AssetPack::OpenAsset(cachePath.c_str(), cacheFile) || cacheFile.size < sizeof(FileHeader))
+        {
+            AssetPack::CloseAsset(cacheFile);
+            return false;
+        }
+
+        const FileHeader& header = *(const FileHeader*)cacheFile.data;
+        if (!IsCacheValid(header, cacheFile, import))
+        {
+            ILOG("Mesh cache %s is stale, reimporting", cachePath.c_str());
+            AssetPack::CloseAsset(cacheFile);
+            return false;
+        }
+
+        const FileSubMesh* fileSubmeshes = (const FileSubMesh*)(cacheFile.data + sizeof(FileHeader));
+        const FileMaterial* fileMaterials = (const FileMaterial*)(fileSubmeshes + header.submeshCount);
+        const FileDependency* fileDependencies = (const FileDependency*)(fileMaterials + header.materialCount);
+        const Meshlet* fileMeshlets = (const Meshlet*)(cacheFile.data + header.meshletBlobOffset);
+
+        import.materials.resize(header.materialCount);
+        for (u32 i = 0; i < header.materialCount; ++i)
+        {
+            const FileMaterial& fileMaterial = fileMaterials[i];
+            MaterialSource& source = import.materials[i];
+            source.name = fileMaterial.name;
+            source.albedo = fileMaterial.albedo;
+            source.emissive = fileMaterial.emissive;
+            source.smoothness = fileMaterial.smoothness;
+            for (u32 slot = 0; slot < MaterialTexture_Count; ++slot)
+                source.texturePaths[slot] = fileMaterial.texturePaths[slot];
+        }
+
+        for (u32 i = 0; i < header.dependencyCount; ++i)
+            import.dependencies.push_back(fileDependencies[i].path);
+
+        import.mesh.submeshes.resize(header.submeshCount);
+        for (u32 i = 0; i < header.submeshCount; ++i)
+        {
+            const FileSubMesh& fileSubmesh = fileSubmeshes[i];
+            SubMesh& submesh = import.mesh.submeshes[i];
+            submesh.vertexBufferLayout.attributes.assign(fileSubmesh.attributes, fileSubmesh.attributes + fileSubmesh.attributeCount);
+            submesh.vertexBufferLayout.stride = fileSubmesh.stride;
+            submesh.vertexOffset = fileSubmesh.vertexOffset;
+            submesh.indexOffset = fileSubmesh.indexOffset;
+            submesh.indexCount = fileSubmesh.indexCount;
+            submesh.indexType = fileSubmesh.indexType;
+            std::copy(fileSubmesh.lods, fileSubmesh.lods + MESH_LOD_MAX_LEVELS, submesh.lods);
+            submesh.lodCount = fileSubmesh.lodCount;
+            submesh.meshlets.assign(fileMeshlets + fileSubmesh.meshletOffset, fileMeshlets + fileSubmesh.meshletOffset + fileSubmesh.meshletCount);
+
+            import.submeshMaterialIdx.push_back(fileSubmesh.materialIdx);
+
+            // Vertices of consecutive submeshes are packed without padding
+            const u64 vertexEnd = i + 1 < header.submeshCount ? fileSubmeshes[i + 1].vertexOffset : header.vertexBlobSize;
+            submesh.vertexCount = (vertexEnd - fileSubmesh.vertexOffset) / submesh.vertexBufferLayout.stride;
+
+            // The upload reads the blobs directly, CPU copies are only made for models that keep geometry resident
+            if (import.residency != GeometryResidency_Drop)
+            {
+                const u8* vertexData = cacheFile.data + header.vertexBlobOffset + fileSubmesh.vertexOffset;
+                submesh.vertices.assign(vertexData, vertexData + (vertexEnd - fileSubmesh.vertexOffset));
+
+                const u8* indexData = cacheFile.data + header.indexBlobOffset + fileSubmesh.indexOffset;
+                if (submesh.indexType == GL_UNSIGNED_SHORT)
+                    submesh.indices.assign((const u16*)indexData, (const u16*)indexData + submesh.indexCount);
+                else
+                    submesh.indices.assign((const u32*)indexData, (const u32*)indexData + submesh.indexCount);
+            }
+        }
+
+        import.vertexBufferSize = header.vertexBlobSize;
+        import.indexBufferSize = header.indexBlobSize;
+        import.cachedVertexData = cacheFile.data + header.vertexBlobOffset;
+        import.cachedIndexData = cacheFile.data + header.indexBlobOffset;
+        import.coldLoadMs = header.coldLoadMs;
+        import.quantizationStats = header.quantizationStats;
+        import.optimizationStats = header.optimizationStats;
+        import.cacheFile = std::move(cacheFile); // keeps the decompressed buffer the blobs point into
+
+        return true;
+    }
+
+    bool WriteModel(const ModelImport& import)
+    {
+        const char* sourcePath = import.filepath.c_str();
+        const Mesh& mesh = import.mesh;
+        const std::vector<MaterialSource>& materials = import.materials;
+
+        FileHeader header = {};
+        if (!AssetPack::GetSourceStamp(sourcePath, header.source))
+            return false;
+
+        header.magic = MESH_CACHE_MAGIC;
+        header.version = MESH_CACHE_VERSION;
+        header.vertexQuantization = import.vertexQuantization;
+        header.quantizationStats = import.quantizationStats;
+        header.optimizationStats = import.optimizationStats;
+        header.coldLoadMs = import.coldLoadMs;
+        header.submeshCount = mesh.submeshes.size();
+        header.materialCount = materials.size();
+        header.vertexBlobSize = import.vertexBufferSize;
+        header.indexBlobSize = import.indexBufferSize;
+
+        std::vector<FileSubMesh> fileSubmeshes(header.submeshCount);
+        std::vector<Meshlet> meshlets;
+        for (u32 i = 0; i < header.submeshCount; ++i)
+        {
+            const SubMesh& submesh = mesh.submeshes[i];
+            FileSubMesh& fileSubmesh = fileSubmeshes[i];
+            fileSubmesh = {};
+
+            const std::vector<VertexBufferAttribute>& attributes = submesh.vertexBufferLayout.attributes;
+            ASSERT(attributes.size() <= MESH_CACHE_MAX_ATTRIBUTES, "Too many vertex attributes for the mesh cache");
+            for (u32 j = 0; j < attributes.size(); ++j)
+                fileSubmesh.attributes[j] = attributes[j];
+            fileSubmesh.attributeCount = attributes.size();
+            fileSubmesh.stride = submesh.vertexBufferLayout.stride;
+            fileSubmesh.materialIdx = import.submeshMaterialIdx[i];
+            fileSubmesh.vertexOffset = submesh.vertexOffset;
+            fileSubmesh.indexOffset = submesh.indexOffset;
+            fileSubmesh.indexCount = submesh.indexCount;
+            fileSubmesh.indexType = submesh.indexType;
+            fileSubmesh.meshletOffset = meshlets.size();
+            fileSubmesh.meshletCount = submesh.meshlets.size();
+            std::copy(submesh.lods, submesh.lods + MESH_LOD_MAX_LEVELS, fileSubmesh.lods);
+            fileSubmesh.lodCount = submesh.lodCount;
+            meshlets.insert(meshlets.end(), submesh.meshlets.begin(), submesh.meshlets.end());
+        }
+        std::vector<FileMaterial> fileMaterials(header.materialCount);
+        for (u32 i = 0; i < header.materialCount; ++i)
+        {
+            const MaterialSource& material = materials[i];
+            FileMaterial& fileMaterial = fileMaterials[i];
+            fileMaterial = {};
+
+            CopyString(fileMaterial.name, MESH_CACHE_NAME_LENGTH, material.name);
+            fileMaterial.albedo = material.albedo;
+            fileMaterial.emissive = material.emissive;
+            fileMaterial.smoothness = material.smoothness;
+            for (u32 slot = 0; slot < MaterialTexture_Count; ++slot)
+                CopyString(fileMaterial.texturePaths[slot], MESH_CACHE_PATH_LENGTH, material.texturePaths[slot]);
+        }
+
+        // Stamped now, an edit made while the import ran then shows up as stale next time
+        std::vector<FileDependency> fileDependencies;
+        for (const std::string& dependency : import.dependencies)
+        {
+            const std::string path = AssetPack::NormalizePath(dependency.c_str());
+            bool listed = false;
+            for (const FileDependency& existing : fileDependencies)
+                listed |= path == existing.path;
+            if (listed)
+                continue;
+
+            FileDependency fileDependency = {};
+            CopyString(fileDependency.path, MESH_CACHE_PATH_LENGTH, path);
+            if (!AssetPack::GetSourceStamp(path.c_str(), fileDependency.stamp))
+            {
+                ELOG("Mesh cache of %s not written, its dependency %s can't be stamped", sourcePath, path.c_str());
+                return false;
+            }
+            fileDependencies.push_back(fileDependency);
+        }
+        header.dependencyCount = fileDependencies.size();
+
+        u64 tablesSize = sizeof(FileHeader) + sizeof(FileSubMesh) * fileSubmeshes.size() + sizeof(FileMaterial) * fileMaterials.size() +
+                         sizeof(FileDependency) * fileDependencies.size();
+        header.vertexBlobOffset = BufferManager::Align(tablesSize, MESH_CACHE_BLOB_ALIGNMENT);
+        header.indexBlobOffset = BufferManager::Align(header.vertexBlobOffset + header.vertexBlobSize, MESH_CACHE_BLOB_ALIGNMENT);
+        header.meshletBlobOffset = BufferManager::Align(header.indexBlobOffset + header.indexBlobSize, MESH_CACHE_BLOB_ALIGNMENT);
+        header.meshletCount = meshlets.size();
+
+        // Streamed to the file piece by piece, so the import never holds a second copy of the mesh
+        std::string cachePath = GetCachePath(sourcePath);
+        FILE* file = fopen(cachePath.c_str(), "wb");
+        if (!file)
+        {
+            ELOG("fopen() failed writing file %s", cachePath.c_str());
+            return false;
+        }
+
+        u64 cursor = 0;
+        bool success = WriteAt(file, cursor, 0, &header, sizeof(header));
+        success &= WriteAt(file, cursor, cursor, fileSubmeshes.data(), sizeof(FileSubMesh) * fileSubmeshes.size());
+        success &= WriteAt(file, cursor, cursor, fileMaterials.data(), sizeof(FileMaterial) * fileMaterials.size());
+        success &= WriteAt(file, cursor, cursor, fileDependencies.data(), sizeof(FileDependency) * fileDependencies.size());
+
+        for (const SubMesh& submesh : mesh.submeshes)
+            success &= WriteAt(file, cursor, header.vertexBlobOffset + submesh.vertexOffset, submesh.vertices.data(), submesh.vertices.size());
+
+        std::vector<u8> indexData;
+        for (const SubMesh& submesh : mesh.submeshes)
+        {
+            indexData.resize(submesh.indices.size() * ModelLoader::GetIndexSize(submesh.indexType));
+            ModelLoader::WriteIndices(submesh, indexData.data());
+            success &= WriteAt(file, cursor, header.indexBlobOffset + submesh.indexOffset, indexData.data(), indexData.size());
+        }
+
+        success &= WriteAt(file, cursor, header.meshletBlobOffset, meshlets.data(), sizeof(Meshlet) * meshlets.size());
+        fclose(file);
+
+        if (success)
+        {
+            ILOG("Wrote mesh cache %s (%u bytes)", cachePath.c_str(), (u32)cursor);
+        }
+        else
+        {
+            ELOG("Could not write mesh cache %s", cachePath.c_str());
+            remove(cachePath.c_str());
+        }
+        return success;
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef MESH_CACHE_FUNC
+#define MESH_CACHE_FUNC
+
+#include "Globals.h"
+#include "ModelLoadingFunctions.h"
+
+// Binary cache of imported models, stored next to the source asset. It keeps
+// the interleaved, already narrowed vertex blob and the index blob, so a warm
+// start maps the file and UploadMesh splits the vertices into the streams of
+// the geometry pool, writing them and the indices through glMapBufferRange on
+// the TLSF ranges of the mesh. The cache also stamps every file the import
+// read (the model and its .mtl), a change to any of them rejects it.
+#define MESH_CACHE_EXTENSION ".kmesh"
+#define MESH_CACHE_MAGIC     0x48534d4b // "KMSH"
+#define MESH_CACHE_VERSION   8
+
+namespace MeshCache
+{
+    std::string GetCachePath(const char* sourcePath);
+
+    // Returns false if there is no valid cache for import.filepath and
+    // import.vertexQuantization. On success the
+    // cache stays mapped in import.cacheFile and the blobs point into it.
+    // Safe to call from worker threads.
+    bool ReadModel(ModelImport& import);
+
+    // Returns false when the cache could not be written, the model then just reimports next time
+    bool WriteModel(const ModelImport& import);
+}
+
+#endif // !MESH_CACHE_FUNC
@@ -0,0 +1,460 @@
+#include "MeshOptimizerFunctions.h"
+
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <cfloat>
+
+namespace MeshOptimizer
+{
+    // FIFO cache simulation: a vertex is cached while fewer than cacheSize
+    // misses happened since it was loaded
+    struct FifoCache
+    {
+        std::vector<u32> timestamps;
+        u32              time;
+        u32              size;
+    };
+
+    static FifoCache MakeFifoCache(u32 vertexCount, u32 cacheSize)
+    {
+        FifoCache cache = {};
+        cache.timestamps.assign(vertexCount, 0);
+        cache.time = cacheSize + 1;
+        cache.size = cacheSize;
+        return cache;
+    }
+
+    static u32 FetchVertex(FifoCache& cache, u32 index)
+    {
+        if (cache.time - cache.timestamps[index] > cache.size)
+        {
+            cache.timestamps[index] = cache.time++;
+            return 1;
+        }
+        return 0;
+    }
+
+    static void FlushCache(FifoCache& cache)
+    {
+        cache.time += cache.size + 1;
+    }
+
+    VertexCacheStats AnalyzeVertexCache(const std::vector<u32>& indices, u32 vertexCount, u32 cacheSize)
+    {
+        VertexCacheStats stats = {};
+        FifoCache cache = MakeFifoCache(vertexCount, cacheSize);
+
+        std::vector<u8> referenced(vertexCount, 0);
+        u32 referencedCount = 0;
+        for (u32 index : indices)
+        {
+            stats.misses += FetchVertex(cache, index);
+            referencedCount += referenced[index] ? 0 : 1;
+            referenced[index] = 1;
+        }
+
+        const u32 triangleCount = indices.size() / 3;
+        stats.acmr = triangleCount ? (f32)stats.misses / triangleCount : 0.0f;
+        stats.atvr = referencedCount ? (f32)stats.misses / referencedCount : 0.0f;
+        return stats;
+    }
+
+    static void RasterizeTriangle(const vec3& v0, const vec3& v1, const vec3& v2, std::vector<f32>& depth, OverdrawStats& stats)
+    {
+        const f32 area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+        if (area <= 0.0f)
+            return; // back facing or degenerate
+
+        const i32 resolution = MESH_OPTIMIZER_OVERDRAW_RESOLUTION;
+        const i32 minX = std::max(0, (i32)floorf(std::min(v0.x, std::min(v1.x, v2.x))));
+        const i32 minY = std::max(0, (i32)floorf(std::min(v0.y, std::min(v1.y, v2.y))));
+        const i32 maxX = std::min(resolution - 1, (i32)ceilf(std::max(v0.x, std::max(v1.x, v2.x))));
+        const i32 maxY = std::min(resolution - 1, (i32)ceilf(std::max(v0.y, std::max(v1.y, v2.y))));
+
+        const f32 invArea = 1.0f / area;
+        for (i32 y = minY; y <= maxY; ++y)
+        {
+            const f32 py = y + 0.5f;
+            for (i32 x = minX; x <= maxX; ++x)
+            {
+                const f32 px = x + 0.5f;
+                const f32 w0 = (v2.x - v1.x) * (py - v1.y) - (v2.y - v1.y) * (px - v1.x);
+                const f32 w1 = (v0.x - v2.x) * (py - v2.y) - (v0.y - v2.y) * (px - v2.x);
+                const f32 w2 = (v1.x - v0.x) * (py - v0.y) - (v1.y - v0.y) * (px - v0.x);
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                    continue;
+
+                // Early depth test: only fragments in front of what is there get shaded
+                const f32 z = (w0 * v0.z + w1 * v1.z + w2 * v2.z) * invArea;
+                f32& pixelDepth = depth[y * resolution + x];
+                if (z < pixelDepth)
+                {
+                    pixelDepth = z;
+                    stats.shadedPixels++;
+                }
+            }
+        }
+    }
+
+    OverdrawStats AnalyzeOverdraw(const std::vector<u32>& indices, const std::vector<vec3>& positions)
+    {
+        OverdrawStats stats = {};
+        if (indices.empty())
+            return stats;
+
+        vec3 boundsMin(FLT_MAX);
+        vec3 boundsMax(-FLT_MAX);
+        for (const vec3& position : positions)
+        {
+            boundsMin = glm::min(boundsMin, position);
+            boundsMax = glm::max(boundsMax, position);
+        }
+        const vec3 extent = boundsMax - boundsMin;
+        const f32 maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+        const f32 scale = maxExtent > 0.0f ? (MESH_OPTIMIZER_OVERDRAW_RESOLUTION - 1) / maxExtent : 0.0f;
+
+        const u32 pixelCount = MESH_OPTIMIZER_OVERDRAW_RESOLUTION * MESH_OPTIMIZER_OVERDRAW_RESOLUTION;
+        std::vector<f32> depth(pixelCount);
+        std::vector<vec3> projected(positions.size());
+
+        // Look down each axis from both sides. (u, v, axis) is right handed, so
+        // counter clockwise triangles facing the camera keep a positive area.
+        for (u32 axis = 0; axis < 3; ++axis)
+        {
+            const u32 u = (axis + 1) % 3;
+            const u32 v = (axis + 2) % 3;
+            for (u32 side = 0; side < 2; ++side)
+            {
+                for (u32 i = 0; i < positions.size(); ++i)
+                {
+                    const vec3 p = (positions[i] - boundsMin) * scale;
+                    if (side == 0)
+                        projected[i] = vec3(p[u], p[v], extent[axis] * scale - p[axis]); // camera on the + side
+                    else
+                        projected[i] = vec3(MESH_OPTIMIZER_OVERDRAW_RESOLUTION - 1 - p[u], p[v], p[axis]);
+                }
+
+                std::fill(depth.begin(), depth.end(), FLT_MAX);
+                for (u32 i = 0; i + 2 < indices.size(); i += 3)
+                    RasterizeTriangle(projected[indices[i]], projected[indices[i + 1]], projected[indices[i + 2]], depth, stats);
+
+                for (u32 i = 0; i < pixelCount; ++i)
+                    stats.coveredPixels += depth[i] != FLT_MAX ? 1 : 0;
+            }
+        }
+
+        stats.overdraw = stats.coveredPixels ? (f32)stats.shadedPixels / stats.coveredPixels : 0.0f;
+        return stats;
+    }
+
+    static f32 ForsythVertexScore(i32 cachePosition, u32 liveTriangles)
+    {
+        if (liveTriangles == 0)
+            return -1.0f;
+
+        f32 score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            // The vertices of the last triangle get a fixed score, so the next
+            // triangle is not biased towards reusing exactly those
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = powf(1.0f - (cachePosition - 3) / (f32)(MESH_OPTIMIZER_CACHE_SIZE - 3), 1.5f);
+        }
+
+        // Vertices with few triangles left are worth finishing off
+        score += 2.0f * powf((f32)liveTriangles, -0.5f);
+        return score;
+    }
+
+    void OptimizeVertexCache(std::vector<u32>& indices, u32 vertexCount)
+    {
+        const u32 triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        // Triangles adjacent to every vertex, the live ones first
+        std::vector<u32> liveTriangles(vertexCount, 0);
+        for (u32 index : indices)
+            liveTriangles[index]++;
+
+        std::vector<u32> adjacencyOffsets(vertexCount + 1, 0);
+        for (u32 v = 0; v < vertexCount; ++v)
+            adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+
+        std::vector<u32> adjacency(indices.size());
+        std::vector<u32> adjacencyCursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (u32 i = 0; i < indices.size(); ++i)
+            adjacency[adjacencyCursor[indices[i]]++] = i / 3;
+
+        std::vector<i32> cachePositions(vertexCount, -1);
+        std::vector<f32> vertexScores(vertexCount);
+        for (u32 v = 0; v < vertexCount; ++v)
+            vertexScores[v] = ForsythVertexScore(-1, liveTriangles[v]);
+
+        std::vector<f32> triangleScores(triangleCount);
+        std::vector<u8> emitted(triangleCount, 0);
+        u32 bestTriangle = 0;
+        for (u32 t = 0; t < triangleCount; ++t)
+        {
+            triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+            if (triangleScores[t] > triangleScores[bestTriangle])
+                bestTriangle = t;
+        }
+
+        std::vector<u32> output;
+        output.reserve(indices.size());
+        std::vector<u32> cache;
+        std::vector<u32> newCache;
+        u32 scanCursor = 0;
+
+        for (u32 emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+        {
+            if (bestTriangle == UINT32_MAX)
+            {
+                // Nothing in the cache leads anywhere, go on with the next triangle in input order
+                while (emitted[scanCursor])
+                    ++scanCursor;
+                bestTriangle = scanCursor;
+            }
+
+            const u32 triangle[3] = { indices[bestTriangle * 3], indices[bestTriangle * 3 + 1], indices[bestTriangle * 3 + 2] };
+            output.insert(output.end(), triangle, triangle + 3);
+            emitted[bestTriangle] = 1;
+
+            for (u32 k = 0; k < 3; ++k)
+            {
+                const u32 v = triangle[k];
+                u32* begin = &adjacency[adjacencyOffsets[v]];
+                u32* end = begin + liveTriangles[v];
+                u32* it = std::find(begin, end, bestTriangle);
+                if (it != end)
+                {
+                    *it = *(end - 1);
+                    liveTriangles[v]--;
+                }
+            }
+
+            // The triangle's vertices move to the front of the LRU cache
+            newCache.clear();
+            for (u32 k = 0; k < 3; ++k)
+            {
+                if (std::find(newCache.begin(), newCache.end(), triangle[k]) == newCache.end())
+                    newCache.push_back(triangle[k]);
+            }
+            for (u32 v : cache)
+            {
+                if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                    newCache.push_back(v);
+            }
+
+            for (u32 i = 0; i < newCache.size(); ++i)
+            {
+                const u32 v = newCache[i];
+                cachePositions[v] = i < MESH_OPTIMIZER_CACHE_SIZE ? (i32)i : -1;
+                vertexScores[v] = ForsythVertexScore(cachePositions[v], liveTriangles[v]);
+            }
+
+            // Only triangles touching the cache are candidates for the next step,
+            // evicted vertices still need their triangles rescored
+            bestTriangle = UINT32_MAX;
+            f32 bestScore = -FLT_MAX;
+            for (u32 v : newCache)
+            {
+                for (u32 i = adjacencyOffsets[v]; i < adjacencyOffsets[v] + liveTriangles[v]; ++i)
+                {
+                    const u32 t = adjacency[i];
+                    triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+                    if (cachePositions[v] >= 0 && triangleScores[t] > bestScore)
+                    {
+                        bestScore = triangleScores[t];
+                        bestTriangle = t;
+                    }
+                }
+            }
+
+            if (newCache.size() > MESH_OPTIMIZER_CACHE_SIZE)
+                newCache.resize(MESH_OPTIMIZER_CACHE_SIZE);
+            cache.swap(newCache);
+        }
+
+        indices.swap(output);
+    }
+
+    void OptimizeOverdraw(std::vector<u32>& indices, const std::vector<vec3>& positions, f32 threshold)
+    {
+        const u32 triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        // Hard boundaries: triangles that miss on all three vertices, the cache starts over there anyway
+        FifoCache cache = MakeFifoCache(positions.size(), MESH_OPTIMIZER_FIFO_SIZE);
+        std::vector<u32> triangleMisses(triangleCount);
+        std::vector<u32> hardClusters;
+        for (u32 t = 0; t < triangleCount; ++t)
+        {
+            triangleMisses[t] = FetchVertex(cache, indices[t * 3]) + FetchVertex(cache, indices[t * 3 + 1]) + FetchVertex(cache, indices[t * 3 + 2]);
+            if (t == 0 || triangleMisses[t] == 3)
+                hardClusters.push_back(t);
+        }
+        hardClusters.push_back(triangleCount);
+
+        // Soft boundaries: cut every hard cluster into the smallest pieces that
+        // still keep its ACMR under the threshold
+        std::vector<u32> clusters;
+        for (u32 c = 0; c + 1 < hardClusters.size(); ++c)
+        {
+            const u32 start = hardClusters[c];
+            const u32 end = hardClusters[c + 1];
+
+            u32 clusterMisses = 0;
+            for (u32 t = start; t < end; ++t)
+                clusterMisses += triangleMisses[t];
+            const f32 clusterThreshold = threshold * clusterMisses / (end - start);
+
+            clusters.push_back(start);
+            FlushCache(cache);
+            u32 misses = 0;
+            u32 triangles = 0;
+            for (u32 t = start; t < end; ++t)
+            {
+                misses += FetchVertex(cache, indices[t * 3]) + FetchVertex(cache, indices[t * 3 + 1]) + FetchVertex(cache, indices[t * 3 + 2]);
+                triangles++;
+                if (t + 1 < end && misses <= clusterThreshold * triangles)
+                {
+                    clusters.push_back(t + 1);
+                    FlushCache(cache);
+                    misses = 0;
+                    triangles = 0;
+                }
+            }
+        }
+        clusters.push_back(triangleCount);
+
+        // Clusters on the outside facing away from the center are likely to occlude the rest, draw them first
+        vec3 meshCentroid(0.0f);
+        for (const vec3& position : positions)
+            meshCentroid += position;
+        meshCentroid /= (f32)std::max<size_t>(1, positions.size());
+
+        const u32 clusterCount = clusters.size() - 1;
+        std::vector<f32> sortKeys(clusterCount);
+        for (u32 c = 0; c < clusterCount; ++c)
+        {
+            vec3 centroid(0.0f);
+            vec3 normal(0.0f);
+            f32 area = 0.0f;
+            for (u32 t = clusters[c]; t < clusters[c + 1]; ++t)
+            {
+                const vec3& p0 = positions[indices[t * 3]];
+                const vec3& p1 = positions[indices[t * 3 + 1]];
+                const vec3& p2 = positions[indices[t * 3 + 2]];
+                const vec3 triangleNormal = glm::cross(p1 - p0, p2 - p0); // length is twice the area
+                const f32 triangleArea = glm::length(triangleNormal);
+
+                centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+                normal += triangleNormal;
+                area += triangleArea;
+            }
+
+            const f32 normalLength = glm::length(normal);
+            if (area > 0.0f && normalLength > 0.0f)
+                sortKeys[c] = glm::dot(centroid / area - meshCentroid, normal / normalLength);
+            else
+                sortKeys[c] = 0.0f;
+        }
+
+        std::vector<u32> order(clusterCount);
+        for (u32 c = 0; c < clusterCount; ++c)
+            order[c] = c;
+        std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b) { return sortKeys[a] > sortKeys[b]; });
+
+        std::vector<u32> output;
+        output.reserve(indices.size());
+        for (u32 c : order)
+            output.insert(output.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+        indices.swap(output);
+    }
+
+    u32 OptimizeVertexFetch(std::vector<u8>& vertices, u32 stride, std::vector<u32>& indices)
+    {
+        const u32 vertexCount = vertices.size() / stride;
+        std::vector<u32> remap(vertexCount, UINT32_MAX);
+
+        u32 nextVertex = 0;
+        for (u32& index : indices)
+        {
+            if (remap[index] == UINT32_MAX)
+                remap[index] = nextVertex++;
+            index = remap[index];
+        }
+
+        std::vector<u8> reordered(nextVertex * stride);
+        for (u32 v = 0; v < vertexCount; ++v)
+        {
+            if (remap[v] != UINT32_MAX)
+                memcpy(&reordered[remap[v] * stride], &vertices[v * stride], stride);
+        }
+        vertices.swap(reordered);
+
+        return nextVertex;
+    }
+
+    std::vector<vec3> ReadPositions(const SubMesh& submesh)
+    {
+        const u32 stride = submesh.vertexBufferLayout.stride;
+        const u32 vertexCount = submesh.vertices.size() / stride;
+        std::vector<vec3> positions(vertexCount);
+
+        for (const VertexBufferAttribute& attribute : submesh.vertexBufferLayout.attributes)
+        {
+            if (attribute.location != 0)
+                continue;
+
+            for (u32 v = 0; v < vertexCount; ++v)
+            {
+                const u8* data = submesh.vertices.data() + v * stride + attribute.offset;
+                if (attribute.type == GL_HALF_FLOAT)
+                {
+                    u64 packed;
+                    memcpy(&packed, data, sizeof(packed));
+                    positions[v] = vec3(glm::unpackHalf4x16(packed));
+                }
+                else
+                {
+                    memcpy(&positions[v], data, sizeof(vec3));
+                }
+            }
+        }
+
+        return positions;
+    }
+
+    void OptimizeSubMesh(SubMesh& submesh, MeshOptimizationStats& stats)
+    {
+        const u32 stride = submesh.vertexBufferLayout.stride;
+        const u32 vertexCount = submesh.vertices.size() / stride;
+        const std::vector<vec3> positions = ReadPositions(submesh);
+
+        stats.triangleCount = submesh.indices.size() / 3;
+
+        VertexCacheStats cacheStats = AnalyzeVertexCache(submesh.indices, vertexCount, MESH_OPTIMIZER_FIFO_SIZE);
+        OverdrawStats overdrawStats = AnalyzeOverdraw(submesh.indices, positions);
+        stats.acmrBefore = cacheStats.acmr;
+        stats.atvrBefore = cacheStats.atvr;
+        stats.overdrawBefore = overdrawStats.overdraw;
+
+        OptimizeVertexCache(submesh.indices, vertexCount);
+        OptimizeOverdraw(submesh.indices, positions, MESH_OPTIMIZER_OVERDRAW_THRESHOLD);
+
+        cacheStats = AnalyzeVertexCache(submesh.indices, vertexCount, MESH_OPTIMIZER_FIFO_SIZE);
+        overdrawStats = AnalyzeOverdraw(submesh.indices, positions);
+        stats.acmrAfter = cacheStats.acmr;
+        stats.atvrAfter = cacheStats.atvr;
+        stats.overdrawAfter = overdrawStats.overdraw;
+
+        // Renumbering the vertices does not change the metrics above
+        OptimizeVertexFetch(submesh.vertices, stride, submesh.indices);
+    }
+}
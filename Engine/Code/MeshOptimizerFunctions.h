@@ -0,0 +1,55 @@
+#ifndef MESH_OPTIMIZER_FUNC
+#define MESH_OPTIMIZER_FUNC
+
+#include "Globals.h"
+#include <vector>
+
+// Reorders the triangles and vertices of imported submeshes for the GPU:
+// triangles for the post-transform vertex cache (Forsyth), then clusters of
+// them front to back to reduce overdraw (Sander et al.), then vertices in
+// first-use order for fetch locality. Every step is deterministic, so the
+// result can be cached.
+#define MESH_OPTIMIZER_CACHE_SIZE        32   // LRU entries scored by the Forsyth heuristic
+#define MESH_OPTIMIZER_FIFO_SIZE         16   // FIFO cache used to measure ACMR/ATVR
+#define MESH_OPTIMIZER_OVERDRAW_THRESHOLD 1.05f // allowed ACMR increase when reordering for overdraw
+#define MESH_OPTIMIZER_OVERDRAW_RESOLUTION 256
+
+struct VertexCacheStats
+{
+    u32 misses;
+    f32 acmr; // average cache miss ratio: misses per triangle, 0.5 is ideal
+    f32 atvr; // average transformed vertex ratio: misses per vertex, 1.0 is ideal
+};
+
+struct OverdrawStats
+{
+    u32 coveredPixels;
+    u32 shadedPixels;
+    f32 overdraw; // shaded / covered, 1.0 is ideal
+};
+
+namespace MeshOptimizer
+{
+    VertexCacheStats AnalyzeVertexCache(const std::vector<u32>& indices, u32 vertexCount, u32 cacheSize);
+
+    // Rasterizes the mesh from the 6 axis directions with early depth testing
+    OverdrawStats AnalyzeOverdraw(const std::vector<u32>& indices, const std::vector<vec3>& positions);
+
+    void OptimizeVertexCache(std::vector<u32>& indices, u32 vertexCount);
+
+    // Expects cache optimized indices. Clusters are only split where it keeps the
+    // ACMR under threshold times the ACMR of the input.
+    void OptimizeOverdraw(std::vector<u32>& indices, const std::vector<vec3>& positions, f32 threshold);
+
+    // Renumbers the vertices in first-use order and drops unreferenced ones.
+    // Returns the new vertex count.
+    u32 OptimizeVertexFetch(std::vector<u8>& vertices, u32 stride, std::vector<u32>& indices);
+
+    // Decodes the positions (location 0) of a submesh, float or half
+    std::vector<vec3> ReadPositions(const SubMesh& submesh);
+
+    // Runs the three passes on submesh.vertices/indices, before LayoutMesh
+    void OptimizeSubMesh(SubMesh& submesh, MeshOptimizationStats& stats);
+}
+
+#endif // !MESH_OPTIMIZER_FUNC
@@ -0,0 +1,453 @@
+#include "MeshSimplifierFunctions.h"
+#include "MeshOptimizerFunctions.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace MeshSimplifier
+{
+    // Fraction of the full detail triangles every level aims for
+    static const f32 LodTriangleRatios[MESH_LOD_MAX_LEVELS] = { 1.0f, 0.5f, 0.25f, 0.1f, 0.03f };
+
+    // Weighted sum of squared distances to a set of planes: p.A.p + 2 b.p + c.
+    // weight only accumulates the triangle areas, so the error of a collapse is
+    // the mean squared distance to the surface it replaces.
+    struct Quadric
+    {
+        f64 a00, a01, a02, a11, a12, a22;
+        f64 b0, b1, b2;
+        f64 c;
+        f64 weight;
+    };
+
+    struct Collapse
+    {
+        u32 from;
+        u32 to;
+        f32 cost;
+    };
+
+    struct SimplifierMesh
+    {
+        const std::vector<vec3>* positions;
+        std::vector<u32>     welded;   // vertex -> lowest vertex at the same position
+        std::vector<Quadric> quadrics; // by welded vertex
+
+        // Rebuilt every pass
+        std::vector<u32> triangleOffsets; // welded vertex -> first entry in triangles
+        std::vector<u32> triangles;
+        std::vector<u8>  isBorder;
+        std::vector<u8>  touched;
+        std::vector<u32> wedgeRemap;
+
+        // Scratch of CanCollapse
+        std::vector<std::pair<u32, u32>> wedgePairs;
+        std::vector<u32> fromNeighbours;
+        std::vector<u32> toNeighbours;
+        std::vector<u32> commonNeighbours;
+    };
+
+    static void AddPlane(Quadric& q, const vec3& n, f32 d, f32 weight)
+    {
+        q.a00 += weight * n.x * n.x;
+        q.a01 += weight * n.x * n.y;
+        q.a02 += weight * n.x * n.z;
+        q.a11 += weight * n.y * n.y;
+        q.a12 += weight * n.y * n.z;
+        q.a22 += weight * n.z * n.z;
+        q.b0 += weight * n.x * d;
+        q.b1 += weight * n.y * d;
+        q.b2 += weight * n.z * d;
+        q.c += weight * d * d;
+    }
+
+    static void AddQuadric(Quadric& q, const Quadric& other)
+    {
+        q.a00 += other.a00;
+        q.a01 += other.a01;
+        q.a02 += other.a02;
+        q.a11 += other.a11;
+        q.a12 += other.a12;
+        q.a22 += other.a22;
+        q.b0 += other.b0;
+        q.b1 += other.b1;
+        q.b2 += other.b2;
+        q.c += other.c;
+        q.weight += other.weight;
+    }
+
+    static f32 EvaluateQuadric(const Quadric& q, const vec3& p)
+    {
+        const f64 x = p.x;
+        const f64 y = p.y;
+        const f64 z = p.z;
+        const f64 value = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z
+                        + 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+                        + 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+        return q.weight > 0.0 ? (f32)std::max(value / q.weight, 0.0) : 0.0f;
+    }
+
+    static void WeldPositions(const std::vector<vec3>& positions, std::vector<u32>& welded)
+    {
+        std::vector<u32> order(positions.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](u32 a, u32 b)
+        {
+            const vec3& pa = positions[a];
+            const vec3& pb = positions[b];
+            if (pa.x != pb.x)
+                return pa.x < pb.x;
+            if (pa.y != pb.y)
+                return pa.y < pb.y;
+            if (pa.z != pb.z)
+                return pa.z < pb.z;
+            return a < b;
+        });
+
+        welded.resize(positions.size());
+        for (u32 i = 0; i < order.size(); ++i)
+        {
+            const bool samePosition = i > 0 && positions[order[i]] == positions[order[i - 1]];
+            welded[order[i]] = samePosition ? welded[order[i - 1]] : order[i];
+        }
+    }
+
+    static void BuildAdjacency(SimplifierMesh& mesh, const std::vector<u32>& indices)
+    {
+        const u32 vertexCount = mesh.welded.size();
+        mesh.triangleOffsets.assign(vertexCount + 1, 0);
+        for (u32 index : indices)
+            mesh.triangleOffsets[mesh.welded[index] + 1]++;
+        for (u32 v = 0; v < vertexCount; ++v)
+            mesh.triangleOffsets[v + 1] += mesh.triangleOffsets[v];
+
+        mesh.triangles.resize(indices.size());
+        std::vector<u32> cursor(mesh.triangleOffsets.begin(), mesh.triangleOffsets.end() - 1);
+        for (u32 i = 0; i < indices.size(); ++i)
+            mesh.triangles[cursor[mesh.welded[indices[i]]]++] = i / 3;
+    }
+
+    // Triangles around welded vertex a that also use welded vertex b
+    static u32 CountEdgeTriangles(const SimplifierMesh& mesh, const std::vector<u32>& indices, u32 a, u32 b)
+    {
+        u32 count = 0;
+        for (u32 i = mesh.triangleOffsets[a]; i < mesh.triangleOffsets[a + 1]; ++i)
+        {
+            const u32* triangle = &indices[mesh.triangles[i] * 3];
+            if (mesh.welded[triangle[0]] == b || mesh.welded[triangle[1]] == b || mesh.welded[triangle[2]] == b)
+                count++;
+        }
+        return count;
+    }
+
+    static void GatherNeighbours(const SimplifierMesh& mesh, const std::vector<u32>& indices, u32 v, std::vector<u32>& neighbours)
+    {
+        neighbours.clear();
+        for (u32 i = mesh.triangleOffsets[v]; i < mesh.triangleOffsets[v + 1]; ++i)
+        {
+            const u32* triangle = &indices[mesh.triangles[i] * 3];
+            for (u32 k = 0; k < 3; ++k)
+            {
+                if (mesh.welded[triangle[k]] != v)
+                    neighbours.push_back(mesh.welded[triangle[k]]);
+            }
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    }
+
+    static void InitQuadrics(SimplifierMesh& mesh, const std::vector<u32>& indices)
+    {
+        const std::vector<vec3>& positions = *mesh.positions;
+        mesh.quadrics.assign(mesh.welded.size(), Quadric{});
+
+        for (u32 t = 0; t < indices.size() / 3; ++t)
+        {
+            const u32* triangle = &indices[t * 3];
+            const vec3& p0 = positions[triangle[0]];
+            const vec3 normal = glm::cross(positions[triangle[1]] - p0, positions[triangle[2]] - p0);
+            const f32 length = glm::length(normal);
+            if (length <= 0.0f)
+                continue;
+
+            const vec3 n = normal / length;
+            const f32 area = length * 0.5f;
+            for (u32 k = 0; k < 3; ++k)
+            {
+                Quadric& q = mesh.quadrics[mesh.welded[triangle[k]]];
+                AddPlane(q, n, -glm::dot(n, p0), area);
+                q.weight += area;
+            }
+
+            // Open edges get a plane perpendicular to the triangle, so border
+            // vertices resist moving away from the border line
+            for (u32 k = 0; k < 3; ++k)
+            {
+                const u32 a = mesh.welded[triangle[k]];
+                const u32 b = mesh.welded[triangle[(k + 1) % 3]];
+                if (CountEdgeTriangles(mesh, indices, a, b) != 1)
+                    continue;
+
+                const vec3 edge = positions[b] - positions[a];
+                const vec3 edgeNormal = glm::cross(edge, n);
+                const f32 edgeNormalLength = glm::length(edgeNormal);
+                if (edgeNormalLength <= 0.0f)
+                    continue;
+
+                const vec3 borderNormal = edgeNormal / edgeNormalLength;
+                const f32 weight = MESH_SIMPLIFIER_BORDER_WEIGHT * glm::dot(edge, edge);
+                AddPlane(mesh.quadrics[a], borderNormal, -glm::dot(borderNormal, positions[a]), weight);
+                AddPlane(mesh.quadrics[b], borderNormal, -glm::dot(borderNormal, positions[a]), weight);
+            }
+        }
+    }
+
+    // Fills mesh.wedgePairs with the vertex each corner of 'from' turns into
+    static bool CanCollapse(SimplifierMesh& mesh, const std::vector<u32>& indices, u32 from, u32 to)
+    {
+        const std::vector<vec3>& positions = *mesh.positions;
+        std::vector<std::pair<u32, u32>>& wedgePairs = mesh.wedgePairs;
+        wedgePairs.clear();
+
+        // Every vertex at the position of 'from' must share a triangle with a
+        // vertex at the position of 'to', so seams collapse along themselves
+        for (u32 i = mesh.triangleOffsets[from]; i < mesh.triangleOffsets[from + 1]; ++i)
+        {
+            const u32* triangle = &indices[mesh.triangles[i] * 3];
+            u32 fromCorner = UINT32_MAX;
+            u32 toCorner = UINT32_MAX;
+            for (u32 k = 0; k < 3; ++k)
+            {
+                if (mesh.welded[triangle[k]] == from)
+                    fromCorner = triangle[k];
+                else if (mesh.welded[triangle[k]] == to)
+                    toCorner = triangle[k];
+            }
+            if (toCorner == UINT32_MAX)
+                continue;
+
+            bool found = false;
+            for (const std::pair<u32, u32>& pair : wedgePairs)
+            {
+                if (pair.first == fromCorner)
+                {
+                    if (pair.second != toCorner)
+                        return false; // ambiguous
+                    found = true;
+                }
+            }
+            if (!found)
+                wedgePairs.push_back(std::make_pair(fromCorner, toCorner));
+        }
+
+        for (u32 i = mesh.triangleOffsets[from]; i < mesh.triangleOffsets[from + 1]; ++i)
+        {
+            const u32* triangle = &indices[mesh.triangles[i] * 3];
+            u32 fromK = 0;
+            bool hasTo = false;
+            for (u32 k = 0; k < 3; ++k)
+            {
+                if (mesh.welded[triangle[k]] == from)
+                    fromK = k;
+                hasTo |= mesh.welded[triangle[k]] == to;
+            }
+
+            bool paired = false;
+            for (const std::pair<u32, u32>& pair : wedgePairs)
+                paired |= pair.first == triangle[fromK];
+            if (!paired)
+                return false;
+
+            if (hasTo)
+                continue; // collapses away
+
+            // The triangles left must not flip nor degenerate
+            vec3 p[3] = { positions[triangle[0]], positions[triangle[1]], positions[triangle[2]] };
+            const vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            p[fromK] = positions[to];
+            const vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+            const f32 afterLength = glm::length(after);
+            if (afterLength <= 0.0f || glm::dot(before, after) < 0.25f * glm::length(before) * afterLength)
+                return false;
+        }
+
+        // Link condition: only the vertices opposite to the edge may be shared
+        // neighbours, otherwise the collapse pinches the surface
+        GatherNeighbours(mesh, indices, from, mesh.fromNeighbours);
+        GatherNeighbours(mesh, indices, to, mesh.toNeighbours);
+        mesh.commonNeighbours.clear();
+        std::set_intersection(mesh.fromNeighbours.begin(), mesh.fromNeighbours.end(),
+                              mesh.toNeighbours.begin(), mesh.toNeighbours.end(), std::back_inserter(mesh.commonNeighbours));
+        return mesh.commonNeighbours.size() <= CountEdgeTriangles(mesh, indices, from, to);
+    }
+
+    // Collapses the cheapest independent edges, returns how many
+    static u32 SimplifyPass(SimplifierMesh& mesh, std::vector<u32>& indices, u32 targetTriangleCount, f32& maxError)
+    {
+        const std::vector<vec3>& positions = *mesh.positions;
+        const u32 vertexCount = mesh.welded.size();
+        BuildAdjacency(mesh, indices);
+
+        mesh.isBorder.assign(vertexCount, 0);
+        for (u32 i = 0; i < indices.size(); ++i)
+        {
+            const u32 a = mesh.welded[indices[i]];
+            const u32 b = mesh.welded[indices[i - i % 3 + (i + 1) % 3]];
+            if (CountEdgeTriangles(mesh, indices, a, b) == 1)
+            {
+                mesh.isBorder[a] = 1;
+                mesh.isBorder[b] = 1;
+            }
+        }
+
+        std::vector<Collapse> collapses;
+        collapses.reserve(indices.size() * 2);
+        for (u32 i = 0; i < indices.size(); ++i)
+        {
+            const u32 a = mesh.welded[indices[i]];
+            const u32 b = mesh.welded[indices[i - i % 3 + (i + 1) % 3]];
+            const u32 ends[2][2] = { { a, b }, { b, a } };
+            for (u32 e = 0; e < 2; ++e)
+            {
+                const u32 from = ends[e][0];
+                const u32 to = ends[e][1];
+
+                // Border vertices only slide along the border
+                if (mesh.isBorder[from] && CountEdgeTriangles(mesh, indices, from, to) != 1)
+                    continue;
+
+                Quadric q = mesh.quadrics[from];
+                AddQuadric(q, mesh.quadrics[to]);
+                collapses.push_back({ from, to, EvaluateQuadric(q, positions[to]) });
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b)
+        {
+            if (a.cost != b.cost)
+                return a.cost < b.cost;
+            return a.from != b.from ? a.from < b.from : a.to < b.to;
+        });
+
+        mesh.touched.assign(vertexCount, 0);
+        mesh.wedgeRemap.resize(vertexCount);
+        std::iota(mesh.wedgeRemap.begin(), mesh.wedgeRemap.end(), 0);
+
+        // Only the cheapest half is considered while anything there is possible,
+        // the next pass rescores the rest with the updated quadrics
+        const u32 passLimit = (collapses.size() + 1) / 2;
+        u32 triangleCount = indices.size() / 3;
+        u32 collapseCount = 0;
+        for (u32 i = 0; i < collapses.size() && triangleCount > targetTriangleCount; ++i)
+        {
+            if (i >= passLimit && collapseCount > 0)
+                break;
+
+            const Collapse& collapse = collapses[i];
+            if (mesh.touched[collapse.from] || mesh.touched[collapse.to])
+                continue;
+            if (!CanCollapse(mesh, indices, collapse.from, collapse.to))
+                continue;
+
+            for (const std::pair<u32, u32>& pair : mesh.wedgePairs)
+                mesh.wedgeRemap[pair.first] = pair.second;
+            AddQuadric(mesh.quadrics[collapse.to], mesh.quadrics[collapse.from]);
+
+            // The one-ring of 'from' changed, leave it alone until the next pass
+            mesh.touched[collapse.from] = 1;
+            mesh.touched[collapse.to] = 1;
+            for (u32 neighbour : mesh.fromNeighbours)
+                mesh.touched[neighbour] = 1;
+
+            triangleCount -= CountEdgeTriangles(mesh, indices, collapse.from, collapse.to);
+            maxError = std::max(maxError, collapse.cost);
+            collapseCount++;
+        }
+
+        u32 writeCursor = 0;
+        for (u32 t = 0; t < indices.size() / 3; ++t)
+        {
+            const u32 a = mesh.wedgeRemap[indices[t * 3]];
+            const u32 b = mesh.wedgeRemap[indices[t * 3 + 1]];
+            const u32 c = mesh.wedgeRemap[indices[t * 3 + 2]];
+            if (mesh.welded[a] == mesh.welded[b] || mesh.welded[b] == mesh.welded[c] || mesh.welded[a] == mesh.welded[c])
+                continue;
+
+            indices[writeCursor++] = a;
+            indices[writeCursor++] = b;
+            indices[writeCursor++] = c;
+        }
+        indices.resize(writeCursor);
+
+        return collapseCount;
+    }
+
+    void BuildLodChain(SubMesh& submesh, const std::vector<vec3>& positions)
+    {
+        const u32 fullIndexCount = submesh.indices.size();
+        submesh.lods[0] = { 0, fullIndexCount, 0.0f };
+        submesh.lodCount = 1;
+        if (fullIndexCount / 3 < MESH_SIMPLIFIER_MIN_TRIANGLES)
+            return;
+
+        SimplifierMesh mesh;
+        mesh.positions = &positions;
+        WeldPositions(positions, mesh.welded);
+
+        // Triangles already degenerate once welded would only get in the way
+        std::vector<u32> indices;
+        indices.reserve(fullIndexCount);
+        for (u32 t = 0; t < fullIndexCount / 3; ++t)
+        {
+            const u32* triangle = &submesh.indices[t * 3];
+            const u32 a = mesh.welded[triangle[0]];
+            const u32 b = mesh.welded[triangle[1]];
+            const u32 c = mesh.welded[triangle[2]];
+            if (a != b && b != c && a != c)
+                indices.insert(indices.end(), triangle, triangle + 3);
+        }
+
+        BuildAdjacency(mesh, indices);
+        InitQuadrics(mesh, indices);
+
+        f32 maxError = 0.0f;
+        u32 previousIndexCount = fullIndexCount;
+        for (u32 level = 1; level < MESH_LOD_MAX_LEVELS; ++level)
+        {
+            const u32 targetTriangleCount = (u32)(fullIndexCount / 3 * LodTriangleRatios[level]);
+            u32 collapseCount = 1;
+            while (indices.size() / 3 > targetTriangleCount && collapseCount > 0)
+                collapseCount = SimplifyPass(mesh, indices, targetTriangleCount, maxError);
+
+            if (indices.empty() || indices.size() > previousIndexCount * MESH_SIMPLIFIER_MIN_REDUCTION)
+                break;
+
+            std::vector<u32> levelIndices = indices;
+            MeshOptimizer::OptimizeVertexCache(levelIndices, positions.size());
+
+            SubMeshLod& lod = submesh.lods[submesh.lodCount++];
+            lod.firstIndex = submesh.indices.size();
+            lod.indexCount = levelIndices.size();
+            lod.error = sqrtf(maxError);
+            submesh.indices.insert(submesh.indices.end(), levelIndices.begin(), levelIndices.end());
+            previousIndexCount = indices.size();
+        }
+    }
+
+    f32 GetPixelsPerUnit(f32 worldScale, f32 distance, f32 verticalFov, f32 screenHeight)
+    {
+        return worldScale * screenHeight / (2.0f * tanf(verticalFov * 0.5f) * distance);
+    }
+
+    u32 SelectLod(const SubMesh& submesh, f32 pixelsPerUnit, f32 maxErrorPixels)
+    {
+        // Errors grow with the level, keep the last one that still fits
+        u32 level = 0;
+        for (u32 i = 1; i < submesh.lodCount; ++i)
+        {
+            if (submesh.lods[i].error * pixelsPerUnit <= maxErrorPixels)
+                level = i;
+        }
+        return level;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef MESH_SIMPLIFIER_FUNC
+#define MESH_SIMPLIFIER_FUNC
+
+#include "Globals.h"
+#include <vector>
+
+// Builds the level of detail chain of imported submeshes with quadric error
+// metric edge collapses (Garland-Heckbert). Collapses are half-edge: a vertex
+// moves onto one of its neighbours, so every level indexes the vertices of the
+// full detail level and is appended to the same index buffer. Vertices sharing
+// a position (UV/normal seams) collapse together along the seam, open borders
+// only slide along themselves. Every level stores the largest error of the
+// collapses that produced it, in model space units, so the renderer can pick
+// the coarsest level whose projected error stays under a pixel threshold.
+#define MESH_SIMPLIFIER_MIN_TRIANGLES   64     // smaller submeshes keep a single level
+#define MESH_SIMPLIFIER_MIN_REDUCTION   0.8f   // a level must have at most this fraction of the previous one
+#define MESH_SIMPLIFIER_BORDER_WEIGHT   10.0f  // quadric weight of the planes that keep open borders in place
+#define MESH_SIMPLIFIER_ERROR_THRESHOLD 1.0f   // default projected error in pixels when selecting levels
+
+struct LodSelectionStats
+{
+    u32 trianglesDrawn;
+    u32 trianglesFullDetail; // what drawing level 0 everywhere would have cost
+    u32 submeshesPerLevel[MESH_LOD_MAX_LEVELS];
+};
+
+namespace MeshSimplifier
+{
+    // Appends the simplified levels to submesh.indices and fills submesh.lods.
+    // Expects the optimized full detail indices, before LayoutMesh.
+    void BuildLodChain(SubMesh& submesh, const std::vector<vec3>& positions);
+
+    // Pixels covered by one model space unit of an object at the given distance
+    f32 GetPixelsPerUnit(f32 worldScale, f32 distance, f32 verticalFov, f32 screenHeight);
+
+    // Coarsest level whose error projects to at most maxErrorPixels
+    u32 SelectLod(const SubMesh& submesh, f32 pixelsPerUnit, f32 maxErrorPixels);
+}
+
+#endif // !MESH_SIMPLIFIER_FUNC
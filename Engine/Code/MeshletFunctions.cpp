@@ -0,0 +1,162 @@
+#include "MeshletFunctions.h"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace MeshletBuilder
+{
+    static void ComputeBounds(Meshlet& meshlet, const std::vector<u32>& indices, const std::vector<vec3>& positions)
+    {
+        const u32 firstIndex = meshlet.firstTriangle * 3;
+        const u32 indexCount = meshlet.triangleCount * 3;
+
+        vec3 boundsMin(FLT_MAX);
+        vec3 boundsMax(-FLT_MAX);
+        for (u32 i = firstIndex; i < firstIndex + indexCount; ++i)
+        {
+            boundsMin = glm::min(boundsMin, positions[indices[i]]);
+            boundsMax = glm::max(boundsMax, positions[indices[i]]);
+        }
+
+        const vec3 center = (boundsMin + boundsMax) * 0.5f;
+        f32 radius = 0.0f;
+        for (u32 i = firstIndex; i < firstIndex + indexCount; ++i)
+            radius = std::max(radius, glm::length(positions[indices[i]] - center));
+
+        meshlet.boundingSphere = vec4(center, radius);
+        meshlet.aabbMin = vec4(boundsMin, 0.0f);
+        meshlet.aabbMax = vec4(boundsMax, 0.0f);
+
+        // Normal cone: average normal, and how far the triangle normals spread around it
+        vec3 normalSum(0.0f);
+        std::vector<vec3> normals;
+        normals.reserve(meshlet.triangleCount);
+        for (u32 i = firstIndex; i < firstIndex + indexCount; i += 3)
+        {
+            const vec3& p0 = positions[indices[i]];
+            const vec3& p1 = positions[indices[i + 1]];
+            const vec3& p2 = positions[indices[i + 2]];
+            const vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const f32 length = glm::length(normal);
+            if (length > 0.0f)
+            {
+                normals.push_back(normal / length);
+                normalSum += normal / length;
+            }
+        }
+
+        meshlet.cone = vec4(0.0f, 0.0f, 1.0f, 1.0f);
+        const f32 sumLength = glm::length(normalSum);
+        if (normals.empty() || sumLength <= 0.0f)
+            return;
+
+        const vec3 axis = normalSum / sumLength;
+        f32 minDot = 1.0f;
+        for (const vec3& normal : normals)
+            minDot = std::min(minDot, glm::dot(axis, normal));
+
+        // A cone wider than ~85 degrees would almost never cull, leave it disabled
+        if (minDot > 0.1f)
+            meshlet.cone = vec4(axis, sqrtf(1.0f - minDot * minDot));
+    }
+
+    void BuildMeshlets(SubMesh& submesh, const std::vector<vec3>& positions)
+    {
+        submesh.meshlets.clear();
+
+        const std::vector<u32>& indices = submesh.indices;
+        const u32 triangleCount = indices.size() / 3;
+
+        // Vertices already in the current meshlet carry its tag
+        std::vector<u32> vertexTags(positions.size(), 0);
+        u32 meshletTag = 1;
+
+        Meshlet meshlet = {};
+        for (u32 t = 0; t < triangleCount; ++t)
+        {
+            const u32 a = indices[t * 3];
+            const u32 b = indices[t * 3 + 1];
+            const u32 c = indices[t * 3 + 2];
+
+            u32 newVertices = vertexTags[a] != meshletTag ? 1 : 0;
+            newVertices += (vertexTags[b] != meshletTag && b != a) ? 1 : 0;
+            newVertices += (vertexTags[c] != meshletTag && c != a && c != b) ? 1 : 0;
+
+            if (meshlet.triangleCount == MESHLET_MAX_TRIANGLES || meshlet.vertexCount + newVertices > MESHLET_MAX_VERTICES)
+            {
+                ComputeBounds(meshlet, indices, positions);
+                submesh.meshlets.push_back(meshlet);
+
+                meshlet = {};
+                meshlet.firstTriangle = t;
+                ++meshletTag;
+            }
+
+            const u32 triangle[3] = { a, b, c };
+            for (u32 v : triangle)
+            {
+                if (vertexTags[v] != meshletTag)
+                {
+                    vertexTags[v] = meshletTag;
+                    meshlet.vertexCount++;
+                }
+            }
+            meshlet.triangleCount++;
+        }
+
+        if (meshlet.triangleCount > 0)
+        {
+            ComputeBounds(meshlet, indices, positions);
+            submesh.meshlets.push_back(meshlet);
+        }
+    }
+
+    void ExtractFrustumPlanes(const glm::mat4& m, vec4 planes[6])
+    {
+        // Rows of the matrix, glm is column major
+        const vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        const vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        const vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        const vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        planes[0] = row3 + row0; // left
+        planes[1] = row3 - row0; // right
+        planes[2] = row3 + row1; // bottom
+        planes[3] = row3 - row1; // top
+        planes[4] = row3 + row2; // near
+        planes[5] = row3 - row2; // far
+
+        for (u32 i = 0; i < 6; ++i)
+        {
+            const f32 length = glm::length(vec3(planes[i]));
+            if (length > 0.0f)
+                planes[i] /= length;
+        }
+    }
+
+    bool IsMeshletVisible(const Meshlet& meshlet, const vec4 planes[6], const vec3& cameraPosition, MeshletCullingStats& stats)
+    {
+        const vec3 center = vec3(meshlet.boundingSphere);
+        const f32 radius = meshlet.boundingSphere.w;
+
+        for (u32 i = 0; i < 6; ++i)
+        {
+            if (glm::dot(vec3(planes[i]), center) + planes[i].w < -radius)
+            {
+                stats.frustumCulled++;
+                return false;
+            }
+        }
+
+        // Every triangle faces away when the camera sits inside the cone behind the meshlet
+        const vec3 toCenter = center - cameraPosition;
+        if (glm::dot(toCenter, vec3(meshlet.cone)) >= meshlet.cone.w * glm::length(toCenter) + radius)
+        {
+            stats.backfaceCulled++;
+            return false;
+        }
+
+        stats.visibleMeshlets++;
+        return true;
+    }
+}
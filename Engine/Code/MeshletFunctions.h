@@ -0,0 +1,35 @@
+#ifndef MESHLET_FUNC
+#define MESHLET_FUNC
+
+#include "Globals.h"
+#include <vector>
+
+// Submeshes are split at import time into meshlets: runs of consecutive
+// triangles (in the optimized order) that touch at most MESHLET_MAX_VERTICES
+// vertices. At draw time meshlets outside the frustum or facing away from the
+// camera are skipped and the surviving ranges are drawn with one
+// glMultiDrawElements per submesh.
+#define MESHLET_MAX_VERTICES  64
+#define MESHLET_MAX_TRIANGLES 124
+
+struct MeshletCullingStats
+{
+    u32 totalMeshlets;
+    u32 visibleMeshlets;
+    u32 frustumCulled;
+    u32 backfaceCulled;
+};
+
+namespace MeshletBuilder
+{
+    // Splits the triangles of the submesh and computes the bounds of every meshlet
+    void BuildMeshlets(SubMesh& submesh, const std::vector<vec3>& positions);
+
+    // Model space frustum planes (xyz normal pointing inside, w distance) of a world view projection matrix
+    void ExtractFrustumPlanes(const glm::mat4& worldViewProjection, vec4 planes[6]);
+
+    // cameraPosition in model space. Updates stats with the reason of the rejection.
+    bool IsMeshletVisible(const Meshlet& meshlet, const vec4 planes[6], const vec3& cameraPosition, MeshletCullingStats& stats);
+}
+
+#endif // !MESHLET_FUNC
@@ -0,0 +1,422 @@
+#include "MipChainFunctions.h"
+#include "JobSystemFunctions.h"
+
+#include <immintrin.h>
+#include <algorithm>
+#include <cmath>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// MSVC accepts AVX2 intrinsics in any function, GCC and Clang need them enabled per function
+#if defined(_MSC_VER) && !defined(__clang__)
+#define MIP_TARGET_AVX2
+#else
+#define MIP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#define MIP_MAX_TAPS             8
+#define MIP_ROWS_PER_JOB         16
+#define MIP_SRGB_ENCODE_LUT_SIZE 4096
+
+namespace MipGenerator
+{
+    struct MipKernel
+    {
+        i32 firstTap; // source texel of the first tap, relative to 2 * x
+        u32 tapCount;
+        f32 weights[MIP_MAX_TAPS];
+    };
+
+    struct ColorTables
+    {
+        f32 decode[2][256];                   // [isSRGB] u8 -> linear
+        u8  encode[MIP_SRGB_ENCODE_LUT_SIZE]; // linear -> sRGB u8
+    };
+
+    static bool DetectAVX2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+
+        // The OS has to save the ymm registers too
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+            return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    bool IsAVX2Enabled()
+    {
+        static const bool enabled = DetectAVX2();
+        return enabled;
+    }
+
+    static ColorTables BuildColorTables()
+    {
+        ColorTables tables = {};
+        for (u32 i = 0; i < 256; ++i)
+        {
+            const f32 value = i / 255.0f;
+            tables.decode[0][i] = value;
+            tables.decode[1][i] = value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+        }
+        for (u32 i = 0; i < MIP_SRGB_ENCODE_LUT_SIZE; ++i)
+        {
+            const f32 value = i / (f32)(MIP_SRGB_ENCODE_LUT_SIZE - 1);
+            const f32 srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+            tables.encode[i] = (u8)std::min(255.0f, srgb * 255.0f + 0.5f);
+        }
+        return tables;
+    }
+
+    static const ColorTables& GetColorTables()
+    {
+        static const ColorTables tables = BuildColorTables();
+        return tables;
+    }
+
+    static f64 BesselI0(f64 x)
+    {
+        f64 sum = 1.0;
+        f64 term = 1.0;
+        for (u32 k = 1; k < 32; ++k)
+        {
+            const f64 factor = x / (2.0 * k);
+            term *= factor * factor;
+            sum += term;
+        }
+        return sum;
+    }
+
+    static MipKernel MakeKernel(MipFilter filter)
+    {
+        MipKernel kernel = {};
+        if (filter == MipFilter_Box)
+        {
+            kernel.firstTap = 0;
+            kernel.tapCount = 2;
+            kernel.weights[0] = 0.5f;
+            kernel.weights[1] = 0.5f;
+            return kernel;
+        }
+
+        // Kaiser windowed sinc, two destination texels wide on each side
+        const f64 alpha = 4.0;
+        const f64 radius = 2.0;
+        const f64 pi = 3.14159265358979323846;
+
+        kernel.firstTap = -3;
+        kernel.tapCount = 8;
+
+        f64 weights[MIP_MAX_TAPS];
+        f64 sum = 0.0;
+        for (u32 i = 0; i < kernel.tapCount; ++i)
+        {
+            // Distance from the destination texel center, in destination texels
+            const f64 t = (kernel.firstTap + (i32)i - 0.5) * 0.5;
+            const f64 sinc = t == 0.0 ? 1.0 : sin(pi * t) / (pi * t);
+            const f64 window = BesselI0(alpha * sqrt(std::max(0.0, 1.0 - (t / radius) * (t / radius)))) / BesselI0(alpha);
+            weights[i] = sinc * window;
+            sum += weights[i];
+        }
+        for (u32 i = 0; i < kernel.tapCount; ++i)
+            kernel.weights[i] = (f32)(weights[i] / sum);
+
+        return kernel;
+    }
+
+    void ExpandToRGBA(const Image& image, u8* rgba)
+    {
+        const u32 texelCount = image.size.x * image.size.y;
+        const u8* pixels = (const u8*)image.pixels;
+
+        for (u32 i = 0; i < texelCount; ++i)
+        {
+            const u8* src = pixels + i * image.nchannels;
+            u8* dst = rgba + i * 4;
+            switch (image.nchannels)
+            {
+            case 1: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = 255; break;
+            case 2: dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1]; break;
+            case 3: dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = 255; break;
+            default: memcpy(dst, src, 4); break;
+            }
+        }
+    }
+
+    static void DecodeRow(const u8* src, u32 width, const f32* const decode[4], f32* dst)
+    {
+        for (u32 x = 0; x < width * 4; x += 4)
+        {
+            dst[x + 0] = decode[0][src[x + 0]];
+            dst[x + 1] = decode[1][src[x + 1]];
+            dst[x + 2] = decode[2][src[x + 2]];
+            dst[x + 3] = decode[3][src[x + 3]];
+        }
+    }
+
+    // One RGBA texel is exactly one SSE register
+    static void FilterRowHorizontal(const f32* src, u32 srcWidth, const MipKernel& kernel, f32* dst, u32 dstWidth)
+    {
+        __m128 weights[MIP_MAX_TAPS];
+        for (u32 t = 0; t < kernel.tapCount; ++t)
+            weights[t] = _mm_set1_ps(kernel.weights[t]);
+
+        const i32 lastTexel = (i32)srcWidth - 1;
+        for (u32 x = 0; x < dstWidth; ++x)
+        {
+            const i32 first = 2 * (i32)x + kernel.firstTap;
+            __m128 sum = _mm_setzero_ps();
+            for (u32 t = 0; t < kernel.tapCount; ++t)
+            {
+                const i32 sx = std::min(std::max(first + (i32)t, 0), lastTexel);
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + sx * 4), weights[t]));
+            }
+            _mm_storeu_ps(dst + x * 4, sum);
+        }
+    }
+
+    // The vertical pass is a weighted sum of whole rows, count is a multiple of 4
+    static void AccumulateRowsSSE(const f32* const rows[], const MipKernel& kernel, u32 count, f32* dst)
+    {
+        for (u32 i = 0; i < count; i += 4)
+        {
+            __m128 sum = _mm_setzero_ps();
+            for (u32 t = 0; t < kernel.tapCount; ++t)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[t] + i), _mm_set1_ps(kernel.weights[t])));
+            _mm_storeu_ps(dst + i, sum);
+        }
+    }
+
+    MIP_TARGET_AVX2 static void AccumulateRowsAVX2(const f32* const rows[], const MipKernel& kernel, u32 count, f32* dst)
+    {
+        __m256 weights[MIP_MAX_TAPS];
+        for (u32 t = 0; t < kernel.tapCount; ++t)
+            weights[t] = _mm256_set1_ps(kernel.weights[t]);
+
+        u32 i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 sum = _mm256_setzero_ps();
+            for (u32 t = 0; t < kernel.tapCount; ++t)
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(rows[t] + i), weights[t]));
+            _mm256_storeu_ps(dst + i, sum);
+        }
+        for (; i < count; i += 4)
+        {
+            __m128 sum = _mm_setzero_ps();
+            for (u32 t = 0; t < kernel.tapCount; ++t)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[t] + i), _mm256_castps256_ps128(weights[t])));
+            _mm_storeu_ps(dst + i, sum);
+        }
+        _mm256_zeroupper();
+    }
+
+    static void EncodeRow(const f32* src, u32 width, bool isColor, u8* dst)
+    {
+        const ColorTables& tables = GetColorTables();
+
+        // Colour channels index the sRGB table, alpha and data textures go straight to 8 bits
+        const f32 colorScale = isColor ? (f32)(MIP_SRGB_ENCODE_LUT_SIZE - 1) : 255.0f;
+        const __m128 scale = _mm_setr_ps(colorScale, colorScale, colorScale, 255.0f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        alignas(16) i32 values[4];
+        for (u32 x = 0; x < width; ++x)
+        {
+            __m128 texel = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + x * 4), zero), one);
+            _mm_store_si128((__m128i*)values, _mm_cvtps_epi32(_mm_mul_ps(texel, scale)));
+
+            u8* out = dst + x * 4;
+            if (isColor)
+            {
+                out[0] = tables.encode[values[0]];
+                out[1] = tables.encode[values[1]];
+                out[2] = tables.encode[values[2]];
+            }
+            else
+            {
+                out[0] = (u8)values[0];
+                out[1] = (u8)values[1];
+                out[2] = (u8)values[2];
+            }
+            out[3] = (u8)values[3];
+        }
+    }
+
+    static void DownsampleLevel(const u8* src, const MipLevel& srcLevel, u8* dst, const MipLevel& dstLevel,
+                                const MipKernel& kernel, bool isColor, std::vector<f32>& horizontal)
+    {
+        const ColorTables& tables = GetColorTables();
+        const f32* const decode[4] = {
+            tables.decode[isColor], tables.decode[isColor], tables.decode[isColor], tables.decode[0]
+        };
+
+        const u32 srcWidth = srcLevel.width;
+        const u32 srcHeight = srcLevel.height;
+        const u32 dstWidth = dstLevel.width;
+        const u32 dstHeight = dstLevel.height;
+        horizontal.resize(dstWidth * srcHeight * 4);
+
+        // Horizontal pass: every source row to linear floats, then filtered to the destination width
+        const u32 srcBands = (srcHeight + MIP_ROWS_PER_JOB - 1) / MIP_ROWS_PER_JOB;
+        JobSystem::ParallelFor(srcBands, [&](u32 band)
+        {
+            std::vector<f32> decoded(srcWidth * 4);
+            const u32 endRow = std::min(srcHeight, (band + 1) * MIP_ROWS_PER_JOB);
+            for (u32 y = band * MIP_ROWS_PER_JOB; y < endRow; ++y)
+            {
+                DecodeRow(src + y * srcWidth * 4, srcWidth, decode, decoded.data());
+                FilterRowHorizontal(decoded.data(), srcWidth, kernel, horizontal.data() + y * dstWidth * 4, dstWidth);
+            }
+        });
+
+        // Vertical pass: weighted sum of the filtered rows, then back to 8 bits
+        const bool useAVX2 = IsAVX2Enabled();
+        const u32 dstBands = (dstHeight + MIP_ROWS_PER_JOB - 1) / MIP_ROWS_PER_JOB;
+        JobSystem::ParallelFor(dstBands, [&](u32 band)
+        {
+            std::vector<f32> filtered(dstWidth * 4);
+            const f32* rows[MIP_MAX_TAPS];
+
+            const u32 endRow = std::min(dstHeight, (band + 1) * MIP_ROWS_PER_JOB);
+            for (u32 y = band * MIP_ROWS_PER_JOB; y < endRow; ++y)
+            {
+                const i32 first = 2 * (i32)y + kernel.firstTap;
+                for (u32 t = 0; t < kernel.tapCount; ++t)
+                {
+                    const i32 sy = std::min(std::max(first + (i32)t, 0), (i32)srcHeight - 1);
+                    rows[t] = horizontal.data() + sy * dstWidth * 4;
+                }
+
+                if (useAVX2)
+                    AccumulateRowsAVX2(rows, kernel, dstWidth * 4, filtered.data());
+                else
+                    AccumulateRowsSSE(rows, kernel, dstWidth * 4, filtered.data());
+
+                EncodeRow(filtered.data(), dstWidth, isColor, dst + y * dstWidth * 4);
+            }
+        });
+    }
+
+    // Bilinear, in linear space like the downsampling. Only used to snap level 0 to a
+    // power of two, so the scale is never far from 1 and two taps are enough.
+    static void ResampleLevel(const u8* src, u32 srcWidth, u32 srcHeight, u8* dst, u32 dstWidth, u32 dstHeight, bool isColor)
+    {
+        const ColorTables& tables = GetColorTables();
+        const f32* const decode[4] = {
+            tables.decode[isColor], tables.decode[isColor], tables.decode[isColor], tables.decode[0]
+        };
+
+        const f32 scaleX = (f32)srcWidth / (f32)dstWidth;
+        const f32 scaleY = (f32)srcHeight / (f32)dstHeight;
+
+        const u32 bands = (dstHeight + MIP_ROWS_PER_JOB - 1) / MIP_ROWS_PER_JOB;
+        JobSystem::ParallelFor(bands, [&](u32 band)
+        {
+            std::vector<f32> rows[2] = { std::vector<f32>(srcWidth * 4), std::vector<f32>(srcWidth * 4) };
+            std::vector<f32> filtered(dstWidth * 4);
+
+            const u32 endRow = std::min(dstHeight, (band + 1) * MIP_ROWS_PER_JOB);
+            for (u32 y = band * MIP_ROWS_PER_JOB; y < endRow; ++y)
+            {
+                const f32 sy = std::max((y + 0.5f) * scaleY - 0.5f, 0.0f);
+                const u32 y0 = std::min((u32)sy, srcHeight - 1);
+                const u32 y1 = std::min(y0 + 1, srcHeight - 1);
+                const f32 fy = sy - y0;
+                DecodeRow(src + y0 * srcWidth * 4, srcWidth, decode, rows[0].data());
+                DecodeRow(src + y1 * srcWidth * 4, srcWidth, decode, rows[1].data());
+
+                for (u32 x = 0; x < dstWidth; ++x)
+                {
+                    const f32 sx = std::max((x + 0.5f) * scaleX - 0.5f, 0.0f);
+                    const u32 x0 = std::min((u32)sx, srcWidth - 1);
+                    const u32 x1 = std::min(x0 + 1, srcWidth - 1);
+                    const f32 fx = sx - x0;
+                    for (u32 c = 0; c < 4; ++c)
+                    {
+                        const f32 top = rows[0][x0 * 4 + c] + (rows[0][x1 * 4 + c] - rows[0][x0 * 4 + c]) * fx;
+                        const f32 bottom = rows[1][x0 * 4 + c] + (rows[1][x1 * 4 + c] - rows[1][x0 * 4 + c]) * fx;
+                        filtered[x * 4 + c] = top + (bottom - top) * fy;
+                    }
+                }
+
+                EncodeRow(filtered.data(), dstWidth, isColor, dst + y * dstWidth * 4);
+            }
+        });
+    }
+
+    u32 GetSizeClass(u32 size)
+    {
+#if MIP_RESIZE_TO_POWER_OF_TWO
+        u32 powerOfTwo = 1;
+        while (powerOfTwo * 2 <= size)
+            powerOfTwo *= 2;
+        // Nearest in log scale, the midpoint between p and 2p being p * sqrt(2)
+        return (u64)size * size > 2ull * powerOfTwo * powerOfTwo ? powerOfTwo * 2 : powerOfTwo;
+#else
+        return size;
+#endif
+    }
+
+    void GenerateMipChain(const Image& image, bool isColor, MipFilter filter, MipChain& chain)
+    {
+        chain.width = GetSizeClass(image.size.x);
+        chain.height = GetSizeClass(image.size.y);
+        chain.levelCount = 0;
+
+        u32 width = chain.width;
+        u32 height = chain.height;
+        u32 totalSize = 0;
+        for (;;)
+        {
+            MipLevel& level = chain.levels[chain.levelCount++];
+            level.offset = totalSize;
+            level.size = width * height * 4;
+            level.width = width;
+            level.height = height;
+            totalSize += level.size;
+
+            if ((width == 1 && height == 1) || chain.levelCount == MIP_MAX_LEVELS)
+                break;
+            width = std::max(1u, width / 2);
+            height = std::max(1u, height / 2);
+        }
+
+        chain.pixels.resize(totalSize);
+        if (chain.width == (u32)image.size.x && chain.height == (u32)image.size.y)
+        {
+            ExpandToRGBA(image, chain.pixels.data());
+        }
+        else
+        {
+            std::vector<u8> rgba(image.size.x * image.size.y * 4);
+            ExpandToRGBA(image, rgba.data());
+            ResampleLevel(rgba.data(), image.size.x, image.size.y, chain.pixels.data(), chain.width, chain.height, isColor);
+        }
+
+        const MipKernel kernel = MakeKernel(filter);
+        std::vector<f32> horizontal;
+        for (u32 i = 1; i < chain.levelCount; ++i)
+        {
+            const MipLevel& srcLevel = chain.levels[i - 1];
+            const MipLevel& dstLevel = chain.levels[i];
+            DownsampleLevel(chain.pixels.data() + srcLevel.offset, srcLevel,
+                            chain.pixels.data() + dstLevel.offset, dstLevel,
+                            kernel, isColor, horizontal);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef MIP_CHAIN_FUNC
+#define MIP_CHAIN_FUNC
+
+#include "Globals.h"
+#include <vector>
+
+// Mip chains are built on the CPU instead of with glGenerateMipmap, so the work
+// runs on the job system and the filter is under our control. Each level is
+// filtered from the previous one with a separable 2x downsampling kernel, in
+// linear space for colour textures (sRGB is decoded before and encoded after).
+// Level 0 is first resampled to the nearest power of two size, so textures of
+// similar sizes end up in the same size class and share a texture array.
+#define MIP_MAX_LEVELS             16
+#define MIP_DEFAULT_FILTER         MipFilter_Kaiser
+#define MIP_RESIZE_TO_POWER_OF_TWO 1
+
+enum MipFilter
+{
+    MipFilter_Box,    // 2x2 average, cheapest
+    MipFilter_Kaiser, // 8 tap windowed sinc, keeps detail without ringing
+};
+
+struct MipLevel
+{
+    u32 offset; // into MipChain::pixels
+    u32 size;
+    u32 width;
+    u32 height;
+};
+
+// Every level is tightly packed RGBA8
+struct MipChain
+{
+    u32             width;
+    u32             height;
+    u32             levelCount;
+    MipLevel        levels[MIP_MAX_LEVELS];
+    std::vector<u8> pixels;
+};
+
+namespace MipGenerator
+{
+    // True when the AVX2 kernels are used, SSE otherwise
+    bool IsAVX2Enabled();
+
+    // Copies any 1-4 channel image into RGBA8, greyscale is replicated into rgb
+    void ExpandToRGBA(const Image& image, u8* rgba);
+
+    // Size of level 0 for a source of that size, the nearest power of two when resizing
+    u32 GetSizeClass(u32 size);
+
+    // Builds the full chain down to 1x1, from the source resized to its size class. Rows are spread over the job system, so
+    // it can be called from the main thread as well as from inside a job.
+    void GenerateMipChain(const Image& image, bool isColor, MipFilter filter, MipChain& chain);
+}
+
+#endif // !MIP_CHAIN_FUNC
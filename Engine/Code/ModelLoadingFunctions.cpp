@@ -1,16 +1,31 @@
 #include "engine.h"
 #include "ModelLoadingFunctions.h"
+#include "MeshCacheFunctions.h"
+#include "JobSystemFunctions.h"
+#include "BufferSuppFunctions.h"
+#include "MeshOptimizerFunctions.h"
+#include "MeshletFunctions.h"
+#include "MeshSimplifierFunctions.h"
+#include "ObjLoaderFunctions.h"
 
 #include <stb_image.h>
 #include <stb_image_write.h>
+#include <glm/gtc/packing.hpp>
+#include <cfloat>
 
 namespace ModelLoader
 {
     Image LoadImage(const char* filename)
     {
         Image img = {};
-        stbi_set_flip_vertically_on_load(true);
-        img.pixels = stbi_load(filename, &img.size.x, &img.size.y, &img.nchannels, 0);
+        AssetFile file = {};
+        if (AssetPack::OpenAsset(filename, file))
+        {
+            stbi_set_flip_vertically_on_load_thread(true);
+            img.pixels = stbi_load_from_memory(file.data, (int)file.size, &img.size.x, &img.size.y, &img.nchannels, 0);
+            AssetPack::CloseAsset(file);
+        }
+
         if (img.pixels)
         {
             img.stride = img.size.x * img.nchannels;
@@ -27,53 +42,48 @@ namespace ModelLoader
         stbi_image_free(image.pixels);
     }
 
-    GLuint CreateTexture2DFromImage(Image image)
+    u32 FindTexture2D(App* app, const char* filepath)
+    {
+        return AssetRegistryManager::Find(app->assets, AssetType_Texture, filepath);
+    }
+
+    u32 AddTexture2D(App* app, const char* filepath, Image image, bool isColor)
     {
-        GLenum internalFormat = GL_RGB8;
-        GLenum dataFormat = GL_RGB;
-        GLenum dataType = GL_UNSIGNED_BYTE;
+        u32 texIdx = FindTexture2D(app, filepath);
 
-        switch (image.nchannels)
+        if (texIdx == UINT32_MAX)
         {
-        case 3: dataFormat = GL_RGB; internalFormat = GL_RGB8; break;
-        case 4: dataFormat = GL_RGBA; internalFormat = GL_RGBA8; break;
-        default: ELOG("LoadTexture2D() - Unsupported number of channels");
-        }
+            MipChain chain;
+            MipGenerator::GenerateMipChain(image, isColor, MIP_DEFAULT_FILTER, chain);
 
-        GLuint texHandle;
-        glGenTextures(1, &texHandle);
-        glBindTexture(GL_TEXTURE_2D, texHandle);
-        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.size.x, image.size.y, 0, dataFormat, dataType, image.pixels);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, 0);
+            Texture tex = {};
+            TextureArrayManager::UploadMipChain(app->textureArrays, chain, chain.pixels.data(), 0, tex.arrayIdx, tex.layer);
+            tex.filepath = filepath;
+            tex.sizeInBytes = (u32)chain.pixels.size();
+            tex.streamIdx = UINT32_MAX;
+
+            texIdx = app->textures.size();
+            app->textures.push_back(tex);
 
-        return texHandle;
+            AssetId id = AssetRegistryManager::MakeAssetId(AssetType_Texture, filepath);
+            AssetRegistryManager::Insert(app->assets, id, texIdx, filepath);
+        }
+
+        FreeImage(image);
+        return texIdx;
     }
 
-    u32 LoadTexture2D(App* app, const char* filepath)
+    u32 LoadTexture2D(App* app, const char* filepath, bool isColor)
     {
-        for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
-            if (app->textures[texIdx].filepath == filepath)
-                return texIdx;
+        u32 texIdx = FindTexture2D(app, filepath);
+        if (texIdx != UINT32_MAX)
+            return texIdx;
 
         Image image = LoadImage(filepath);
 
         if (image.pixels)
         {
-            Texture tex = {};
-            tex.handle = CreateTexture2DFromImage(image);
-            tex.filepath = filepath;
-
-            u32 texIdx = app->textures.size();
-            app->textures.push_back(tex);
-
-            FreeImage(image);
-            return texIdx;
+            return AddTexture2D(app, filepath, image, isColor);
         }
         else
         {
@@ -81,37 +91,131 @@ namespace ModelLoader
         }
     }
 
-    void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
+    static void AddVertexAttribute(VertexBufferLayout& layout, u8 location, u8 componentCount, GLenum type, GLboolean normalized, u8 size)
+    {
+        layout.attributes.push_back(VertexBufferAttribute{ location, componentCount, layout.stride, normalized, type });
+        layout.stride += size;
+    }
+
+    static f32 AngleDegrees(const glm::vec3& a, const glm::vec3& b)
+    {
+        return glm::degrees(acosf(glm::clamp(glm::dot(a, b), -1.0f, 1.0f)));
+    }
+
+    static glm::vec3 SafeNormalize(const glm::vec3& v)
     {
-        std::vector<float> vertices;
-        std::vector<u32> indices;
+        const f32 length = glm::length(v);
+        return length > 0.0f ? v / length : glm::vec3(0.0f, 0.0f, 1.0f);
+    }
+
+    void BuildSubMeshVertices(const VertexStreams& streams, u32 vertexQuantization, VertexQuantizationStats& quantizationStats, SubMesh& submesh)
+    {
+        const bool hasTexCoords = streams.texCoords != NULL;
+        const bool hasTangentSpace = streams.tangents != NULL && streams.bitangents != NULL;
+
+        const bool halfPositions = (vertexQuantization & VertexQuantization_HalfPositions) != 0;
+        const bool halfTexCoords = (vertexQuantization & VertexQuantization_HalfTexCoords) != 0;
+        const bool packedNormals = (vertexQuantization & VertexQuantization_PackedNormals) != 0;
+        const bool packedTangents = (vertexQuantization & VertexQuantization_PackedTangents) != 0;
+
+        // create the vertex format
+        VertexBufferLayout vertexBufferLayout = {};
+        if (halfPositions)
+            AddVertexAttribute(vertexBufferLayout, 0, 4, GL_HALF_FLOAT, GL_FALSE, 4 * sizeof(u16));
+        else
+            AddVertexAttribute(vertexBufferLayout, 0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float));
+
+        if (packedNormals)
+            AddVertexAttribute(vertexBufferLayout, 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(u32));
+        else
+            AddVertexAttribute(vertexBufferLayout, 1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float));
+
+        if (hasTexCoords)
+        {
+            if (halfTexCoords)
+                AddVertexAttribute(vertexBufferLayout, 2, 2, GL_HALF_FLOAT, GL_FALSE, 2 * sizeof(u16));
+            else
+                AddVertexAttribute(vertexBufferLayout, 2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float));
+        }
+
+        if (hasTangentSpace)
+        {
+            if (packedTangents)
+            {
+                AddVertexAttribute(vertexBufferLayout, 3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(u32));
+            }
+            else
+            {
+                AddVertexAttribute(vertexBufferLayout, 3, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float));
+                AddVertexAttribute(vertexBufferLayout, 4, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float));
+            }
+        }
 
-        bool hasTexCoords = false;
-        bool hasTangentSpace = false;
+        const u32 stride = vertexBufferLayout.stride;
+        const u32 rawStride = (6 + (hasTexCoords ? 2 : 0) + (hasTangentSpace ? 6 : 0)) * sizeof(float);
+        quantizationStats.rawVertexBytes += streams.vertexCount * rawStride;
+        quantizationStats.vertexBytes += streams.vertexCount * stride;
 
-        // process vertices
-        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+        std::vector<u8> vertices(streams.vertexCount * stride);
+        for (u32 i = 0; i < streams.vertexCount; i++)
         {
-            vertices.push_back(mesh->mVertices[i].x);
-            vertices.push_back(mesh->mVertices[i].y);
-            vertices.push_back(mesh->mVertices[i].z);
-            vertices.push_back(mesh->mNormals[i].x);
-            vertices.push_back(mesh->mNormals[i].y);
-            vertices.push_back(mesh->mNormals[i].z);
+            u8* vertex = vertices.data() + i * stride;
 
-            if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+            const glm::vec3 position = streams.positions[i];
+            if (halfPositions)
             {
-                hasTexCoords = true;
-                vertices.push_back(mesh->mTextureCoords[0][i].x);
-                vertices.push_back(mesh->mTextureCoords[0][i].y);
+                const u64 packed = glm::packHalf4x16(glm::vec4(position, 1.0f));
+                memcpy(vertex, &packed, sizeof(packed));
+                vertex += sizeof(packed);
+
+                const glm::vec3 unpacked = glm::vec3(glm::unpackHalf4x16(packed));
+                const glm::vec3 error = glm::abs(unpacked - position);
+                quantizationStats.maxPositionError = glm::max(quantizationStats.maxPositionError, glm::max(error.x, glm::max(error.y, error.z)));
+            }
+            else
+            {
+                memcpy(vertex, &position, sizeof(position));
+                vertex += sizeof(position);
             }
 
-            if (mesh->mTangents != nullptr && mesh->mBitangents)
+            const glm::vec3 normal = SafeNormalize(streams.normals[i]);
+            if (packedNormals)
             {
-                hasTangentSpace = true;
-                vertices.push_back(mesh->mTangents[i].x);
-                vertices.push_back(mesh->mTangents[i].y);
-                vertices.push_back(mesh->mTangents[i].z);
+                const u32 packed = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+                memcpy(vertex, &packed, sizeof(packed));
+                vertex += sizeof(packed);
+
+                const glm::vec3 unpacked = SafeNormalize(glm::vec3(glm::unpackSnorm3x10_1x2(packed)));
+                quantizationStats.maxNormalErrorDegrees = glm::max(quantizationStats.maxNormalErrorDegrees, AngleDegrees(unpacked, normal));
+            }
+            else
+            {
+                memcpy(vertex, &normal, sizeof(normal));
+                vertex += sizeof(normal);
+            }
+
+            if (hasTexCoords)
+            {
+                const glm::vec2 texCoord(streams.texCoords[i]);
+                if (halfTexCoords)
+                {
+                    const u32 packed = glm::packHalf2x16(texCoord);
+                    memcpy(vertex, &packed, sizeof(packed));
+                    vertex += sizeof(packed);
+
+                    const glm::vec2 error = glm::abs(glm::unpackHalf2x16(packed) - texCoord);
+                    quantizationStats.maxTexCoordError = glm::max(quantizationStats.maxTexCoordError, glm::max(error.x, error.y));
+                }
+                else
+                {
+                    memcpy(vertex, &texCoord, sizeof(texCoord));
+                    vertex += sizeof(texCoord);
+                }
+            }
+
+            if (hasTangentSpace)
+            {
+                const glm::vec3 tangent = streams.tangents[i];
 
                 // For some reason ASSIMP gives me the bitangents flipped.
                 // Maybe it's my fault, but when I generate my own geometry
@@ -121,53 +225,64 @@ namespace ModelLoader
                 // I think that (even if the documentation says the opposite)
                 // it returns a left-handed tangent space matrix.
                 // SOLUTION: I invert the components of the bitangent here.
-                vertices.push_back(-mesh->mBitangents[i].x);
-                vertices.push_back(-mesh->mBitangents[i].y);
-                vertices.push_back(-mesh->mBitangents[i].z);
+                // (The native OBJ reader follows the Assimp convention.)
+                const glm::vec3 bitangent = -streams.bitangents[i];
+
+                if (packedTangents)
+                {
+                    const f32 bitangentSign = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+                    const u32 packed = glm::packSnorm3x10_1x2(glm::vec4(SafeNormalize(tangent), bitangentSign));
+                    memcpy(vertex, &packed, sizeof(packed));
+                }
+                else
+                {
+                    memcpy(vertex, &tangent, sizeof(tangent));
+                    memcpy(vertex + sizeof(tangent), &bitangent, sizeof(bitangent));
+                }
             }
         }
 
+        submesh.vertexBufferLayout = vertexBufferLayout;
+        submesh.vertices.swap(vertices);
+    }
+
+    void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices, u32 vertexQuantization, VertexQuantizationStats& quantizationStats)
+    {
+        // aiVector3D is three packed floats
+        VertexStreams streams = {};
+        streams.vertexCount = mesh->mNumVertices;
+        streams.positions = (const vec3*)mesh->mVertices;
+        streams.normals = (const vec3*)mesh->mNormals;
+        streams.texCoords = (const vec3*)mesh->mTextureCoords[0];
+        streams.tangents = (const vec3*)mesh->mTangents;
+        streams.bitangents = (const vec3*)mesh->mBitangents;
+
+        // Built in place, the vertex and index arrays are sized once. The converted vertices
+        // are kept in SubMesh::vertices, the optimizer and the mesh cache need them before
+        // there is a GL context, UploadMesh copies them once into the pool
+        myMesh->submeshes.push_back(SubMesh{});
+        SubMesh& submesh = myMesh->submeshes.back();
+        BuildSubMeshVertices(streams, vertexQuantization, quantizationStats, submesh);
+
         // process indices
+        u32 indexCount = 0;
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+            indexCount += mesh->mFaces[i].mNumIndices;
+
+        submesh.indices.resize(indexCount);
+        u32* index = submesh.indices.data();
         for (unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
-            for (unsigned int j = 0; j < face.mNumIndices; j++)
-            {
-                indices.push_back(face.mIndices[j]);
-            }
+            const aiFace& face = mesh->mFaces[i];
+            memcpy(index, face.mIndices, face.mNumIndices * sizeof(u32));
+            index += face.mNumIndices;
         }
 
         // store the proper (previously proceessed) material for this mesh
         submeshMaterialIndices.push_back(baseMeshMaterialIndex + mesh->mMaterialIndex);
-
-        // create the vertex format
-        VertexBufferLayout vertexBufferLayout = {};
-        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 0, 3, 0 });
-        vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 1, 3, 3 * sizeof(float) });
-        vertexBufferLayout.stride = 6 * sizeof(float);
-        if (hasTexCoords)
-        {
-            vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 2, 2, vertexBufferLayout.stride });
-            vertexBufferLayout.stride += 2 * sizeof(float);
-        }
-        if (hasTangentSpace)
-        {
-            vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 3, 3, vertexBufferLayout.stride });
-            vertexBufferLayout.stride += 3 * sizeof(float);
-
-            vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 4, 3, vertexBufferLayout.stride });
-            vertexBufferLayout.stride += 3 * sizeof(float);
-        }
-
-        // add the submesh into the mesh
-        SubMesh submesh = {};
-        submesh.vertexBufferLayout = vertexBufferLayout;
-        submesh.vertices.swap(vertices);
-        submesh.indices.swap(indices);
-        myMesh->submeshes.push_back(submesh);
     }
 
-    void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial, String directory)
+    void ProcessAssimpMaterial(aiMaterial* material, MaterialSource& mySource, const std::string& directory)
     {
         aiString name;
         aiColor3D diffuseColor;
@@ -180,148 +295,827 @@ namespace ModelLoader
         material->Get(AI_MATKEY_COLOR_SPECULAR, specularColor);
         material->Get(AI_MATKEY_SHININESS, shininess);
 
-        myMaterial.name = name.C_Str();
-        myMaterial.albedo = vec3(diffuseColor.r, diffuseColor.g, diffuseColor.b);
-        myMaterial.emissive = vec3(emissiveColor.r, emissiveColor.g, emissiveColor.b);
-        myMaterial.smoothness = shininess / 256.0f;
+        mySource.name = name.C_Str();
+        mySource.albedo = vec3(diffuseColor.r, diffuseColor.g, diffuseColor.b);
+        mySource.emissive = vec3(emissiveColor.r, emissiveColor.g, emissiveColor.b);
+        mySource.smoothness = shininess / 256.0f;
+
+        const aiTextureType textureTypes[MaterialTexture_Count] = {
+            aiTextureType_DIFFUSE,
+            aiTextureType_EMISSIVE,
+            aiTextureType_SPECULAR,
+            aiTextureType_NORMALS,
+            aiTextureType_HEIGHT
+        };
 
         aiString aiFilename;
-        if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
+        for (u32 slot = 0; slot < MaterialTexture_Count; ++slot)
         {
-            material->GetTexture(aiTextureType_DIFFUSE, 0, &aiFilename);
-            String filename = MakeString(aiFilename.C_Str());
-            String filepath = MakePath(directory, filename);
-            myMaterial.albedoTextureIdx = LoadTexture2D(app, filepath.str);
+            if (material->GetTextureCount(textureTypes[slot]) > 0)
+            {
+                material->GetTexture(textureTypes[slot], 0, &aiFilename);
+                mySource.texturePaths[slot] = directory + "/" + aiFilename.C_Str();
+            }
         }
-        if (material->GetTextureCount(aiTextureType_EMISSIVE) > 0)
+    }
+
+    // The name is left out, materials copied across models often get renamed
+    static u64 HashMaterialContent(const Material& material)
+    {
+        u64 hash = HashBytes(&material.albedo, sizeof(material.albedo));
+        hash = HashBytes(&material.emissive, sizeof(material.emissive), hash);
+        hash = HashBytes(&material.smoothness, sizeof(material.smoothness), hash);
+        const u32 textureIndices[MaterialTexture_Count] = {
+            material.albedoTextureIdx,
+            material.emissiveTextureIdx,
+            material.specularTextureIdx,
+            material.normalsTextureIdx,
+            material.bumpTextureIdx
+        };
+        return HashBytes(textureIndices, sizeof(textureIndices), hash);
+    }
+
+    static bool IsSameMaterialContent(const Material& a, const Material& b)
+    {
+        return a.albedo == b.albedo && a.emissive == b.emissive && a.smoothness == b.smoothness &&
+               a.albedoTextureIdx == b.albedoTextureIdx && a.emissiveTextureIdx == b.emissiveTextureIdx &&
+               a.specularTextureIdx == b.specularTextureIdx && a.normalsTextureIdx == b.normalsTextureIdx &&
+               a.bumpTextureIdx == b.bumpTextureIdx;
+    }
+
+    // UINT32_MAX when no registered material has the same content
+    static u32 FindMaterialByContent(const App* app, const Material& material, u64 contentHash)
+    {
+        const u32 materialIdx = AssetRegistryManager::FindContent(app->assets, AssetType_MaterialContent, contentHash);
+        if (materialIdx == UINT32_MAX || !IsSameMaterialContent(app->materials[materialIdx], material))
+            return UINT32_MAX;
+        return materialIdx;
+    }
+
+    static void CountDuplicateMaterial(App* app, const Material& material)
+    {
+        app->deduplicationStats.duplicateMaterials++;
+        app->deduplicationStats.savedMaterialBytes += sizeof(Material) + material.name.capacity();
+    }
+
+    u32 CreateMaterial(App* app, const char* modelPath, const MaterialSource& source, bool& isShared)
+    {
+        isShared = false;
+
+        AssetId id = AssetRegistryManager::MakeAssetId(AssetType_Material, modelPath, source.name.c_str());
+        u32 materialIdx = AssetRegistryManager::Find(app->assets, id);
+        if (materialIdx != UINT32_MAX)
+            return materialIdx;
+
+        Material material = {};
+        material.name = source.name;
+        material.albedo = source.albedo;
+        material.emissive = source.emissive;
+        material.smoothness = source.smoothness;
+
+        u32* textureIndices[MaterialTexture_Count] = {
+            &material.albedoTextureIdx,
+            &material.emissiveTextureIdx,
+            &material.specularTextureIdx,
+            &material.normalsTextureIdx,
+            &material.bumpTextureIdx
+        };
+
+        const u32 defaultTextureIndices[MaterialTexture_Count] = {
+            app->whiteTexIdx,
+            app->blackTexIdx,
+            app->blackTexIdx,
+            app->normalTexIdx,
+            app->blackTexIdx
+        };
+
+        for (u32 slot = 0; slot < MaterialTexture_Count; ++slot)
         {
-            material->GetTexture(aiTextureType_EMISSIVE, 0, &aiFilename);
-            String filename = MakeString(aiFilename.C_Str());
-            String filepath = MakePath(directory, filename);
-            myMaterial.emissiveTextureIdx = LoadTexture2D(app, filepath.str);
+            if (!source.texturePaths[slot].empty())
+                *textureIndices[slot] = TextureStreamer::RequestTexture2D(app, source.texturePaths[slot].c_str(), TextureCompressor::GetSlotUsage(slot));
+            else
+                *textureIndices[slot] = defaultTextureIndices[slot];
         }
-        if (material->GetTextureCount(aiTextureType_SPECULAR) > 0)
+
+        //material.createNormalFromBump();
+
+        const u64 contentHash = HashMaterialContent(material);
+        materialIdx = FindMaterialByContent(app, material, contentHash);
+        if (materialIdx != UINT32_MAX)
         {
-            material->GetTexture(aiTextureType_SPECULAR, 0, &aiFilename);
-            String filename = MakeString(aiFilename.C_Str());
-            String filepath = MakePath(directory, filename);
-            myMaterial.specularTextureIdx = LoadTexture2D(app, filepath.str);
+            isShared = true;
+            CountDuplicateMaterial(app, material);
         }
-        if (material->GetTextureCount(aiTextureType_NORMALS) > 0)
+        else
         {
-            material->GetTexture(aiTextureType_NORMALS, 0, &aiFilename);
-            String filename = MakeString(aiFilename.C_Str());
-            String filepath = MakePath(directory, filename);
-            myMaterial.normalsTextureIdx = LoadTexture2D(app, filepath.str);
+            materialIdx = (u32)app->materials.size();
+            app->materials.push_back(material);
+            AssetRegistryManager::InsertContent(app->assets, AssetType_MaterialContent, contentHash, materialIdx);
         }
-        if (material->GetTextureCount(aiTextureType_HEIGHT) > 0)
+
+        AssetRegistryManager::Insert(app->assets, id, materialIdx, modelPath, source.name.c_str());
+        return materialIdx;
+    }
+
+    void MergeTexture(App* app, u32 duplicateTexIdx, u32 texIdx)
+    {
+        AssetId id = AssetRegistryManager::MakeAssetId(AssetType_Texture, app->textures[duplicateTexIdx].filepath.c_str());
+        AssetRegistryManager::Insert(app->assets, id, texIdx, app->textures[duplicateTexIdx].filepath.c_str());
+
+        // Materials already merged away are no longer registered under their content and are left alone
+        std::vector<u32> remappedMaterials(app->materials.size());
+        for (u32 i = 0; i < app->materials.size(); ++i)
         {
-            material->GetTexture(aiTextureType_HEIGHT, 0, &aiFilename);
-            String filename = MakeString(aiFilename.C_Str());
-            String filepath = MakePath(directory, filename);
-            myMaterial.bumpTextureIdx = LoadTexture2D(app, filepath.str);
+            remappedMaterials[i] = i;
+
+            Material& material = app->materials[i];
+            const u64 previousHash = HashMaterialContent(material);
+            if (AssetRegistryManager::FindContent(app->assets, AssetType_MaterialContent, previousHash) != i)
+                continue;
+
+            u32* textureIndices[MaterialTexture_Count] = {
+                &material.albedoTextureIdx,
+                &material.emissiveTextureIdx,
+                &material.specularTextureIdx,
+                &material.normalsTextureIdx,
+                &material.bumpTextureIdx
+            };
+            bool usesDuplicate = false;
+            for (u32* textureIdx : textureIndices)
+            {
+                if (*textureIdx == duplicateTexIdx)
+                {
+                    *textureIdx = texIdx;
+                    usesDuplicate = true;
+                }
+            }
+            if (!usesDuplicate)
+                continue;
+
+            AssetRegistryManager::RemoveContent(app->assets, AssetType_MaterialContent, previousHash);
+            const u64 contentHash = HashMaterialContent(material);
+            const u32 sharedIdx = FindMaterialByContent(app, material, contentHash);
+            if (sharedIdx != UINT32_MAX)
+            {
+                remappedMaterials[i] = sharedIdx;
+                CountDuplicateMaterial(app, material);
+            }
+            else
+            {
+                AssetRegistryManager::InsertContent(app->assets, AssetType_MaterialContent, contentHash, i);
+            }
         }
 
-        //myMaterial.createNormalFromBump();
+        for (Model& model : app->models)
+            for (u32& materialIdx : model.materialIdx)
+                materialIdx = remappedMaterials[materialIdx];
+
+        // Models loaded later look their materials up by model path and name
+        AssetRegistryManager::RemapIndices(app->assets, AssetType_Material, remappedMaterials);
     }
 
-    void ProcessAssimpNode(const aiScene* scene, aiNode* node, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
+    void ProcessAssimpNode(const aiScene* scene, aiNode* node, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices, u32 vertexQuantization, VertexQuantizationStats& quantizationStats)
     {
         // process all the node's meshes (if any)
         for (unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            ProcessAssimpMesh(scene, mesh, myMesh, baseMeshMaterialIndex, submeshMaterialIndices);
+            ProcessAssimpMesh(scene, mesh, myMesh, baseMeshMaterialIndex, submeshMaterialIndices, vertexQuantization, quantizationStats);
         }
 
         // then do the same for each of its children
         for (unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            ProcessAssimpNode(scene, node->mChildren[i], myMesh, baseMeshMaterialIndex, submeshMaterialIndices);
+            ProcessAssimpNode(scene, node->mChildren[i], myMesh, baseMeshMaterialIndex, submeshMaterialIndices, vertexQuantization, quantizationStats);
         }
     }
 
-    u32 LoadModel(App* app, const char* filename)
+    std::string GetDirectory(const std::string& path)
+    {
+        size_t separator = path.find_last_of("/\\");
+        return separator == std::string::npos ? std::string() : path.substr(0, separator);
+    }
+
+    void OptimizeMesh(ModelImport& import)
     {
-        const aiScene* scene = aiImportFile(filename,
+        std::vector<SubMesh>& submeshes = import.mesh.submeshes;
+        std::vector<MeshOptimizationStats> submeshStats(submeshes.size());
+        JobSystem::ParallelFor(submeshes.size(), [&](u32 i)
+        {
+            MeshOptimizer::OptimizeSubMesh(submeshes[i], submeshStats[i]);
+
+            const std::vector<vec3> positions = MeshOptimizer::ReadPositions(submeshes[i]);
+            MeshletBuilder::BuildMeshlets(submeshes[i], positions);
+            MeshSimplifier::BuildLodChain(submeshes[i], positions);
+        });
+
+        MeshOptimizationStats& total = import.optimizationStats;
+        total = {};
+        for (u32 i = 0; i < submeshStats.size(); ++i)
+        {
+            const MeshOptimizationStats& stats = submeshStats[i];
+            ILOG("%s submesh %u (%u triangles): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overdraw %.3f -> %.3f",
+                 import.filepath.c_str(), i, stats.triangleCount,
+                 stats.acmrBefore, stats.acmrAfter, stats.atvrBefore, stats.atvrAfter, stats.overdrawBefore, stats.overdrawAfter);
+
+            const SubMesh& submesh = submeshes[i];
+            std::string lodLog;
+            for (u32 level = 1; level < submesh.lodCount; ++level)
+            {
+                char levelLog[64];
+                snprintf(levelLog, sizeof(levelLog), " %u (error %.4f)", submesh.lods[level].indexCount / 3, submesh.lods[level].error);
+                lodLog += levelLog;
+            }
+            ILOG("%s submesh %u LOD triangles:%s", import.filepath.c_str(), i, lodLog.empty() ? " none" : lodLog.c_str());
+
+            const f32 weight = (f32)stats.triangleCount;
+            total.triangleCount += stats.triangleCount;
+            total.acmrBefore += stats.acmrBefore * weight;
+            total.acmrAfter += stats.acmrAfter * weight;
+            total.atvrBefore += stats.atvrBefore * weight;
+            total.atvrAfter += stats.atvrAfter * weight;
+            total.overdrawBefore += stats.overdrawBefore * weight;
+            total.overdrawAfter += stats.overdrawAfter * weight;
+        }
+
+        if (total.triangleCount > 0)
+        {
+            const f32 invTriangleCount = 1.0f / total.triangleCount;
+            total.acmrBefore *= invTriangleCount;
+            total.acmrAfter *= invTriangleCount;
+            total.atvrBefore *= invTriangleCount;
+            total.atvrAfter *= invTriangleCount;
+            total.overdrawBefore *= invTriangleCount;
+            total.overdrawAfter *= invTriangleCount;
+        }
+    }
+
+    u32 GetIndexSize(GLenum indexType)
+    {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(u16) : sizeof(u32);
+    }
+
+    void WriteIndices(const SubMesh& submesh, u8* dst)
+    {
+        if (submesh.indexType == GL_UNSIGNED_SHORT)
+        {
+            u16* dst16 = (u16*)dst;
+            for (u32 i = 0; i < submesh.indices.size(); ++i)
+                dst16[i] = (u16)submesh.indices[i];
+        }
+        else
+        {
+            memcpy(dst, submesh.indices.data(), submesh.indices.size() * sizeof(u32));
+        }
+    }
+
+    void LayoutMesh(ModelImport& import)
+    {
+        import.vertexBufferSize = 0;
+        import.indexBufferSize = 0;
+
+        for (u32 i = 0; i < import.mesh.submeshes.size(); ++i)
+        {
+            SubMesh& submesh = import.mesh.submeshes[i];
+
+            submesh.vertexOffset = import.vertexBufferSize;
+            import.vertexBufferSize += submesh.vertices.size();
+
+            submesh.vertexCount = submesh.vertices.size() / submesh.vertexBufferLayout.stride;
+            submesh.indexType = submesh.vertexCount <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+            // Keep 32-bit index ranges aligned after 16-bit ones
+            submesh.indexOffset = BufferManager::Align(import.indexBufferSize, sizeof(u32));
+            submesh.indexCount = submesh.indices.size();
+            import.indexBufferSize = submesh.indexOffset + submesh.indexCount * GetIndexSize(submesh.indexType);
+        }
+    }
+
+    // Assimp opens the model and whatever it references (.mtl...) through these, so they come from the asset pack too
+    struct AssimpAssetFile
+    {
+        AssetFile asset;
+        u64       cursor;
+    };
+
+    static size_t AssimpRead(aiFile* file, char* buffer, size_t size, size_t count)
+    {
+        AssimpAssetFile* assetFile = (AssimpAssetFile*)file->UserData;
+        if (size == 0)
+            return 0;
+
+        const u64 available = (assetFile->asset.size - assetFile->cursor) / size;
+        const u64 readCount = count < available ? count : available;
+        memcpy(buffer, assetFile->asset.data + assetFile->cursor, readCount * size);
+        assetFile->cursor += readCount * size;
+        return readCount;
+    }
+
+    static size_t AssimpWrite(aiFile*, const char*, size_t, size_t)
+    {
+        return 0;
+    }
+
+    static size_t AssimpTell(aiFile* file)
+    {
+        return ((AssimpAssetFile*)file->UserData)->cursor;
+    }
+
+    static size_t AssimpFileSize(aiFile* file)
+    {
+        return ((AssimpAssetFile*)file->UserData)->asset.size;
+    }
+
+    static aiReturn AssimpSeek(aiFile* file, size_t offset, aiOrigin origin)
+    {
+        AssimpAssetFile* assetFile = (AssimpAssetFile*)file->UserData;
+        u64 cursor = offset;
+        if (origin == aiOrigin_CUR)
+            cursor = assetFile->cursor + offset;
+        else if (origin == aiOrigin_END)
+            cursor = assetFile->asset.size - offset;
+
+        if (cursor > assetFile->asset.size)
+            return aiReturn_FAILURE;
+
+        assetFile->cursor = cursor;
+        return aiReturn_SUCCESS;
+    }
+
+    static void AssimpFlush(aiFile*)
+    {
+    }
+
+    static aiFile* AssimpOpen(aiFileIO* fileIO, const char* filepath, const char* mode)
+    {
+        if (strchr(mode, 'w') != NULL)
+            return NULL;
+
+        AssimpAssetFile* assetFile = new AssimpAssetFile{};
+        if (!AssetPack::OpenAsset(filepath, assetFile->asset))
+        {
+            delete assetFile;
+            return NULL;
+        }
+
+        // Anything but the model itself (material libraries...) is a dependency of the import
+        ModelImport* import = (ModelImport*)fileIO->UserData;
+        if (AssetPack::NormalizePath(filepath) != AssetPack::NormalizePath(import->filepath.c_str()))
+            import->dependencies.push_back(filepath);
+
+        aiFile* file = new aiFile{};
+        file->ReadProc = AssimpRead;
+        file->WriteProc = AssimpWrite;
+        file->TellProc = AssimpTell;
+        file->FileSizeProc = AssimpFileSize;
+        file->SeekProc = AssimpSeek;
+        file->FlushProc = AssimpFlush;
+        file->UserData = (aiUserData)assetFile;
+        return file;
+    }
+
+    static void AssimpClose(aiFileIO*, aiFile* file)
+    {
+        AssimpAssetFile* assetFile = (AssimpAssetFile*)file->UserData;
+        AssetPack::CloseAsset(assetFile->asset);
+        delete assetFile;
+        delete file;
+    }
+
+    static const aiScene* ImportAssimpScene(ModelImport& import)
+    {
+        aiFileIO fileIO = { AssimpOpen, AssimpClose, (aiUserData)&import };
+        return aiImportFileEx(import.filepath.c_str(),
             aiProcess_Triangulate |
             aiProcess_GenSmoothNormals |
             aiProcess_CalcTangentSpace |
             aiProcess_JoinIdenticalVertices |
             aiProcess_PreTransformVertices |
-            aiProcess_ImproveCacheLocality |
             aiProcess_OptimizeMeshes |
             aiProcess_CalcTangentSpace |
-            aiProcess_SortByPType);
+            aiProcess_SortByPType,
+            &fileIO);
+    }
 
+    static bool ImportAssimp(ModelImport& import)
+    {
+        const char* filename = import.filepath.c_str();
+        const aiScene* scene = ImportAssimpScene(import);
         if (!scene)
         {
             ELOG("Error loading mesh %s: %s", filename, aiGetErrorString());
-            return UINT32_MAX;
+            return false;
         }
 
-        app->meshes.push_back(Mesh{});
-        Mesh& mesh = app->meshes.back();
-        u32 meshIdx = (u32)app->meshes.size() - 1u;
-
-        app->models.push_back(Model{});
-        Model& model = app->models.back();
-        model.meshIdx = meshIdx;
-        u32 modelIdx = (u32)app->models.size() - 1u;
-
-        String directory = GetDirectoryPart(MakeString(filename));
+        std::string directory = GetDirectory(import.filepath);
 
         // Create a list of materials
-        u32 baseMeshMaterialIndex = (u32)app->materials.size();
+        import.materials.resize(scene->mNumMaterials);
         for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+            ProcessAssimpMaterial(scene->mMaterials[i], import.materials[i], directory);
+
+        import.quantizationStats = {};
+        import.mesh.submeshes.reserve(scene->mNumMeshes);
+        ProcessAssimpNode(scene, scene->mRootNode, &import.mesh, 0, import.submeshMaterialIdx, import.vertexQuantization, import.quantizationStats);
+
+        aiReleaseImport(scene);
+        return true;
+    }
+
+#if OBJ_LOADER_BENCHMARK_ASSIMP
+    static void BenchmarkAssimp(const char* filename)
+    {
+        AssetFile file = {};
+        AssetPack::OpenAsset(filename, file);
+        const f64 megabytes = file.size / (1024.0 * 1024.0);
+        AssetPack::CloseAsset(file);
+
+        ModelImport import = {};
+        import.filepath = filename;
+
+        const f64 startTime = glfwGetTime();
+        const aiScene* scene = ImportAssimpScene(import);
+        const f64 assimpMs = (glfwGetTime() - startTime) * 1000.0;
+        if (scene)
+            aiReleaseImport(scene);
+
+        ILOG("Assimp imported %s (%.2f MB) in %.2f ms: %.1f MB/s", filename, megabytes, assimpMs, megabytes / (assimpMs / 1000.0));
+    }
+#endif
+
+    bool ImportModelSource(ModelImport& import)
+    {
+        const char* filename = import.filepath.c_str();
+
+        // Assimp stays in charge of everything but .obj, and of the .obj files the native reader can't open
+        bool imported = false;
+        if (ObjLoader::IsObjFile(filename))
         {
-            app->materials.push_back(Material{});
-            Material& material = app->materials.back();
-            ProcessAssimpMaterial(app, scene->mMaterials[i], material, directory);
+#if OBJ_LOADER_BENCHMARK_ASSIMP
+            BenchmarkAssimp(filename);
+#endif
+            imported = ObjLoader::ImportObj(import);
         }
 
-        ProcessAssimpNode(scene, scene->mRootNode, &mesh, baseMeshMaterialIndex, model.materialIdx);
+        if (!imported && !ImportAssimp(import))
+            return false;
 
-        aiReleaseImport(scene);
+        OptimizeMesh(import);
+        LayoutMesh(import);
+        return true;
+    }
 
-        u32 vertexBufferSize = 0;
-        u32 indexBufferSize = 0;
+    void ImportModel(ModelImport& import)
+    {
+        const f64 startTime = glfwGetTime();
+
+        if (MeshCache::ReadModel(import))
+            import.fromCache = true;
+        else if (!ImportModelSource(import))
+            return;
+
+        import.importMs = (glfwGetTime() - startTime) * 1000.0;
 
-        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+        if (!import.fromCache)
         {
-            vertexBufferSize += mesh.submeshes[i].vertices.size() * sizeof(float);
-            indexBufferSize += mesh.submeshes[i].indices.size() * sizeof(u32);
+            import.coldLoadMs = import.importMs;
+            MeshCache::WriteModel(import);
         }
 
-        glGenBuffers(1, &mesh.vertexBufferHandle);
-        glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
-        glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, NULL, GL_STATIC_DRAW);
+        import.success = true;
+    }
 
-        glGenBuffers(1, &mesh.indexBufferHandle);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, NULL, GL_STATIC_DRAW);
+    // Writes the vertices and indices of the submeshes of mesh in range, streamData and
+    // indexData point to the first vertex and index of the range
+    static void WriteRange(const GeometryPool& pool, const Mesh& mesh, const GeometryRange& range, const ModelImport& import,
+                           u8* const* streamData, u8* indexData)
+    {
+        const u32 indexSize = GetIndexSize(pool.indexType);
+        const u32 rangeFirstVertex = Tlsf::GetOffset(pool.vertexAllocator, range.vertexAllocation);
+        const u32 rangeFirstIndex = Tlsf::GetOffset(pool.indexAllocator, range.indexAllocation);
 
-        u32 indicesOffset = 0;
-        u32 verticesOffset = 0;
+        JobSystem::ParallelFor(mesh.submeshes.size(), [&](u32 i)
+        {
+            const SubMesh& submesh = mesh.submeshes[i];
+            if (submesh.poolIdx != range.poolIdx)
+                return;
 
-        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+            u8* submeshStreams[GEOMETRY_MAX_STREAMS] = {};
+            for (u32 s = 0; s < GEOMETRY_MAX_STREAMS; ++s)
+            {
+                if (streamData[s])
+                    submeshStreams[s] = streamData[s] + (u64)(submesh.baseVertex - rangeFirstVertex) * pool.streams[s].layout.stride;
+            }
+            u8* submeshIndices = indexData + (u64)(submesh.firstIndex - rangeFirstIndex) * indexSize;
+            if (import.fromCache)
+            {
+                GeometryPoolManager::WriteStreams(pool, import.cachedVertexData + submesh.vertexOffset, submesh.vertexCount, submeshStreams);
+                memcpy(submeshIndices, import.cachedIndexData + submesh.indexOffset, (u64)submesh.indexCount * indexSize);
+            }
+            else
+            {
+                GeometryPoolManager::WriteStreams(pool, submesh.vertices.data(), submesh.vertexCount, submeshStreams);
+                WriteIndices(submesh, submeshIndices);
+            }
+        });
+    }
+
+    void UploadMesh(std::vector<GeometryPool>& pools, Mesh& mesh, const ModelImport& import, u32 readLocations)
+    {
+        GeometryPoolManager::AllocateMesh(pools, mesh, readLocations);
+
+        // Each range of the mesh is mapped on its own and its submeshes are copied into it
+        // once: the interleaved vertices, already converted by the import, of the cache blobs
+        // or of SubMesh::vertices are split into the vertex streams and the indices narrowed.
+        // When a range can't be mapped, or is lost while mapped, the same writes go to
+        // staging copies uploaded with glBufferSubData
+        for (const GeometryRange& range : mesh.geometryRanges)
         {
-            const void* verticesData = mesh.submeshes[i].vertices.data();
-            const u32   verticesSize = mesh.submeshes[i].vertices.size() * sizeof(float);
-            glBufferSubData(GL_ARRAY_BUFFER, verticesOffset, verticesSize, verticesData);
-            mesh.submeshes[i].vertexOffset = verticesOffset;
-            verticesOffset += verticesSize;
+            if (range.vertexCount == 0 || range.indexCount == 0)
+                continue;
+
+            const GeometryPool& pool = pools[range.poolIdx];
+            const u32 indexSize = GetIndexSize(pool.indexType);
+            const u32 rangeFirstVertex = Tlsf::GetOffset(pool.vertexAllocator, range.vertexAllocation);
+            const u32 rangeFirstIndex = Tlsf::GetOffset(pool.indexAllocator, range.indexAllocation);
+
+            const u64 indexOffset = (u64)rangeFirstIndex * indexSize;
+            const u64 indexBytes = (u64)range.indexCount * indexSize;
+
+            const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+            bool mapped = true;
+            u8* streamData[GEOMETRY_MAX_STREAMS] = {};
+            for (u32 i = 0; i < GEOMETRY_MAX_STREAMS; ++i)
+            {
+                const GeometryStream& stream = pool.streams[i];
+                if (stream.handle == 0)
+                    continue;
+                glBindBuffer(GL_ARRAY_BUFFER, stream.handle);
+                streamData[i] = (u8*)glMapBufferRange(GL_ARRAY_BUFFER, (u64)rangeFirstVertex * stream.layout.stride, (u64)range.vertexCount * stream.layout.stride, access);
+                mapped &= streamData[i] != nullptr;
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, pool.indexBufferHandle);
+            u8* indexData = (u8*)glMapBufferRange(GL_COPY_WRITE_BUFFER, indexOffset, indexBytes, access);
+            mapped &= indexData != nullptr;
+
+            if (mapped)
+                WriteRange(pool, mesh, range, import, streamData, indexData);
+
+            // Unmaps whatever got mapped, a failed unmap means the contents are undefined
+            bool unmapped = true;
+            for (u32 i = 0; i < GEOMETRY_MAX_STREAMS; ++i)
+            {
+                if (!streamData[i])
+                    continue;
+                glBindBuffer(GL_ARRAY_BUFFER, pool.streams[i].handle);
+                unmapped &= glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+            }
+            if (indexData)
+                unmapped &= glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_TRUE;
+
+            if (mapped && unmapped)
+                continue;
+
+            if (!mapped)
+            {
+                ELOG("Geometry pool ranges of %s could not be mapped, uploading them with glBufferSubData", import.filepath.c_str());
+            }
+            else
+            {
+                ELOG("Geometry pool ranges of %s were lost while mapped, uploading them again with glBufferSubData", import.filepath.c_str());
+            }
+
+            // Same writes into staging copies of the range
+            std::vector<u8> streamStaging[GEOMETRY_MAX_STREAMS];
+            std::vector<u8> indexStaging(indexBytes);
+            for (u32 i = 0; i < GEOMETRY_MAX_STREAMS; ++i)
+            {
+                streamData[i] = nullptr;
+                if (pool.streams[i].handle == 0)
+                    continue;
+                streamStaging[i].resize((u64)range.vertexCount * pool.streams[i].layout.stride);
+                streamData[i] = streamStaging[i].data();
+            }
+            WriteRange(pool, mesh, range, import, streamData, indexStaging.data());
 
-            const void* indicesData = mesh.submeshes[i].indices.data();
-            const u32   indicesSize = mesh.submeshes[i].indices.size() * sizeof(u32);
-            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indicesOffset, indicesSize, indicesData);
-            mesh.submeshes[i].indexOffset = indicesOffset;
-            indicesOffset += indicesSize;
+            for (u32 i = 0; i < GEOMETRY_MAX_STREAMS; ++i)
+            {
+                if (!streamData[i])
+                    continue;
+                const GeometryStream& stream = pool.streams[i];
+                glBindBuffer(GL_ARRAY_BUFFER, stream.handle);
+                glBufferSubData(GL_ARRAY_BUFFER, (u64)rangeFirstVertex * stream.layout.stride, streamStaging[i].size(), streamData[i]);
+            }
+            glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset, indexBytes, indexStaging.data());
         }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 
+        // Bounds of the whole mesh for the entity culling, the meshlets stay on the CPU for their own
+        mesh.boundsMin = vec3(FLT_MAX);
+        mesh.boundsMax = vec3(-FLT_MAX);
+        for (const SubMesh& submesh : mesh.submeshes)
+        {
+            for (const Meshlet& meshlet : submesh.meshlets)
+            {
+                mesh.boundsMin = glm::min(mesh.boundsMin, vec3(meshlet.aabbMin));
+                mesh.boundsMax = glm::max(mesh.boundsMax, vec3(meshlet.aabbMax));
+            }
+        }
+    }
+
+    const char* GetGeometryResidencyName(GeometryResidency residency)
+    {
+        switch (residency)
+        {
+        case GeometryResidency_Drop:          return "drop";
+        case GeometryResidency_PositionsOnly: return "positions only";
+        case GeometryResidency_Keep:          return "keep";
+        }
+        return "unknown";
+    }
+
+    static u64 GetCpuGeometryBytes(const SubMesh& submesh)
+    {
+        return submesh.vertices.capacity() + submesh.indices.capacity() * sizeof(u32) + submesh.positions.capacity() * sizeof(vec3);
+    }
+
+    void ApplyGeometryResidency(Mesh& mesh, const ModelImport& import, ModelLoadStats& stats)
+    {
+        // Reference: every vertex and every index of every level, as GeometryResidency_Keep holds them
+        u64 fullCopyBytes = import.vertexBufferSize;
+        for (SubMesh& submesh : mesh.submeshes)
+        {
+            fullCopyBytes += submesh.indexCount * sizeof(u32);
+
+            if (import.residency == GeometryResidency_PositionsOnly)
+            {
+                submesh.positions = MeshOptimizer::ReadPositions(submesh);
+                submesh.indices.resize(submesh.lods[0].indexCount);
+                submesh.indices.shrink_to_fit();
+            }
+            if (import.residency != GeometryResidency_Keep)
+                std::vector<u8>().swap(submesh.vertices);
+            if (import.residency == GeometryResidency_Drop)
+                std::vector<u32>().swap(submesh.indices);
+
+            stats.residentGeometryBytes += GetCpuGeometryBytes(submesh);
+        }
+
+        stats.residency = import.residency;
+        stats.reclaimedGeometryBytes = fullCopyBytes > stats.residentGeometryBytes ? fullCopyBytes - stats.residentGeometryBytes : 0;
+    }
+
+    void FinalizeModel(App* app, u32 modelIdx, ModelImport& import)
+    {
+        const f64 startTime = glfwGetTime();
+
+        if (!import.success)
+            return;
+
+        // Only requests the textures, they are decoded and uploaded in the background
+        std::vector<u32> materialIndices;
+        u32 sharedMaterialCount = 0;
+        for (const MaterialSource& material : import.materials)
+        {
+            bool isShared;
+            materialIndices.push_back(CreateMaterial(app, import.filepath.c_str(), material, isShared));
+            sharedMaterialCount += isShared ? 1 : 0;
+        }
+
+        // A reload replaces the mesh in place, so entities keep drawing the same mesh index
+        Model& model = app->models[modelIdx];
+        if (model.meshIdx == UINT32_MAX)
+        {
+            app->meshes.push_back(Mesh{});
+            model.meshIdx = (u32)app->meshes.size() - 1u;
+        }
+        else
+        {
+            GeometryPoolManager::FreeMesh(app->geometryPools, app->meshes[model.meshIdx]);
+            app->meshes[model.meshIdx] = Mesh{};
+        }
+
+        Mesh& mesh = app->meshes[model.meshIdx];
+        mesh.submeshes.swap(import.mesh.submeshes);
+
+        const f64 uploadStartTime = glfwGetTime();
+        UploadMesh(app->geometryPools, mesh, import, GeometryPoolManager::GetReadLocations(app->programs));
+        const f64 uploadMs = (glfwGetTime() - uploadStartTime) * 1000.0;
+
+        model.materialIdx.clear();
+        for (u32 relativeMaterialIdx : import.submeshMaterialIdx)
+            model.materialIdx.push_back(materialIndices[relativeMaterialIdx]);
+
+        ModelLoadStats stats = {};
+        stats.filepath = import.filepath;
+        stats.loadMs = import.importMs + (glfwGetTime() - startTime) * 1000.0;
+        stats.coldLoadMs = import.fromCache ? import.coldLoadMs : stats.loadMs;
+        stats.uploadMs = uploadMs;
+        stats.fromCache = import.fromCache;
+        stats.vertexQuantization = import.vertexQuantization;
+        stats.quantization = import.quantizationStats;
+        stats.optimization = import.optimizationStats;
+        stats.materialCount = import.materials.size();
+        stats.sharedMaterialCount = sharedMaterialCount;
+        ApplyGeometryResidency(mesh, import, stats);
+        app->modelLoadStats.push_back(stats);
+
+        if (stats.fromCache)
+        {
+            ILOG("Loaded %s from mesh cache in %.2f ms (cold import took %.2f ms, upload %.2f ms)", stats.filepath.c_str(), stats.loadMs, stats.coldLoadMs, stats.uploadMs);
+        }
+        else
+        {
+            ILOG("Imported %s in %.2f ms (upload %.2f ms)", stats.filepath.c_str(), stats.loadMs, stats.uploadMs);
+        }
+
+        u32 shortIndexSubmeshes = 0;
+        u32 meshletCount = 0;
+        for (const SubMesh& submesh : mesh.submeshes)
+        {
+            shortIndexSubmeshes += submesh.indexType == GL_UNSIGNED_SHORT ? 1 : 0;
+            meshletCount += submesh.meshlets.size();
+        }
+        ILOG("%s indices: %u KB, %u of %u submeshes use 16-bit indices, %u meshlets", stats.filepath.c_str(),
+             import.indexBufferSize / 1024, shortIndexSubmeshes, (u32)mesh.submeshes.size(), meshletCount);
+
+        ILOG("%s materials: %u, %u shared with materials already loaded", stats.filepath.c_str(), stats.materialCount, stats.sharedMaterialCount);
+
+        ILOG("%s CPU geometry (%s): %u KB resident, %u KB reclaimed", stats.filepath.c_str(), GetGeometryResidencyName(import.residency),
+             (u32)(stats.residentGeometryBytes / 1024), (u32)(stats.reclaimedGeometryBytes / 1024));
+
+        const VertexQuantizationStats& quantization = stats.quantization;
+        ILOG("%s vertices: %u KB -> %u KB, max error: position %f, normal %.3f deg, uv %f", stats.filepath.c_str(),
+             quantization.rawVertexBytes / 1024, quantization.vertexBytes / 1024,
+             quantization.maxPositionError, quantization.maxNormalErrorDegrees, quantization.maxTexCoordError);
+    }
+
+    static void QueueImport(App* app, u32 modelIdx, const char* filename, u32 vertexQuantization, GeometryResidency residency)
+    {
+        PendingModel pending = {};
+        pending.modelIdx = modelIdx;
+        pending.import = new ModelImport{};
+        pending.import->filepath = filename;
+        pending.import->vertexQuantization = vertexQuantization;
+        pending.import->residency = residency;
+
+        ModelImport* import = pending.import;
+        pending.done = JobSystem::Submit([import]() { ImportModel(*import); });
+
+        app->pendingModels.push_back(std::move(pending));
+    }
+
+    u32 LoadModelAsync(App* app, const char* filename, u32 vertexQuantization, GeometryResidency residency)
+    {
+        AssetId id = AssetRegistryManager::MakeAssetId(AssetType_Model, filename);
+        u32 modelIdx = AssetRegistryManager::Find(app->assets, id);
+        if (modelIdx != UINT32_MAX)
+            return modelIdx;
+
+        // The handle is valid right away, the model just has no mesh until it is finalized
+        Model model = {};
+        model.meshIdx = UINT32_MAX;
+        app->models.push_back(model);
+        modelIdx = (u32)app->models.size() - 1u;
+        AssetRegistryManager::Insert(app->assets, id, modelIdx, filename);
+
+        QueueImport(app, modelIdx, filename, vertexQuantization, residency);
         return modelIdx;
     }
-}
\ No newline at end of file
+
+    void ReloadModel(App* app, u32 modelIdx, const char* filename, u32 vertexQuantization, GeometryResidency residency)
+    {
+        QueueImport(app, modelIdx, filename, vertexQuantization, residency);
+    }
+
+    void UpdatePendingModels(App* app, bool waitForAll)
+    {
+        for (u32 i = 0; i < app->pendingModels.size();)
+        {
+            PendingModel& pending = app->pendingModels[i];
+
+            if (waitForAll)
+                JobSystem::Wait(pending.done);
+            else if (pending.done.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                ++i;
+                continue;
+            }
+
+            FinalizeModel(app, pending.modelIdx, *pending.import);
+            AssetPack::CloseAsset(pending.import->cacheFile);
+            delete pending.import;
+
+            app->pendingModels.erase(app->pendingModels.begin() + i);
+        }
+    }
+
+    u32 LoadModel(App* app, const char* filename, u32 vertexQuantization, GeometryResidency residency)
+    {
+        u32 modelIdx = LoadModelAsync(app, filename, vertexQuantization, residency);
+        UpdatePendingModels(app, true);
+        return app->models[modelIdx].meshIdx != UINT32_MAX ? modelIdx : UINT32_MAX;
+    }
+}
@@ -2,30 +2,164 @@
 #define MODEL_LOADING_FUNC
 
 #include <assimp/cimport.h>
+#include <assimp/cfileio.h>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include "Globals.h"
+#include "platform.h"
+#include "TextureCompressionFunctions.h"
+#include "GeometryPoolFunctions.h"
+#include "AssetPackFunctions.h"
 #include <vector>
+#include <future>
 
 struct App;
 
+// Vertex attribute compression, chosen per import. Packed normals and tangents
+// are fed to the shaders as normalized signed ints, so they need no decoding.
+// With packed tangents the bitangent is not stored, the shader rebuilds it as
+// cross(normal, tangent.xyz) * tangent.w. Half positions lose precision quickly
+// away from the origin: only use them on models within a few hundred units.
+enum VertexQuantization
+{
+    VertexQuantization_None           = 0,
+    VertexQuantization_HalfPositions  = 1 << 0, // 4 x GL_HALF_FLOAT, w = 1
+    VertexQuantization_HalfTexCoords  = 1 << 1, // 2 x GL_HALF_FLOAT
+    VertexQuantization_PackedNormals  = 1 << 2, // GL_INT_2_10_10_10_REV
+    VertexQuantization_PackedTangents = 1 << 3, // GL_INT_2_10_10_10_REV, w = bitangent sign
+
+    VertexQuantization_Default = VertexQuantization_HalfTexCoords | VertexQuantization_PackedNormals | VertexQuantization_PackedTangents,
+    VertexQuantization_All     = VertexQuantization_Default | VertexQuantization_HalfPositions,
+};
+
+// What stays in the SubMesh on the CPU once its GL buffers are filled.
+// Rendering only reads the GL copy, so most models drop theirs; models used
+// for CPU work (picking, collision) keep positions or everything.
+enum GeometryResidency
+{
+    GeometryResidency_Drop,          // GL copy only
+    GeometryResidency_PositionsOnly, // SubMesh::positions and the full detail indices
+    GeometryResidency_Keep,          // SubMesh::vertices and the indices of every level
+};
+
+// CPU side result of importing a model. It is filled on a worker thread and
+// only turned into GL objects once it reaches the main thread.
+struct ModelImport
+{
+    std::string                 filepath;
+    std::vector<std::string>    dependencies;       // other files the import read (material libraries...)
+    Mesh                        mesh;               // submeshes only, no GL objects yet
+    std::vector<u32>            submeshMaterialIdx; // relative to materials
+    std::vector<MaterialSource> materials;
+    u32                         vertexQuantization; // VertexQuantization flags
+    GeometryResidency           residency;
+    VertexQuantizationStats     quantizationStats;
+    MeshOptimizationStats       optimizationStats;  // triangle weighted over the submeshes
+
+    u32                         vertexBufferSize;
+    u32                         indexBufferSize;
+
+    AssetFile                   cacheFile;          // stays open until the upload
+    const u8*                   cachedVertexData;
+    const u8*                   cachedIndexData;
+
+    f64                         importMs;
+    f64                         coldLoadMs;
+    bool                        fromCache;
+    bool                        success;
+};
+
+// Per vertex attributes of an imported mesh, in the Assimp convention.
+// texCoords (xy used) and the tangent space are optional.
+struct VertexStreams
+{
+    u32         vertexCount;
+    const vec3* positions;
+    const vec3* normals;
+    const vec3* texCoords;
+    const vec3* tangents;
+    const vec3* bitangents;
+};
+
+struct PendingModel
+{
+    u32               modelIdx;
+    ModelImport*      import;
+    std::future<void> done;
+};
+
 namespace ModelLoader
 {
     Image LoadImage(const char* filename);
 
     void FreeImage(Image image);
 
-    GLuint CreateTexture2DFromImage(Image image);
+    u32 FindTexture2D(App* app, const char* filepath);
+
+    // Takes ownership of the image
+    u32 AddTexture2D(App* app, const char* filepath, Image image, bool isColor);
+
+    u32 LoadTexture2D(App* app, const char* filepath, bool isColor);
+
+    // Picks the vertex layout for the streams and quantization, and fills submesh.vertices
+    void BuildSubMeshVertices(const VertexStreams& streams, u32 vertexQuantization, VertexQuantizationStats& quantizationStats, SubMesh& submesh);
+
+    void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices, u32 vertexQuantization, VertexQuantizationStats& quantizationStats);
+
+    void ProcessAssimpMaterial(aiMaterial* material, MaterialSource& mySource, const std::string& directory);
+
+    // Materials are identified by the model they come from and their name. A material with the
+    // same parameters and textures as one already loaded returns that one, sets isShared.
+    u32 CreateMaterial(App* app, const char* modelPath, const MaterialSource& source, bool& isShared);
+
+    // Moves every reference to duplicateTexIdx over to texIdx, materials left identical are merged
+    void MergeTexture(App* app, u32 duplicateTexIdx, u32 texIdx);
+
+    void ProcessAssimpNode(const aiScene* scene, aiNode* node, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices, u32 vertexQuantization, VertexQuantizationStats& quantizationStats);
+
+    std::string GetDirectory(const std::string& path);
+
+    // Runs the MeshOptimizer over every submesh and reports the gains
+    void OptimizeMesh(ModelImport& import);
+
+    // Picks the index type of every submesh and assigns its place in the GL buffers
+    void LayoutMesh(ModelImport& import);
+
+    u32 GetIndexSize(GLenum indexType);
+
+    // Writes submesh.indices as submesh.indexType
+    void WriteIndices(const SubMesh& submesh, u8* dst);
+
+    // Parses the source, skipping the mesh cache, and optimizes and lays out its submeshes
+    bool ImportModelSource(ModelImport& import);
+
+    // Worker side: everything that does not need the GL context. Textures are
+    // left to the TextureStreamer.
+    void ImportModel(ModelImport& import);
+
+    // Allocates the mesh in the geometry pools and writes its vertices and indices there,
+    // only the vertex streams holding one of readLocations are created
+    void UploadMesh(std::vector<GeometryPool>& pools, Mesh& mesh, const ModelImport& import, u32 readLocations);
+
+    const char* GetGeometryResidencyName(GeometryResidency residency);
+
+    // Releases what the residency policy of the import doesn't keep, after UploadMesh
+    void ApplyGeometryResidency(Mesh& mesh, const ModelImport& import, ModelLoadStats& stats);
 
-    u32 LoadTexture2D(App* app, const char* filepath);
+    // Main thread side: requests the textures, creates the materials and buffers of an import
+    void FinalizeModel(App* app, u32 modelIdx, ModelImport& import);
 
-    void ProcessAssimpMesh(const aiScene* scene, aiMesh* mesh, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices);
+    // Returns the model index right away. The model has meshIdx == UINT32_MAX until
+    // UpdatePendingModels finalizes it.
+    u32 LoadModelAsync(App* app, const char* filename, u32 vertexQuantization, GeometryResidency residency);
 
-    void ProcessAssimpMaterial(App* app, aiMaterial* material, Material& myMaterial, String directory);
+    // Imports the file again into the same model. It keeps drawing its current mesh until
+    // UpdatePendingModels swaps the new one in and frees the old pool ranges.
+    void ReloadModel(App* app, u32 modelIdx, const char* filename, u32 vertexQuantization, GeometryResidency residency);
 
-    void ProcessAssimpNode(const aiScene* scene, aiNode* node, Mesh* myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices);
+    void UpdatePendingModels(App* app, bool waitForAll);
 
-    u32 LoadModel(App* app, const char* filename);
+    u32 LoadModel(App* app, const char* filename, u32 vertexQuantization, GeometryResidency residency);
 }
 
 #endif
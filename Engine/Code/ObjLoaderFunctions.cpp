@@ -0,0 +1,670 @@
+#include "ObjLoaderFunctions.h"
+#include "JobSystemFunctions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#define OBJ_MISSING_INDEX INT32_MIN
+
+namespace ObjLoader
+{
+    // Positive OBJ indices are global, negative ones count back from the last
+    // element seen, which a chunk only knows relative to its own start
+    enum CornerLocal
+    {
+        CornerLocal_Position = 1 << 0,
+        CornerLocal_TexCoord = 1 << 1,
+        CornerLocal_Normal   = 1 << 2,
+    };
+
+    struct FaceCorner
+    {
+        i32 position; // 0-based, OBJ_MISSING_INDEX when absent
+        i32 texCoord;
+        i32 normal;
+        u32 localMask; // CornerLocal flags of the indices still relative to the chunk
+    };
+
+    struct MaterialRun
+    {
+        u32         firstTriangle; // relative to the chunk
+        std::string name;
+    };
+
+    struct Chunk
+    {
+        const char*              begin;
+        const char*              end;
+        std::vector<vec3>        positions;
+        std::vector<vec3>        texCoords;
+        std::vector<vec3>        normals;
+        std::vector<FaceCorner>  corners; // 3 per triangle
+        std::vector<MaterialRun> materialRuns;
+        std::vector<std::string> materialLibraries;
+    };
+
+    struct ObjSubMesh
+    {
+        u32                     materialIdx; // in ModelImport::materials
+        std::vector<FaceCorner> corners;
+    };
+
+    static const f64 PowersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    static bool IsDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    static bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    static const char* SkipSpaces(const char* s, const char* end)
+    {
+        while (s < end && IsSpace(*s))
+            ++s;
+        return s;
+    }
+
+    // The digits are accumulated as an integer and scaled once at the end:
+    // no locale, no per digit floating point work, and exact for the 6 to 9
+    // significant digits exporters write
+    static const char* ParseFloat(const char* s, const char* end, f32& value)
+    {
+        s = SkipSpaces(s, end);
+
+        bool negative = false;
+        if (s < end && (*s == '-' || *s == '+'))
+            negative = *s++ == '-';
+
+        u64 mantissa = 0;
+        u32 digits = 0;
+        i32 exponent = 0;
+        for (; s < end && IsDigit(*s); ++s)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*s - '0');
+                digits += mantissa > 0 ? 1 : 0;
+            }
+            else
+            {
+                exponent++;
+            }
+        }
+
+        if (s < end && *s == '.')
+        {
+            for (++s; s < end && IsDigit(*s); ++s)
+            {
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (*s - '0');
+                    digits += mantissa > 0 ? 1 : 0;
+                    exponent--;
+                }
+            }
+        }
+
+        if (s < end && (*s == 'e' || *s == 'E'))
+        {
+            ++s;
+            bool negativeExponent = false;
+            if (s < end && (*s == '-' || *s == '+'))
+                negativeExponent = *s++ == '-';
+
+            i32 explicitExponent = 0;
+            for (; s < end && IsDigit(*s); ++s)
+                explicitExponent = std::min(explicitExponent * 10 + (*s - '0'), 1000);
+            exponent += negativeExponent ? -explicitExponent : explicitExponent;
+        }
+
+        f64 result = (f64)mantissa;
+        const i32 magnitude = std::abs(exponent);
+        const f64 scale = magnitude <= 22 ? PowersOfTen[magnitude] : pow(10.0, magnitude);
+        result = exponent < 0 ? result / scale : result * scale;
+
+        value = (f32)(negative ? -result : result);
+        return s;
+    }
+
+    static const char* ParseInt(const char* s, const char* end, i32& value)
+    {
+        bool negative = false;
+        if (s < end && (*s == '-' || *s == '+'))
+            negative = *s++ == '-';
+
+        i32 result = 0;
+        for (; s < end && IsDigit(*s); ++s)
+            result = result * 10 + (*s - '0');
+
+        value = negative ? -result : result;
+        return s;
+    }
+
+    static i32 ResolveIndex(i32 index, u32 localCount, u32 localFlag, u32& localMask)
+    {
+        if (index > 0)
+            return index - 1;
+
+        if (index < 0)
+        {
+            localMask |= localFlag;
+            return (i32)localCount + index;
+        }
+
+        return OBJ_MISSING_INDEX;
+    }
+
+    // v, v/vt, v//vn or v/vt/vn
+    static const char* ParseCorner(const char* s, const char* end, const Chunk& chunk, FaceCorner& corner)
+    {
+        i32 position = 0;
+        i32 texCoord = 0;
+        i32 normal = 0;
+        s = ParseInt(s, end, position);
+        if (s < end && *s == '/')
+        {
+            ++s;
+            if (s < end && *s != '/')
+                s = ParseInt(s, end, texCoord);
+            if (s < end && *s == '/')
+                s = ParseInt(s + 1, end, normal);
+        }
+
+        corner.localMask = 0;
+        corner.position = ResolveIndex(position, chunk.positions.size(), CornerLocal_Position, corner.localMask);
+        corner.texCoord = ResolveIndex(texCoord, chunk.texCoords.size(), CornerLocal_TexCoord, corner.localMask);
+        corner.normal = ResolveIndex(normal, chunk.normals.size(), CornerLocal_Normal, corner.localMask);
+        return s;
+    }
+
+    static bool StartsWith(const char* s, const char* end, const char* keyword)
+    {
+        const u32 length = strlen(keyword);
+        return (u32)(end - s) > length && memcmp(s, keyword, length) == 0 && IsSpace(s[length]);
+    }
+
+    static std::string ParseName(const char* s, const char* end)
+    {
+        s = SkipSpaces(s, end);
+        while (end > s && IsSpace(end[-1]))
+            --end;
+        return std::string(s, end);
+    }
+
+    static void ParseChunk(Chunk& chunk)
+    {
+        std::vector<FaceCorner> polygon;
+        const char* s = chunk.begin;
+        while (s < chunk.end)
+        {
+            const char* lineEnd = (const char*)memchr(s, '\n', chunk.end - s);
+            if (lineEnd == NULL)
+                lineEnd = chunk.end;
+
+            s = SkipSpaces(s, lineEnd);
+            if (StartsWith(s, lineEnd, "v"))
+            {
+                vec3 position;
+                s = ParseFloat(s + 1, lineEnd, position.x);
+                s = ParseFloat(s, lineEnd, position.y);
+                ParseFloat(s, lineEnd, position.z);
+                chunk.positions.push_back(position);
+            }
+            else if (StartsWith(s, lineEnd, "vt"))
+            {
+                vec3 texCoord(0.0f);
+                s = ParseFloat(s + 2, lineEnd, texCoord.x);
+                ParseFloat(s, lineEnd, texCoord.y);
+                chunk.texCoords.push_back(texCoord);
+            }
+            else if (StartsWith(s, lineEnd, "vn"))
+            {
+                vec3 normal;
+                s = ParseFloat(s + 2, lineEnd, normal.x);
+                s = ParseFloat(s, lineEnd, normal.y);
+                ParseFloat(s, lineEnd, normal.z);
+                chunk.normals.push_back(normal);
+            }
+            else if (StartsWith(s, lineEnd, "f"))
+            {
+                polygon.clear();
+                s = SkipSpaces(s + 1, lineEnd);
+                while (s < lineEnd && (IsDigit(*s) || *s == '-'))
+                {
+                    FaceCorner corner;
+                    s = SkipSpaces(ParseCorner(s, lineEnd, chunk, corner), lineEnd);
+                    polygon.push_back(corner);
+                }
+
+                for (u32 i = 1; i + 1 < polygon.size(); ++i)
+                {
+                    chunk.corners.push_back(polygon[0]);
+                    chunk.corners.push_back(polygon[i]);
+                    chunk.corners.push_back(polygon[i + 1]);
+                }
+            }
+            else if (StartsWith(s, lineEnd, "usemtl"))
+            {
+                chunk.materialRuns.push_back({ (u32)chunk.corners.size() / 3, ParseName(s + 6, lineEnd) });
+            }
+            else if (StartsWith(s, lineEnd, "mtllib"))
+            {
+                chunk.materialLibraries.push_back(ParseName(s + 6, lineEnd));
+            }
+
+            s = lineEnd + 1;
+        }
+    }
+
+    static void ParseVec3(const char* s, const char* end, vec3& value)
+    {
+        s = ParseFloat(s, end, value.x);
+        s = ParseFloat(s, end, value.y);
+        ParseFloat(s, end, value.z);
+    }
+
+    // Texture options (-bm 0.5, -clamp on...) come before the file name
+    static std::string ParseTexturePath(const char* s, const char* end, const std::string& directory)
+    {
+        std::string name = ParseName(s, end);
+        const size_t separator = name.find_last_of(" \t");
+        if (separator != std::string::npos)
+            name = name.substr(separator + 1);
+        return directory + "/" + name;
+    }
+
+    static void ReadMaterialLibrary(const std::string& filepath, const std::string& directory, std::vector<MaterialSource>& materials)
+    {
+        AssetFile file = {};
+        if (!AssetPack::OpenAsset(filepath.c_str(), file))
+        {
+            ELOG("Could not open material library %s", filepath.c_str());
+            return;
+        }
+
+        const char* s = (const char*)file.data;
+        const char* end = s + file.size;
+        MaterialSource* material = NULL;
+        while (s < end)
+        {
+            const char* lineEnd = (const char*)memchr(s, '\n', end - s);
+            if (lineEnd == NULL)
+                lineEnd = end;
+
+            s = SkipSpaces(s, lineEnd);
+            if (StartsWith(s, lineEnd, "newmtl"))
+            {
+                // Same defaults as Assimp's OBJ importer
+                materials.push_back(MaterialSource{});
+                material = &materials.back();
+                material->name = ParseName(s + 6, lineEnd);
+                material->albedo = vec3(0.6f);
+            }
+            else if (material != NULL)
+            {
+                if (StartsWith(s, lineEnd, "Kd"))
+                    ParseVec3(s + 2, lineEnd, material->albedo);
+                else if (StartsWith(s, lineEnd, "Ke"))
+                    ParseVec3(s + 2, lineEnd, material->emissive);
+                else if (StartsWith(s, lineEnd, "Ns"))
+                {
+                    f32 shininess = 0.0f;
+                    ParseFloat(s + 2, lineEnd, shininess);
+                    material->smoothness = shininess / 256.0f;
+                }
+                else if (StartsWith(s, lineEnd, "map_Kd"))
+                    material->texturePaths[MaterialTexture_Albedo] = ParseTexturePath(s + 6, lineEnd, directory);
+                else if (StartsWith(s, lineEnd, "map_Ke"))
+                    material->texturePaths[MaterialTexture_Emissive] = ParseTexturePath(s + 6, lineEnd, directory);
+                else if (StartsWith(s, lineEnd, "map_Ks"))
+                    material->texturePaths[MaterialTexture_Specular] = ParseTexturePath(s + 6, lineEnd, directory);
+                else if (StartsWith(s, lineEnd, "norm") || StartsWith(s, lineEnd, "map_Kn"))
+                    material->texturePaths[MaterialTexture_Normals] = ParseTexturePath(s + (s[0] == 'n' ? 4 : 6), lineEnd, directory);
+                else if (StartsWith(s, lineEnd, "map_Bump") || StartsWith(s, lineEnd, "map_bump"))
+                    material->texturePaths[MaterialTexture_Bump] = ParseTexturePath(s + 8, lineEnd, directory);
+                else if (StartsWith(s, lineEnd, "bump"))
+                    material->texturePaths[MaterialTexture_Bump] = ParseTexturePath(s + 4, lineEnd, directory);
+            }
+
+            s = lineEnd + 1;
+        }
+
+        AssetPack::CloseAsset(file);
+    }
+
+    static u32 HashCorner(const FaceCorner& corner)
+    {
+        u32 hash = (u32)corner.position * 0x9E3779B1u;
+        hash ^= (u32)corner.texCoord * 0x85EBCA77u + (hash << 6) + (hash >> 2);
+        hash ^= (u32)corner.normal * 0xC2B2AE3Du + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+
+    // Open addressing table from corner to vertex, every distinct triple becomes a vertex
+    static void WeldCorners(const std::vector<FaceCorner>& corners, std::vector<FaceCorner>& vertices, std::vector<u32>& indices)
+    {
+        u32 capacity = 16;
+        while (capacity < corners.size() * 2)
+            capacity *= 2;
+        std::vector<u32> table(capacity, UINT32_MAX);
+
+        indices.resize(corners.size());
+        for (u32 i = 0; i < corners.size(); ++i)
+        {
+            const FaceCorner& corner = corners[i];
+            u32 slot = HashCorner(corner) & (capacity - 1);
+            while (table[slot] != UINT32_MAX)
+            {
+                const FaceCorner& vertex = vertices[table[slot]];
+                if (vertex.position == corner.position && vertex.texCoord == corner.texCoord && vertex.normal == corner.normal)
+                    break;
+                slot = (slot + 1) & (capacity - 1);
+            }
+
+            if (table[slot] == UINT32_MAX)
+            {
+                table[slot] = vertices.size();
+                vertices.push_back(corner);
+            }
+            indices[i] = table[slot];
+        }
+    }
+
+    // Area weighted face normals summed per OBJ position, so they are smooth across uv seams
+    static void GenerateSmoothNormals(const std::vector<FaceCorner>& vertices, const std::vector<u32>& indices,
+                                      const std::vector<vec3>& positions, std::vector<vec3>& normals)
+    {
+        std::vector<vec3> positionNormals(positions.size(), vec3(0.0f));
+        for (u32 i = 0; i < indices.size(); i += 3)
+        {
+            const i32 p0 = vertices[indices[i]].position;
+            const i32 p1 = vertices[indices[i + 1]].position;
+            const i32 p2 = vertices[indices[i + 2]].position;
+            const vec3 faceNormal = glm::cross(positions[p1] - positions[p0], positions[p2] - positions[p0]);
+            positionNormals[p0] += faceNormal;
+            positionNormals[p1] += faceNormal;
+            positionNormals[p2] += faceNormal;
+        }
+
+        for (u32 v = 0; v < vertices.size(); ++v)
+        {
+            if (vertices[v].normal == OBJ_MISSING_INDEX)
+                normals[v] = positionNormals[vertices[v].position];
+        }
+    }
+
+    // Per face tangents as Assimp computes them (its bitangent points to -v),
+    // summed per vertex and made orthogonal to the normal
+    static void GenerateTangents(const std::vector<u32>& indices, const std::vector<vec3>& positions, const std::vector<vec3>& normals,
+                                 const std::vector<vec3>& texCoords, std::vector<vec3>& tangents, std::vector<vec3>& bitangents)
+    {
+        tangents.assign(positions.size(), vec3(0.0f));
+        bitangents.assign(positions.size(), vec3(0.0f));
+        for (u32 i = 0; i < indices.size(); i += 3)
+        {
+            const u32 i0 = indices[i];
+            const u32 i1 = indices[i + 1];
+            const u32 i2 = indices[i + 2];
+            const vec3 v = positions[i1] - positions[i0];
+            const vec3 w = positions[i2] - positions[i0];
+
+            f32 sx = texCoords[i1].x - texCoords[i0].x;
+            f32 sy = texCoords[i1].y - texCoords[i0].y;
+            f32 tx = texCoords[i2].x - texCoords[i0].x;
+            f32 ty = texCoords[i2].y - texCoords[i0].y;
+            const f32 dirCorrection = (tx * sy - ty * sx) < 0.0f ? -1.0f : 1.0f;
+            if (sx * ty == sy * tx)
+            {
+                // Degenerate mapping, use the default uv directions
+                sx = 0.0f;
+                sy = 1.0f;
+                tx = 1.0f;
+                ty = 0.0f;
+            }
+
+            const vec3 tangent = (w * sy - v * ty) * dirCorrection;
+            const vec3 bitangent = (w * sx - v * tx) * dirCorrection;
+            const f32 tangentLength = glm::length(tangent);
+            const f32 bitangentLength = glm::length(bitangent);
+            for (u32 k = 0; k < 3; ++k)
+            {
+                if (tangentLength > 0.0f)
+                    tangents[indices[i + k]] += tangent / tangentLength;
+                if (bitangentLength > 0.0f)
+                    bitangents[indices[i + k]] += bitangent / bitangentLength;
+            }
+        }
+
+        for (u32 v = 0; v < positions.size(); ++v)
+        {
+            const f32 normalLength = glm::length(normals[v]);
+            const vec3 normal = normalLength > 0.0f ? normals[v] / normalLength : vec3(0.0f, 0.0f, 1.0f);
+            vec3 tangent = tangents[v] - normal * glm::dot(tangents[v], normal);
+            vec3 bitangent = bitangents[v] - normal * glm::dot(bitangents[v], normal);
+            if (glm::dot(tangent, tangent) <= 0.0f)
+                tangent = glm::cross(normal, fabsf(normal.x) < 0.9f ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 1.0f, 0.0f));
+            if (glm::dot(bitangent, bitangent) <= 0.0f)
+                bitangent = -glm::cross(normal, tangent);
+            tangents[v] = glm::normalize(tangent);
+            bitangents[v] = glm::normalize(bitangent);
+        }
+    }
+
+    static void BuildSubMesh(const ObjSubMesh& objSubmesh, const std::vector<vec3>& positions, const std::vector<vec3>& texCoords,
+                             const std::vector<vec3>& normals, u32 vertexQuantization, VertexQuantizationStats& quantizationStats, SubMesh& submesh)
+    {
+        std::vector<FaceCorner> vertices;
+        WeldCorners(objSubmesh.corners, vertices, submesh.indices);
+
+        bool hasTexCoords = false;
+        bool hasAllNormals = true;
+        for (const FaceCorner& vertex : vertices)
+        {
+            hasTexCoords |= vertex.texCoord != OBJ_MISSING_INDEX;
+            hasAllNormals &= vertex.normal != OBJ_MISSING_INDEX;
+        }
+
+        const u32 vertexCount = vertices.size();
+        std::vector<vec3> vertexPositions(vertexCount);
+        std::vector<vec3> vertexNormals(vertexCount, vec3(0.0f));
+        std::vector<vec3> vertexTexCoords(hasTexCoords ? vertexCount : 0, vec3(0.0f));
+        for (u32 v = 0; v < vertexCount; ++v)
+        {
+            const FaceCorner& vertex = vertices[v];
+            vertexPositions[v] = positions[vertex.position];
+            if (vertex.normal != OBJ_MISSING_INDEX)
+                vertexNormals[v] = normals[vertex.normal];
+            if (hasTexCoords && vertex.texCoord != OBJ_MISSING_INDEX)
+                vertexTexCoords[v] = texCoords[vertex.texCoord];
+        }
+
+        if (!hasAllNormals)
+            GenerateSmoothNormals(vertices, submesh.indices, positions, vertexNormals);
+
+        VertexStreams streams = {};
+        streams.vertexCount = vertexCount;
+        streams.positions = vertexPositions.data();
+        streams.normals = vertexNormals.data();
+
+        std::vector<vec3> tangents;
+        std::vector<vec3> bitangents;
+        if (hasTexCoords)
+        {
+            GenerateTangents(submesh.indices, vertexPositions, vertexNormals, vertexTexCoords, tangents, bitangents);
+            streams.texCoords = vertexTexCoords.data();
+            streams.tangents = tangents.data();
+            streams.bitangents = bitangents.data();
+        }
+
+        ModelLoader::BuildSubMeshVertices(streams, vertexQuantization, quantizationStats, submesh);
+    }
+
+    bool IsObjFile(const char* filepath)
+    {
+        const char* extension = strrchr(filepath, '.');
+        return extension != NULL && (strcmp(extension, ".obj") == 0 || strcmp(extension, ".OBJ") == 0);
+    }
+
+    bool ImportObj(ModelImport& import)
+    {
+        const f64 startTime = glfwGetTime();
+        const char* filepath = import.filepath.c_str();
+
+        AssetFile file = {};
+        if (!AssetPack::OpenAsset(filepath, file))
+            return false;
+
+        // Chunk boundaries move forward to the next line start
+        const u32 chunkCount = std::max(1u, (u32)(file.size / OBJ_LOADER_CHUNK_SIZE));
+        const char* fileBegin = (const char*)file.data;
+        const char* fileEnd = fileBegin + file.size;
+        std::vector<Chunk> chunks(chunkCount);
+        for (u32 c = 0; c < chunkCount; ++c)
+        {
+            const char* begin = fileBegin + file.size * c / chunkCount;
+            if (c > 0)
+            {
+                const char* lineEnd = (const char*)memchr(begin, '\n', fileEnd - begin);
+                begin = lineEnd ? lineEnd + 1 : fileEnd;
+            }
+            chunks[c].begin = begin;
+            if (c > 0)
+                chunks[c - 1].end = std::max(begin, chunks[c - 1].begin);
+        }
+        chunks[chunkCount - 1].end = fileEnd;
+
+        JobSystem::ParallelFor(chunkCount, [&](u32 c) { ParseChunk(chunks[c]); });
+        const f64 parseMs = (glfwGetTime() - startTime) * 1000.0;
+
+        // Global element offsets of every chunk
+        std::vector<u32> positionBases(chunkCount);
+        std::vector<u32> texCoordBases(chunkCount);
+        std::vector<u32> normalBases(chunkCount);
+        std::vector<vec3> positions;
+        std::vector<vec3> texCoords;
+        std::vector<vec3> normals;
+        for (u32 c = 0; c < chunkCount; ++c)
+        {
+            positionBases[c] = positions.size();
+            texCoordBases[c] = texCoords.size();
+            normalBases[c] = normals.size();
+            positions.insert(positions.end(), chunks[c].positions.begin(), chunks[c].positions.end());
+            texCoords.insert(texCoords.end(), chunks[c].texCoords.begin(), chunks[c].texCoords.end());
+            normals.insert(normals.end(), chunks[c].normals.begin(), chunks[c].normals.end());
+        }
+
+        // Make every index global, out of range ones drop the attribute (or the triangle, for positions)
+        JobSystem::ParallelFor(chunkCount, [&](u32 c)
+        {
+            for (FaceCorner& corner : chunks[c].corners)
+            {
+                if (corner.localMask & CornerLocal_Position)
+                    corner.position += positionBases[c];
+                if (corner.localMask & CornerLocal_TexCoord)
+                    corner.texCoord += texCoordBases[c];
+                if (corner.localMask & CornerLocal_Normal)
+                    corner.normal += normalBases[c];
+
+                if (corner.position < 0 || corner.position >= (i32)positions.size())
+                    corner.position = OBJ_MISSING_INDEX;
+                if (corner.texCoord < 0 || corner.texCoord >= (i32)texCoords.size())
+                    corner.texCoord = OBJ_MISSING_INDEX;
+                if (corner.normal < 0 || corner.normal >= (i32)normals.size())
+                    corner.normal = OBJ_MISSING_INDEX;
+            }
+        });
+
+        const std::string directory = ModelLoader::GetDirectory(import.filepath);
+        std::vector<MaterialSource> libraryMaterials;
+        for (const Chunk& chunk : chunks)
+        {
+            for (const std::string& library : chunk.materialLibraries)
+            {
+                import.dependencies.push_back(directory + "/" + library);
+                ReadMaterialLibrary(directory + "/" + library, directory, libraryMaterials);
+            }
+        }
+
+        // One submesh per material, in order of first use
+        std::vector<ObjSubMesh> objSubmeshes;
+        std::vector<u32> submeshOfLibraryMaterial(libraryMaterials.size() + 1, UINT32_MAX);
+        u32 currentMaterial = libraryMaterials.size(); // faces before any usemtl use a default material
+        u32 invalidTriangles = 0;
+        for (const Chunk& chunk : chunks)
+        {
+            u32 run = 0;
+            for (u32 t = 0; t < chunk.corners.size() / 3; ++t)
+            {
+                for (; run < chunk.materialRuns.size() && chunk.materialRuns[run].firstTriangle == t; ++run)
+                {
+                    currentMaterial = libraryMaterials.size();
+                    for (u32 m = 0; m < libraryMaterials.size(); ++m)
+                    {
+                        if (libraryMaterials[m].name == chunk.materialRuns[run].name)
+                            currentMaterial = m;
+                    }
+                }
+
+                const FaceCorner* triangle = &chunk.corners[t * 3];
+                if (triangle[0].position == OBJ_MISSING_INDEX || triangle[1].position == OBJ_MISSING_INDEX || triangle[2].position == OBJ_MISSING_INDEX)
+                {
+                    invalidTriangles++;
+                    continue;
+                }
+
+                u32& submeshIdx = submeshOfLibraryMaterial[currentMaterial];
+                if (submeshIdx == UINT32_MAX)
+                {
+                    submeshIdx = objSubmeshes.size();
+                    objSubmeshes.push_back(ObjSubMesh{});
+                    objSubmeshes.back().materialIdx = import.materials.size();
+
+                    MaterialSource defaultMaterial = {};
+                    defaultMaterial.name = "DefaultMaterial";
+                    defaultMaterial.albedo = vec3(0.6f);
+                    import.materials.push_back(currentMaterial < libraryMaterials.size() ? libraryMaterials[currentMaterial] : defaultMaterial);
+                }
+                objSubmeshes[submeshIdx].corners.insert(objSubmeshes[submeshIdx].corners.end(), triangle, triangle + 3);
+            }
+        }
+
+        if (invalidTriangles > 0)
+            ELOG("%s: skipped %u triangles with invalid position indices", filepath, invalidTriangles);
+
+        std::vector<VertexQuantizationStats> submeshStats(objSubmeshes.size(), VertexQuantizationStats{});
+        import.mesh.submeshes.resize(objSubmeshes.size());
+        JobSystem::ParallelFor(objSubmeshes.size(), [&](u32 i)
+        {
+            BuildSubMesh(objSubmeshes[i], positions, texCoords, normals, import.vertexQuantization, submeshStats[i], import.mesh.submeshes[i]);
+        });
+
+        import.quantizationStats = {};
+        for (u32 i = 0; i < objSubmeshes.size(); ++i)
+        {
+            import.submeshMaterialIdx.push_back(objSubmeshes[i].materialIdx);
+
+            VertexQuantizationStats& total = import.quantizationStats;
+            total.rawVertexBytes += submeshStats[i].rawVertexBytes;
+            total.vertexBytes += submeshStats[i].vertexBytes;
+            total.maxPositionError = std::max(total.maxPositionError, submeshStats[i].maxPositionError);
+            total.maxNormalErrorDegrees = std::max(total.maxNormalErrorDegrees, submeshStats[i].maxNormalErrorDegrees);
+            total.maxTexCoordError = std::max(total.maxTexCoordError, submeshStats[i].maxTexCoordError);
+        }
+
+        const f64 totalMs = (glfwGetTime() - startTime) * 1000.0;
+        const f64 megabytes = file.size / (1024.0 * 1024.0);
+        ILOG("Parsed %s (%.2f MB, %u chunks) in %.2f ms, %.2f ms with welding: %.1f MB/s", filepath, megabytes, chunkCount,
+             parseMs, totalMs, megabytes / (totalMs / 1000.0));
+
+        AssetPack::CloseAsset(file);
+        return true;
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef OBJ_LOADER_FUNC
+#define OBJ_LOADER_FUNC
+
+#include "ModelLoadingFunctions.h"
+
+// Native Wavefront .obj/.mtl reader, the format of all the production content,
+// so it skips Assimp and its post-processing. The file is mapped and cut into
+// line aligned chunks parsed in parallel. Faces are fan triangulated, grouped
+// into one submesh per material (like aiProcess_OptimizeMeshes), and their
+// position/uv/normal triples are welded into vertices. Missing normals are
+// smoothed per position and tangents are built from the texture coordinates,
+// following the conventions of Assimp's GenSmoothNormals and CalcTangentSpace.
+#define OBJ_LOADER_CHUNK_SIZE       KB(256)
+#define OBJ_LOADER_BENCHMARK_ASSIMP 0 // also import every .obj through Assimp and log both throughputs
+
+namespace ObjLoader
+{
+    bool IsObjFile(const char* filepath);
+
+    // Fills the submeshes, materials and quantization stats of the import.
+    // Returns false when the file can't be read, the caller falls back to Assimp.
+    bool ImportObj(ModelImport& import);
+}
+
+#endif // !OBJ_LOADER_FUNC
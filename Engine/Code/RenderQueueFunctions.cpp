@@ -0,0 +1,87 @@
+#include "engine.h"
+#include "RenderQueueFunctions.h"
+
+#include <algorithm>
+
+namespace RenderQueue
+{
+    static u64 GetField(u64 key, u32 shift, u32 bits)
+    {
+        return (key >> shift) & ((1ull << bits) - 1);
+    }
+
+    u64 MakeKey(u32 pass, f32 viewDepth, u32 poolIdx, u32 arrayIdx, u32 materialIdx, u32 meshIdx)
+    {
+        const f32 depth = std::min(std::max(viewDepth, 0.0f), RENDER_QUEUE_MAX_DEPTH);
+        const u64 band = std::min((u32)log2f(1.0f + depth), (u32)RENDER_QUEUE_DEPTH_BANDS - 1);
+        const u64 fineDepth = (u64)(depth / RENDER_QUEUE_MAX_DEPTH * (f32)((1 << RENDER_QUEUE_FINE_DEPTH_BITS) - 1));
+
+        return (u64)(pass & 0x3) << 62 |
+               band << 58 |
+               (u64)(poolIdx & 0x3f) << 52 |
+               (u64)(arrayIdx & 0x3f) << 46 |
+               (u64)(materialIdx & 0xffff) << 30 |
+               (u64)(meshIdx & 0xffff) << 14 |
+               fineDepth;
+    }
+
+    RenderQueueItem* PushItems(u32 count)
+    {
+        const u64 address = (u64)PushSize(count * sizeof(RenderQueueItem) + alignof(RenderQueueItem) - 1);
+        return (RenderQueueItem*)((address + alignof(RenderQueueItem) - 1) & ~(u64)(alignof(RenderQueueItem) - 1));
+    }
+
+    void Sort(RenderQueueItem* items, u32 count, RenderQueueItem* scratch)
+    {
+        if (count < 2)
+            return;
+
+        // Every histogram in a single read of the keys
+        u32 histograms[8][256] = {};
+        for (u32 i = 0; i < count; ++i)
+        {
+            const u64 key = items[i].key;
+            for (u32 b = 0; b < 8; ++b)
+                histograms[b][(key >> (b * 8)) & 0xff]++;
+        }
+
+        RenderQueueItem* source = items;
+        RenderQueueItem* destination = scratch;
+        for (u32 b = 0; b < 8; ++b)
+        {
+            u32* histogram = histograms[b];
+            if (histogram[(source[0].key >> (b * 8)) & 0xff] == count)
+                continue; // every key has the same byte
+
+            // Counts to offsets
+            u32 offset = 0;
+            for (u32 i = 0; i < 256; ++i)
+            {
+                const u32 bucketCount = histogram[i];
+                histogram[i] = offset;
+                offset += bucketCount;
+            }
+
+            for (u32 i = 0; i < count; ++i)
+                destination[histogram[(source[i].key >> (b * 8)) & 0xff]++] = source[i];
+            std::swap(source, destination);
+        }
+
+        if (source != items)
+            memcpy(items, source, count * sizeof(RenderQueueItem));
+    }
+
+    void CountStateChanges(const RenderQueueItem* items, u32 count, RenderQueueStateChanges& changes)
+    {
+        changes = {};
+        for (u32 i = 1; i < count; ++i)
+        {
+            const u64 previous = items[i - 1].key;
+            const u64 current = items[i].key;
+            changes.pools += GetField(previous, 52, 6) != GetField(current, 52, 6) ? 1 : 0;
+            changes.arrays += GetField(previous, 46, 6) != GetField(current, 46, 6) ? 1 : 0;
+            changes.materials += GetField(previous, 30, 16) != GetField(current, 30, 16) ? 1 : 0;
+            changes.meshes += GetField(previous, 14, 16) != GetField(current, 14, 16) ? 1 : 0;
+        }
+    }
+}
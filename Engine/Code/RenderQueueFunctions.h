@@ -0,0 +1,65 @@
+#ifndef RENDER_QUEUE_FUNC
+#define RENDER_QUEUE_FUNC
+
+#include "Globals.h"
+
+// Draws are ordered by a 64 bit key, the most significant fields first:
+//
+//   63..62 pass        opaque only for now, the program comes with the pass
+//   61..58 depth band  log2 of the view depth, so opaque draws go roughly front to back
+//   57..52 pool        geometry pool, i.e. the VAO
+//   51..46 array       texture array of the albedo
+//   45..30 material
+//   29..14 mesh
+//   13..0  depth       finer depth inside the same state
+//
+// Fields wrap past their width, which only costs ordering, the item value
+// tells what is drawn. Inside a depth band draws sharing state end up next to
+// each other. Items are sorted with an LSD radix sort, 8 bits a pass, on a
+// scratch buffer of the frame arena; the passes where every key has the same
+// byte are skipped, and equal keys keep their order. The caller provides the
+// scratch buffer: the frame arena for small queues, persistent storage for
+// the ones that grow with the scene.
+#define RENDER_PASS_OPAQUE           0
+#define RENDER_QUEUE_MAX_DEPTH       1000.0f // far plane of the camera
+#define RENDER_QUEUE_DEPTH_BANDS     16
+#define RENDER_QUEUE_FINE_DEPTH_BITS 14
+
+struct RenderQueueItem
+{
+    u64 key;
+    u32 value; // index of what is drawn
+};
+
+// Consecutive draws that change each piece of state
+struct RenderQueueStateChanges
+{
+    u32 pools;
+    u32 arrays;
+    u32 materials;
+    u32 meshes;
+};
+
+struct RenderQueueStats
+{
+    u32                     items;
+    RenderQueueStateChanges sorted;
+    RenderQueueStateChanges unsorted; // in the order the draws were built
+    f64                     sortMs;
+};
+
+namespace RenderQueue
+{
+    // viewDepth along the camera forward, from its near side
+    u64 MakeKey(u32 pass, f32 viewDepth, u32 poolIdx, u32 arrayIdx, u32 materialIdx, u32 meshIdx);
+
+    // Stable, scratch holds at least count items
+    void Sort(RenderQueueItem* items, u32 count, RenderQueueItem* scratch);
+
+    void CountStateChanges(const RenderQueueItem* items, u32 count, RenderQueueStateChanges& changes);
+
+    // Allocates from the frame arena, aligned for the items
+    RenderQueueItem* PushItems(u32 count);
+}
+
+#endif // !RENDER_QUEUE_FUNC
@@ -0,0 +1,477 @@
+#include "engine.h"
+#include "SceneFunctions.h"
+#include "ModelLoadingFunctions.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SCENE_BLOB_ALIGNMENT 16
+
+namespace SceneLoader
+{
+    // Views into the text, which is null terminated so strtof can't run past it
+    struct SceneToken
+    {
+        const char* str;
+        u32         len;
+    };
+
+    struct SceneParser
+    {
+        const char* cursor;
+        const char* end;
+        const char* scenePath;
+        u32         line;
+    };
+
+    static bool IsSameToken(SceneToken token, const char* str)
+    {
+        return token.len == strlen(str) && strncmp(token.str, str, token.len) == 0;
+    }
+
+    static bool ParseError(const SceneParser& parser, const char* message)
+    {
+        ELOG("%s(%u): %s", parser.scenePath, parser.line, message);
+        return false;
+    }
+
+    // Skips blanks and comments, stops at the end of the line
+    static void SkipSpaces(SceneParser& parser)
+    {
+        while (parser.cursor < parser.end && (*parser.cursor == ' ' || *parser.cursor == '\t' || *parser.cursor == '\r'))
+            parser.cursor++;
+
+        if (parser.cursor < parser.end && *parser.cursor == '#')
+        {
+            while (parser.cursor < parser.end && *parser.cursor != '\n')
+                parser.cursor++;
+        }
+    }
+
+    static bool IsLineEnd(SceneParser& parser)
+    {
+        SkipSpaces(parser);
+        return parser.cursor == parser.end || *parser.cursor == '\n';
+    }
+
+    static bool ReadToken(SceneParser& parser, SceneToken& token)
+    {
+        if (IsLineEnd(parser))
+            return false;
+
+        token.str = parser.cursor;
+        while (parser.cursor < parser.end && *parser.cursor != ' ' && *parser.cursor != '\t' && *parser.cursor != '\r' && *parser.cursor != '\n')
+            parser.cursor++;
+        token.len = (u32)(parser.cursor - token.str);
+        return true;
+    }
+
+    static bool ReadFloat(SceneParser& parser, f32& value)
+    {
+        if (IsLineEnd(parser))
+            return false; // strtof would skip the newline
+
+        char* numberEnd;
+        value = strtof(parser.cursor, &numberEnd);
+        if (numberEnd == parser.cursor)
+            return false;
+        parser.cursor = numberEnd;
+        return true;
+    }
+
+    static bool ReadVec3(SceneParser& parser, vec3& value)
+    {
+        return ReadFloat(parser, value.x) && ReadFloat(parser, value.y) && ReadFloat(parser, value.z);
+    }
+
+    // Model names of a scene are few, a linear search beats building a table
+    static u32 FindModel(const std::vector<std::string>& modelNames, SceneToken name)
+    {
+        for (u32 i = 0; i < modelNames.size(); ++i)
+        {
+            if (IsSameToken(name, modelNames[i].c_str()))
+                return i;
+        }
+        return UINT32_MAX;
+    }
+
+    static bool ReadModelName(SceneParser& parser, const std::vector<std::string>& modelNames, u32& modelIdx)
+    {
+        SceneToken name;
+        if (!ReadToken(parser, name))
+            return ParseError(parser, "Expected a model name");
+
+        modelIdx = FindModel(modelNames, name);
+        if (modelIdx == UINT32_MAX)
+            return ParseError(parser, "Unknown model, it must be declared by a model line before");
+        return true;
+    }
+
+    static bool ParseResidency(SceneToken token, u32& residency)
+    {
+        if (IsSameToken(token, "drop"))
+            residency = GeometryResidency_Drop;
+        else if (IsSameToken(token, "positions"))
+            residency = GeometryResidency_PositionsOnly;
+        else if (IsSameToken(token, "keep"))
+            residency = GeometryResidency_Keep;
+        else
+            return false;
+        return true;
+    }
+
+    // Light visuals are entities, placed the way UpdateEntityBuffer moves them every frame
+    static u32 AddLightVisual(std::vector<Entity>& entities, u32 modelIdx, vec3 position)
+    {
+        Entity visual = {};
+        visual.worldMatrix = glm::scale(glm::translate(position), vec3(0.15f));
+        visual.modelIndex = modelIdx;
+        entities.push_back(visual);
+        return entities.size() - 1;
+    }
+
+    static bool ValidateCompiledScene(CompiledScene& scene)
+    {
+        const AssetFile& file = scene.file;
+        if (file.size < sizeof(SceneHeader))
+            return false;
+
+        const SceneHeader& header = *(const SceneHeader*)file.data;
+        if (header.magic != SCENE_MAGIC || header.version != SCENE_VERSION)
+            return false;
+
+        // Records are App structs as is, a build where they differ must recompile
+        if (header.entitySize != sizeof(Entity) || header.lightSize != sizeof(Light))
+            return false;
+
+        if (header.modelsOffset + (u64)header.modelCount * sizeof(SceneModel) > file.size ||
+            header.entitiesOffset + (u64)header.entityCount * sizeof(Entity) > file.size ||
+            header.lightsOffset + (u64)header.lightCount * sizeof(Light) > file.size ||
+            header.pathsOffset + header.pathsSize > file.size)
+            return false;
+
+        scene.header = &header;
+        scene.models = (const SceneModel*)(file.data + header.modelsOffset);
+        scene.entities = (const Entity*)(file.data + header.entitiesOffset);
+        scene.lights = (const Light*)(file.data + header.lightsOffset);
+        scene.paths = (const char*)(file.data + header.pathsOffset);
+
+        if (header.pathsSize == 0 || scene.paths[header.pathsSize - 1] != '\0')
+            return false;
+        for (u32 i = 0; i < header.modelCount; ++i)
+        {
+            if (scene.models[i].pathOffset >= header.pathsSize)
+                return false;
+        }
+
+        // InstantiateScene indexes the models and the light visuals with these
+        for (u32 i = 0; i < header.entityCount; ++i)
+        {
+            if (scene.entities[i].modelIndex >= header.modelCount)
+                return false;
+        }
+        for (u32 i = 0; i < header.lightCount; ++i)
+        {
+            if (scene.lights[i].visualRef < 0 || (u32)scene.lights[i].visualRef >= header.entityCount)
+                return false;
+        }
+        return true;
+    }
+
+    std::string GetCompiledPath(const char* scenePath)
+    {
+        return std::string(scenePath) + SCENE_EXTENSION;
+    }
+
+    bool CompileScene(const char* scenePath, const char* text, u64 size, std::vector<u8>& compiled)
+    {
+        const std::string source(text, size);
+
+        SceneParser parser = {};
+        parser.cursor = source.c_str();
+        parser.end = source.c_str() + source.size();
+        parser.scenePath = scenePath;
+        parser.line = 1;
+
+        std::vector<std::string> modelNames;
+        std::vector<SceneModel> models;
+        std::string paths;
+        std::vector<Entity> entities;
+        std::vector<Light> lights;
+
+        while (parser.cursor < parser.end)
+        {
+            SceneToken keyword;
+            if (ReadToken(parser, keyword))
+            {
+                if (IsSameToken(keyword, "entity"))
+                {
+                    Entity entity = {};
+                    vec3 position;
+                    if (!ReadModelName(parser, modelNames, entity.modelIndex))
+                        return false;
+                    if (!ReadVec3(parser, position))
+                        return ParseError(parser, "Expected the position of the entity");
+
+                    // One factor scales uniformly
+                    vec3 scale(1.0f);
+                    if (ReadFloat(parser, scale.x))
+                    {
+                        scale.y = scale.z = scale.x;
+                        if (ReadFloat(parser, scale.y) && !ReadFloat(parser, scale.z))
+                            return ParseError(parser, "Expected one or three scale factors");
+                    }
+
+                    entity.worldMatrix = glm::scale(glm::translate(position), scale);
+                    entities.push_back(entity);
+                }
+                else if (IsSameToken(keyword, "model"))
+                {
+                    SceneToken name;
+                    SceneToken path;
+                    if (!ReadToken(parser, name) || !ReadToken(parser, path))
+                        return ParseError(parser, "Expected the name and the path of the model");
+                    if (FindModel(modelNames, name) != UINT32_MAX)
+                        return ParseError(parser, "Model name already used");
+
+                    SceneModel model = {};
+                    model.residency = GeometryResidency_Drop;
+                    SceneToken residency;
+                    if (ReadToken(parser, residency) && !ParseResidency(residency, model.residency))
+                        return ParseError(parser, "Expected drop, positions or keep");
+
+                    model.pathOffset = paths.size();
+                    paths.append(path.str, path.len);
+                    paths.push_back('\0');
+                    modelNames.push_back(std::string(name.str, name.len));
+                    models.push_back(model);
+                }
+                else if (IsSameToken(keyword, "directional_light") || IsSameToken(keyword, "point_light"))
+                {
+                    const bool isDirectional = IsSameToken(keyword, "directional_light");
+
+                    Light light = {};
+                    u32 modelIdx;
+                    if (!ReadModelName(parser, modelNames, modelIdx))
+                        return false;
+                    if (!ReadVec3(parser, light.position))
+                        return ParseError(parser, "Expected the position of the light");
+                    if (isDirectional && !ReadVec3(parser, light.direction))
+                        return ParseError(parser, "Expected the direction of the light");
+                    if (!ReadVec3(parser, light.color))
+                        return ParseError(parser, "Expected the color of the light");
+
+                    light.type = isDirectional ? LightType_Directional : LightType_Point;
+                    if (!isDirectional)
+                        light.direction = vec3(1.0f);
+                    light.visualRef = AddLightVisual(entities, modelIdx, light.position);
+                    lights.push_back(light);
+                }
+                else
+                {
+                    return ParseError(parser, "Unknown element, expected model, entity, directional_light or point_light");
+                }
+
+                if (!IsLineEnd(parser))
+                    return ParseError(parser, "Unexpected text at the end of the line");
+            }
+
+            if (parser.cursor < parser.end)
+            {
+                parser.cursor++; // '\n'
+                parser.line++;
+            }
+        }
+
+        if (paths.empty())
+            paths.push_back('\0'); // keeps the paths block valid for scenes without models
+
+        SceneHeader header = {};
+        header.magic = SCENE_MAGIC;
+        header.version = SCENE_VERSION;
+        AssetPack::GetSourceStamp(scenePath, header.source);
+        header.entitySize = sizeof(Entity);
+        header.lightSize = sizeof(Light);
+        header.modelCount = models.size();
+        header.entityCount = entities.size();
+        header.lightCount = lights.size();
+        header.pathsSize = paths.size();
+        header.modelsOffset = sizeof(SceneHeader);
+        header.pathsOffset = header.modelsOffset + models.size() * sizeof(SceneModel);
+        header.entitiesOffset = BufferManager::Align((u32)(header.pathsOffset + header.pathsSize), SCENE_BLOB_ALIGNMENT);
+        header.lightsOffset = BufferManager::Align((u32)(header.entitiesOffset + entities.size() * sizeof(Entity)), SCENE_BLOB_ALIGNMENT);
+
+        compiled.assign(header.lightsOffset + lights.size() * sizeof(Light), 0);
+        memcpy(compiled.data(), &header, sizeof(header));
+        memcpy(compiled.data() + header.modelsOffset, models.data(), models.size() * sizeof(SceneModel));
+        memcpy(compiled.data() + header.pathsOffset, paths.data(), paths.size());
+        memcpy(compiled.data() + header.entitiesOffset, entities.data(), entities.size() * sizeof(Entity));
+        memcpy(compiled.data() + header.lightsOffset, lights.data(), lights.size() * sizeof(Light));
+        return true;
+    }
+
+    // Returns false when the file could not be written, the scene then just compiles again next time
+    static bool WriteCompiledScene(const char* scenePath, const std::vector<u8>& compiled)
+    {
+        const std::string compiledPath = GetCompiledPath(scenePath);
+        FILE* file = fopen(compiledPath.c_str(), "wb");
+        if (!file)
+        {
+            ELOG("fopen() failed writing file %s", compiledPath.c_str());
+            return false;
+        }
+
+        const bool success = fwrite(compiled.data(), 1, compiled.size(), file) == compiled.size();
+        fclose(file);
+
+        if (!success)
+        {
+            ELOG("Could not write compiled scene %s", compiledPath.c_str());
+            remove(compiledPath.c_str());
+        }
+        return success;
+    }
+
+    bool ReadCompiledScene(const char* scenePath, CompiledScene& scene)
+    {
+        const std::string compiledPath = GetCompiledPath(scenePath);
+        if (!AssetPack::OpenAsset(compiledPath.c_str(), scene.file))
+            return false;
+
+        if (!ValidateCompiledScene(scene) || !AssetPack::IsSourceUnchanged(scenePath, scene.header->source))
+        {
+            ILOG("Compiled scene %s is stale, recompiling", compiledPath.c_str());
+            ReleaseCompiledScene(scene);
+            return false;
+        }
+        return true;
+    }
+
+    void ReleaseCompiledScene(CompiledScene& scene)
+    {
+        AssetPack::CloseAsset(scene.file);
+        scene = CompiledScene{};
+    }
+
+    void InstantiateScene(const CompiledScene& scene, const u32* modelIndices, std::vector<Entity>& entities, std::vector<Light>& lights)
+    {
+        const SceneHeader& header = *scene.header;
+
+        const u32 firstEntity = entities.size();
+        entities.resize(firstEntity + header.entityCount);
+        memcpy(entities.data() + firstEntity, scene.entities, header.entityCount * sizeof(Entity));
+        for (u32 i = firstEntity; i < entities.size(); ++i)
+        {
+            ASSERT(entities[i].modelIndex < header.modelCount, "Compiled scene entity references a missing model");
+            entities[i].modelIndex = modelIndices[entities[i].modelIndex];
+        }
+
+        const u32 firstLight = lights.size();
+        lights.resize(firstLight + header.lightCount);
+        memcpy(lights.data() + firstLight, scene.lights, header.lightCount * sizeof(Light));
+        for (u32 i = firstLight; i < lights.size(); ++i)
+            lights[i].visualRef += firstEntity;
+    }
+
+#if SCENE_BENCHMARK_ENTITIES
+    // Times the text and the binary form of a generated grid of entities, its model is never loaded
+    static void BenchmarkScene(u32 entityCount)
+    {
+        const char* scenePath = "SceneBenchmark.scene";
+        const u32 side = (u32)ceil(cbrt((f64)entityCount));
+
+        std::string text = "model cube Assets/Cube.obj\n";
+        char line[128];
+        for (u32 i = 0; i < entityCount; ++i)
+        {
+            snprintf(line, sizeof(line), "entity cube %.2f %.2f %.2f %.3f\n",
+                     (f32)(i % side) * 2.0f, (f32)(i / side % side) * 2.0f, (f32)(i / (side * side)) * 2.0f, 0.5f + (i % 7) * 0.125f);
+            text += line;
+        }
+
+        FILE* file = fopen(scenePath, "wb");
+        if (!file)
+            return;
+        fwrite(text.data(), 1, text.size(), file);
+        fclose(file);
+
+        f64 startTime = glfwGetTime();
+        std::vector<u8> compiled;
+        CompileScene(scenePath, text.data(), text.size(), compiled);
+        const f64 compileMs = (glfwGetTime() - startTime) * 1000.0;
+        WriteCompiledScene(scenePath, compiled);
+
+        startTime = glfwGetTime();
+        CompiledScene scene = {};
+        std::vector<Entity> entities;
+        std::vector<Light> lights;
+        const u32 modelIdx = 0;
+        if (ReadCompiledScene(scenePath, scene))
+        {
+            InstantiateScene(scene, &modelIdx, entities, lights);
+            ReleaseCompiledScene(scene);
+        }
+        const f64 loadMs = (glfwGetTime() - startTime) * 1000.0;
+
+        ILOG("Scene benchmark, %u entities: text (%.2f MB) parsed in %.2f ms, compiled (%.2f MB) mapped and instantiated in %.2f ms",
+             (u32)entities.size(), text.size() / (1024.0 * 1024.0), compileMs, compiled.size() / (1024.0 * 1024.0), loadMs);
+
+        remove(scenePath);
+        remove(GetCompiledPath(scenePath).c_str());
+    }
+#endif
+
+    bool LoadScene(App* app, const char* scenePath)
+    {
+        const f64 startTime = glfwGetTime();
+
+        CompiledScene scene = {};
+        bool fromCompiled = ReadCompiledScene(scenePath, scene);
+        if (!fromCompiled)
+        {
+            AssetFile text = {};
+            if (!AssetPack::OpenAsset(scenePath, text))
+            {
+                ELOG("Could not open scene %s", scenePath);
+                return false;
+            }
+
+            std::vector<u8> compiled;
+            const bool success = CompileScene(scenePath, (const char*)text.data, text.size, compiled);
+            AssetPack::CloseAsset(text);
+            if (!success)
+                return false;
+
+            WriteCompiledScene(scenePath, compiled);
+
+            scene.file.decompressed.swap(compiled);
+            scene.file.data = scene.file.decompressed.data();
+            scene.file.size = scene.file.decompressed.size();
+            if (!ValidateCompiledScene(scene))
+            {
+                ELOG("Compiled scene %s is malformed", scenePath);
+                ReleaseCompiledScene(scene);
+                return false;
+            }
+        }
+
+        const SceneHeader& header = *scene.header;
+        std::vector<u32> modelIndices(header.modelCount);
+        for (u32 i = 0; i < header.modelCount; ++i)
+        {
+            const SceneModel& model = scene.models[i];
+            modelIndices[i] = ModelLoader::LoadModelAsync(app, scene.paths + model.pathOffset, VertexQuantization_Default, (GeometryResidency)model.residency);
+        }
+
+        InstantiateScene(scene, modelIndices.data(), app->entities, app->lights);
+
+        ILOG("Loaded scene %s %s in %.2f ms: %u models, %u entities, %u lights", scenePath, fromCompiled ? "from its compiled form" : "from text",
+             (glfwGetTime() - startTime) * 1000.0, header.modelCount, header.entityCount, header.lightCount);
+        ReleaseCompiledScene(scene);
+
+#if SCENE_BENCHMARK_ENTITIES
+        BenchmarkScene(SCENE_BENCHMARK_ENTITIES);
+#endif
+        return true;
+    }
+}
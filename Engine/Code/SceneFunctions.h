@@ -0,0 +1,83 @@
+#ifndef SCENE_FUNC
+#define SCENE_FUNC
+
+#include "Globals.h"
+#include "AssetPackFunctions.h"
+#include <vector>
+#include <string>
+
+struct App;
+
+// Scenes are described in a text file, one element per line, '#' starts a comment:
+//
+//   model <name> <path> [drop | positions | keep]               CPU geometry residency, drop by default
+//   entity <model> <x y z> [<scale> | <sx sy sz>]
+//   directional_light <model> <x y z> <dx dy dz> <r g b>
+//   point_light <model> <x y z> <r g b>
+//
+// <model> is the name of a model line above it, lights use it for their visual.
+// The text is compiled into <scene>.kscene, rebuilt whenever the text changes,
+// which holds the entities and lights exactly as App stores them. Loading maps
+// it and copies them in bulk, only their model and entity references are
+// offset, so large scenes load without parsing a thing.
+#define SCENE_EXTENSION          ".kscene"
+#define SCENE_MAGIC              0x4e43534b // "KSCN"
+#define SCENE_VERSION            1
+#define SCENE_NAME_LENGTH        64
+#define SCENE_BENCHMARK_ENTITIES 0 // when non zero, LoadScene also times a generated scene of that many entities
+
+struct SceneHeader
+{
+    u32         magic;
+    u32         version;
+    SourceStamp source;
+    u32         entitySize;     // sizeof(Entity) and sizeof(Light) of the build that compiled it
+    u32         lightSize;
+    u32         modelCount;
+    u32         entityCount;
+    u32         lightCount;
+    u32         pathsSize;
+    u64         modelsOffset;   // SceneModel[modelCount]
+    u64         entitiesOffset; // Entity[entityCount], modelIndex into the scene models
+    u64         lightsOffset;   // Light[lightCount], visualRef into the scene entities
+    u64         pathsOffset;    // null terminated model paths
+};
+
+struct SceneModel
+{
+    u32 pathOffset; // from pathsOffset
+    u32 residency;  // GeometryResidency
+};
+
+// A compiled scene, from its mapped .kscene or just compiled in memory
+struct CompiledScene
+{
+    AssetFile          file;
+    const SceneHeader* header;
+    const SceneModel*  models;
+    const Entity*      entities;
+    const Light*       lights;
+    const char*        paths;
+};
+
+namespace SceneLoader
+{
+    std::string GetCompiledPath(const char* scenePath);
+
+    // Parses the text form into the binary one, stops at the first error and logs its line
+    bool CompileScene(const char* scenePath, const char* text, u64 size, std::vector<u8>& compiled);
+
+    // Maps <scenePath>.kscene if it is up to date with the text
+    bool ReadCompiledScene(const char* scenePath, CompiledScene& scene);
+
+    void ReleaseCompiledScene(CompiledScene& scene);
+
+    // Appends the entities and lights of the scene, modelIndices maps its models to App models
+    void InstantiateScene(const CompiledScene& scene, const u32* modelIndices, std::vector<Entity>& entities, std::vector<Light>& lights);
+
+    // Compiles the scene if needed, requests its models and adds its entities and lights.
+    // The models load in the background like any other LoadModelAsync.
+    bool LoadScene(App* app, const char* scenePath);
+}
+
+#endif // !SCENE_FUNC
@@ -0,0 +1,181 @@
+#include "engine.h"
+#include "TextureArrayFunctions.h"
+
+#include <algorithm>
+
+namespace TextureArrayManager
+{
+    static GLuint CreateStorage(const TextureArray& array, u32 layerCapacity)
+    {
+        GLuint handle;
+        glGenTextures(1, &handle);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, array.levelCount, TextureCompressor::GetGLFormat(array.format), array.width, array.height, layerCapacity);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if (array.format == TextureCompression_BC4)
+        {
+            // Single channel textures are greyscale, not red
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_G, GL_RED);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_B, GL_RED);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return handle;
+    }
+
+    // Doubles the layers, the used ones are copied on the GPU
+    static void Grow(TextureArray& array)
+    {
+        const u32 newCapacity = array.layerCapacity * 2;
+        const GLuint newHandle = CreateStorage(array, newCapacity);
+        for (u32 i = 0; i < array.levelCount; ++i)
+        {
+            const u32 width = std::max(1u, array.width >> i);
+            const u32 height = std::max(1u, array.height >> i);
+            glCopyImageSubData(array.handle, GL_TEXTURE_2D_ARRAY, i, 0, 0, 0,
+                               newHandle, GL_TEXTURE_2D_ARRAY, i, 0, 0, 0,
+                               width, height, array.layerCount);
+        }
+        glDeleteTextures(1, &array.handle);
+        array.handle = newHandle;
+        array.layerCapacity = newCapacity;
+
+        ILOG("Texture array %ux%u grown to %u layers", array.width, array.height, newCapacity);
+    }
+
+    u32 FindOrCreateArray(std::vector<TextureArray>& arrays, TextureCompressionFormat format, u32 width, u32 height, u32 levelCount)
+    {
+        for (u32 i = 0; i < arrays.size(); ++i)
+        {
+            const TextureArray& array = arrays[i];
+            if (array.format == format && array.width == width && array.height == height && array.levelCount == levelCount)
+                return i;
+        }
+
+        TextureArray array = {};
+        array.format = format;
+        array.width = width;
+        array.height = height;
+        array.levelCount = levelCount;
+        for (u32 i = 0; i < levelCount; ++i)
+            array.layerSize += TextureCompressor::GetLevelSize(format, std::max(1u, width >> i), std::max(1u, height >> i));
+        array.layerCapacity = TEXTURE_ARRAY_INITIAL_LAYERS;
+        array.handle = CreateStorage(array, array.layerCapacity);
+
+        arrays.push_back(array);
+        return arrays.size() - 1;
+    }
+
+    u32 AllocateLayer(TextureArray& array)
+    {
+        if (!array.freeLayers.empty())
+        {
+            const u32 layer = array.freeLayers.back();
+            array.freeLayers.pop_back();
+            return layer;
+        }
+
+        if (array.layerCount == array.layerCapacity)
+            Grow(array);
+        return array.layerCount++;
+    }
+
+    void FreeLayer(TextureArray& array, u32 layer)
+    {
+        ASSERT(layer < array.layerCount, "FreeLayer() - Layer out of range");
+        array.freeLayers.push_back(layer);
+    }
+
+    void UploadMipChain(std::vector<TextureArray>& arrays, const MipChain& chain, const u8* pixels, u32 firstLevel, u32& arrayIdx, u32& layer)
+    {
+        const MipLevel& first = chain.levels[firstLevel];
+        arrayIdx = FindOrCreateArray(arrays, TextureCompression_RGBA8, first.width, first.height, chain.levelCount - firstLevel);
+        TextureArray& array = arrays[arrayIdx];
+        layer = AllocateLayer(array);
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.handle);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows are tightly packed
+        for (u32 i = firstLevel; i < chain.levelCount; ++i)
+        {
+            const MipLevel& level = chain.levels[i];
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i - firstLevel, 0, 0, layer, level.width, level.height, 1,
+                            GL_RGBA, GL_UNSIGNED_BYTE, pixels + (level.offset - first.offset));
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    void UploadCompressed(std::vector<TextureArray>& arrays, const CompressedTextureHeader& header, const u8* levelData, u32 firstLevel, u32& arrayIdx, u32& layer)
+    {
+        const TextureCompressionFormat format = (TextureCompressionFormat)header.format;
+        const CompressedTextureLevel& first = header.levels[firstLevel];
+        arrayIdx = FindOrCreateArray(arrays, format, first.width, first.height, header.levelCount - firstLevel);
+        TextureArray& array = arrays[arrayIdx];
+        layer = AllocateLayer(array);
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.handle);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (u32 i = firstLevel; i < header.levelCount; ++i)
+        {
+            const CompressedTextureLevel& level = header.levels[i];
+            const u8* data = levelData + (level.offset - first.offset);
+            if (format == TextureCompression_RGBA8)
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i - firstLevel, 0, 0, layer, level.width, level.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            else
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i - firstLevel, 0, 0, layer, level.width, level.height, 1,
+                                          TextureCompressor::GetGLFormat(format), level.size, data);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    u32 BindArrays(const std::vector<TextureArray>& arrays, GLuint program, GLuint boundHandles[TEXTURE_ARRAY_BOUND_UNITS])
+    {
+        GLint units[TEXTURE_ARRAY_BOUND_UNITS];
+        const u32 count = std::min((u32)arrays.size(), (u32)TEXTURE_ARRAY_BOUND_UNITS);
+        for (u32 i = 0; i < TEXTURE_ARRAY_BOUND_UNITS; ++i)
+        {
+            units[i] = i;
+            boundHandles[i] = i < count ? arrays[i].handle : 0;
+            if (i < count)
+            {
+                glActiveTexture(GL_TEXTURE0 + i);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[i].handle);
+            }
+        }
+        glUniform1iv(glGetUniformLocation(program, "uTextures"), TEXTURE_ARRAY_BOUND_UNITS, units);
+        return count;
+    }
+
+    u32 BindArray(const std::vector<TextureArray>& arrays, u32 arrayIdx, GLuint boundHandles[TEXTURE_ARRAY_BOUND_UNITS], u32& binds)
+    {
+        const u32 unit = arrayIdx % TEXTURE_ARRAY_BOUND_UNITS;
+        const GLuint handle = arrays[arrayIdx].handle;
+        if (boundHandles[unit] != handle)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+            boundHandles[unit] = handle;
+            binds++;
+        }
+        return unit;
+    }
+
+    void GetStats(const std::vector<TextureArray>& arrays, TextureArrayStats& stats)
+    {
+        stats.allocatedBytes = 0;
+        stats.usedBytes = 0;
+        for (const TextureArray& array : arrays)
+        {
+            stats.allocatedBytes += (u64)array.layerCapacity * array.layerSize;
+            stats.usedBytes += (u64)(array.layerCount - array.freeLayers.size()) * array.layerSize;
+        }
+    }
+
+    void Release(std::vector<TextureArray>& arrays)
+    {
+        for (TextureArray& array : arrays)
+            glDeleteTextures(1, &array.handle);
+        arrays.clear();
+    }
+}
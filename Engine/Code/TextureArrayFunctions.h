@@ -0,0 +1,68 @@
+#ifndef TEXTURE_ARRAY_FUNC
+#define TEXTURE_ARRAY_FUNC
+
+#include "Globals.h"
+#include "TextureCompressionFunctions.h"
+#include <vector>
+
+// Material textures live in a few GL_TEXTURE_2D_ARRAY pools, one per format,
+// level 0 size and level count, and a texture is a layer of one of them.
+// Sources are resized to power of two size classes (see MipGenerator), which
+// keeps the number of pools low. The pools are bound once per pass to the
+// units of a sampler array, each draw only passes its (array, layer) pair, so
+// texture binds no longer grow with the number of entities. Arrays grow by
+// doubling their layers and copying the old ones over; freed layers are
+// reused, a streamed texture changing its levels moves to another pool.
+#define TEXTURE_ARRAY_INITIAL_LAYERS 4
+#define TEXTURE_ARRAY_BOUND_UNITS    16 // size of uTextures[] in the shaders, arrays past it share units
+
+struct TextureArray
+{
+    TextureCompressionFormat format;
+    u32                      width;      // of level 0
+    u32                      height;
+    u32                      levelCount;
+    u32                      layerSize;  // bytes of a layer, every level included
+    GLuint                   handle;
+    u32                      layerCapacity;
+    u32                      layerCount; // used so far, including the free ones
+    std::vector<u32>         freeLayers;
+};
+
+struct TextureArrayStats
+{
+    u32 boundArrays;   // units bound by the last pass
+    u32 arrayBinds;    // binds in the last pass, more than boundArrays only past TEXTURE_ARRAY_BOUND_UNITS arrays
+    u64 allocatedBytes;
+    u64 usedBytes;
+};
+
+namespace TextureArrayManager
+{
+    // Pool of the format and size, created on first use
+    u32 FindOrCreateArray(std::vector<TextureArray>& arrays, TextureCompressionFormat format, u32 width, u32 height, u32 levelCount);
+
+    // Returns a free layer of the array, growing it when full
+    u32 AllocateLayer(TextureArray& array);
+
+    void FreeLayer(TextureArray& array, u32 layer);
+
+    // Allocates a layer for the chain from firstLevel on and uploads it. The pixels
+    // start at firstLevel, NULL sources them from the bound pixel unpack buffer.
+    void UploadMipChain(std::vector<TextureArray>& arrays, const MipChain& chain, const u8* pixels, u32 firstLevel, u32& arrayIdx, u32& layer);
+
+    // Same as UploadMipChain for the levels of a .ktex
+    void UploadCompressed(std::vector<TextureArray>& arrays, const CompressedTextureHeader& header, const u8* levelData, u32 firstLevel, u32& arrayIdx, u32& layer);
+
+    // Binds the arrays to the units of the program's uTextures[] sampler array, returns the bound count
+    u32 BindArrays(const std::vector<TextureArray>& arrays, GLuint program, GLuint boundHandles[TEXTURE_ARRAY_BOUND_UNITS]);
+
+    // Unit of uTextures[] holding the array, rebinds it when another array shares the unit
+    u32 BindArray(const std::vector<TextureArray>& arrays, u32 arrayIdx, GLuint boundHandles[TEXTURE_ARRAY_BOUND_UNITS], u32& binds);
+
+    void GetStats(const std::vector<TextureArray>& arrays, TextureArrayStats& stats);
+
+    void Release(std::vector<TextureArray>& arrays);
+}
+
+#endif // !TEXTURE_ARRAY_FUNC
@@ -0,0 +1,556 @@
+#include "TextureCompressionFunctions.h"
+#include "JobSystemFunctions.h"
+#include "ModelLoadingFunctions.h"
+#include "BufferSuppFunctions.h"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace TextureCompressor
+{
+    GLenum GetGLFormat(TextureCompressionFormat format)
+    {
+        switch (format)
+        {
+        case TextureCompression_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case TextureCompression_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case TextureCompression_BC4: return GL_COMPRESSED_RED_RGTC1;
+        case TextureCompression_BC5: return GL_COMPRESSED_RG_RGTC2;
+        case TextureCompression_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        case TextureCompression_RGBA8: return GL_RGBA8;
+        default: ELOG("GetGLFormat() - Unknown compression format"); return 0;
+        }
+    }
+
+    u32 GetBlockBytes(TextureCompressionFormat format)
+    {
+        return (format == TextureCompression_BC1 || format == TextureCompression_BC4) ? 8 : 16;
+    }
+
+    u32 GetLevelSize(TextureCompressionFormat format, u32 width, u32 height)
+    {
+        if (format == TextureCompression_RGBA8)
+            return width * height * 4;
+        return ((width + 3) / 4) * ((height + 3) / 4) * GetBlockBytes(format);
+    }
+
+    TextureUsage GetSlotUsage(u32 slot)
+    {
+        switch (slot)
+        {
+        case MaterialTexture_Albedo:
+        case MaterialTexture_Emissive: return TextureUsage_Color;
+        case MaterialTexture_Normals:  return TextureUsage_Normals;
+        default:                       return TextureUsage_Linear;
+        }
+    }
+
+    const char* GetUsageName(TextureUsage usage)
+    {
+        const char* names[TextureUsage_Count] = { "color", "linear", "normals" };
+        return usage < TextureUsage_Count ? names[usage] : "unknown";
+    }
+
+    TextureCompressionFormat ChooseFormat(i32 nchannels, bool highQuality, TextureUsage usage)
+    {
+        // Normal maps only keep xy, the shader rebuilds z
+        if (usage == TextureUsage_Normals && nchannels >= 2)
+            return TextureCompression_BC5;
+
+        switch (nchannels)
+        {
+        case 1:  return TextureCompression_BC4;
+        case 3:  return highQuality ? TextureCompression_BC7 : TextureCompression_BC1;
+        default: return highQuality ? TextureCompression_BC7 : TextureCompression_BC3;
+        }
+    }
+
+    // Principal axis of the block colors (first channelCount channels), by power iteration
+    static void ComputePrincipalAxis(const u8 rgba[16 * 4], u32 channelCount, f32 mean[4], f32 axis[4])
+    {
+        for (u32 c = 0; c < 4; ++c)
+        {
+            mean[c] = 0.0f;
+            axis[c] = c < channelCount ? 1.0f : 0.0f;
+        }
+
+        for (u32 i = 0; i < 16; ++i)
+            for (u32 c = 0; c < channelCount; ++c)
+                mean[c] += rgba[i * 4 + c] / 16.0f;
+
+        f32 covariance[4][4] = {};
+        for (u32 i = 0; i < 16; ++i)
+            for (u32 a = 0; a < channelCount; ++a)
+                for (u32 b = 0; b < channelCount; ++b)
+                    covariance[a][b] += (rgba[i * 4 + a] - mean[a]) * (rgba[i * 4 + b] - mean[b]);
+
+        for (u32 iteration = 0; iteration < 8; ++iteration)
+        {
+            f32 next[4] = {};
+            f32 length = 0.0f;
+            for (u32 a = 0; a < channelCount; ++a)
+            {
+                for (u32 b = 0; b < channelCount; ++b)
+                    next[a] += covariance[a][b] * axis[b];
+                length += next[a] * next[a];
+            }
+
+            if (length < 1e-6f)
+                break; // flat block, any axis works
+
+            length = sqrtf(length);
+            for (u32 a = 0; a < channelCount; ++a)
+                axis[a] = next[a] / length;
+        }
+    }
+
+    static void ComputeEndpoints(const u8 rgba[16 * 4], u32 channelCount, f32 minEndpoint[4], f32 maxEndpoint[4])
+    {
+        f32 mean[4], axis[4];
+        ComputePrincipalAxis(rgba, channelCount, mean, axis);
+
+        f32 minT = 0.0f, maxT = 0.0f;
+        for (u32 i = 0; i < 16; ++i)
+        {
+            f32 t = 0.0f;
+            for (u32 c = 0; c < channelCount; ++c)
+                t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+
+        for (u32 c = 0; c < 4; ++c)
+        {
+            minEndpoint[c] = glm::clamp(mean[c] + minT * axis[c], 0.0f, 255.0f);
+            maxEndpoint[c] = glm::clamp(mean[c] + maxT * axis[c], 0.0f, 255.0f);
+        }
+    }
+
+    static u16 To565(const f32 color[4])
+    {
+        u32 r = (u32)(color[0] * 31.0f / 255.0f + 0.5f);
+        u32 g = (u32)(color[1] * 63.0f / 255.0f + 0.5f);
+        u32 b = (u32)(color[2] * 31.0f / 255.0f + 0.5f);
+        return (u16)((r << 11) | (g << 5) | b);
+    }
+
+    static void From565(u16 color, i32 rgb[3])
+    {
+        rgb[0] = ((color >> 11) & 31) * 255 / 31;
+        rgb[1] = ((color >> 5) & 63) * 255 / 63;
+        rgb[2] = (color & 31) * 255 / 31;
+    }
+
+    static void WriteU16(u8* output, u16 value)
+    {
+        output[0] = (u8)(value & 0xff);
+        output[1] = (u8)(value >> 8);
+    }
+
+    static void CompressColorBlock(const u8 rgba[16 * 4], u8* output)
+    {
+        f32 minEndpoint[4], maxEndpoint[4];
+        ComputeEndpoints(rgba, 3, minEndpoint, maxEndpoint);
+
+        u16 color0 = To565(maxEndpoint);
+        u16 color1 = To565(minEndpoint);
+        if (color0 < color1)
+            std::swap(color0, color1);
+
+        WriteU16(output + 0, color0);
+        WriteU16(output + 2, color1);
+
+        u32 indices = 0;
+        if (color0 != color1)
+        {
+            // color0 > color1 selects the 4 color mode
+            i32 palette[4][3];
+            From565(color0, palette[0]);
+            From565(color1, palette[1]);
+            for (u32 c = 0; c < 3; ++c)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+
+            for (u32 i = 0; i < 16; ++i)
+            {
+                u32 bestIndex = 0;
+                i32 bestError = INT32_MAX;
+                for (u32 p = 0; p < 4; ++p)
+                {
+                    i32 error = 0;
+                    for (u32 c = 0; c < 3; ++c)
+                    {
+                        i32 delta = rgba[i * 4 + c] - palette[p][c];
+                        error += delta * delta;
+                    }
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        bestIndex = p;
+                    }
+                }
+                indices |= bestIndex << (2 * i);
+            }
+        }
+
+        output[4] = (u8)(indices);
+        output[5] = (u8)(indices >> 8);
+        output[6] = (u8)(indices >> 16);
+        output[7] = (u8)(indices >> 24);
+    }
+
+    static void CompressSingleChannelBlock(const u8 rgba[16 * 4], u32 channel, u8* output)
+    {
+        i32 minValue = 255, maxValue = 0;
+        for (u32 i = 0; i < 16; ++i)
+        {
+            minValue = std::min(minValue, (i32)rgba[i * 4 + channel]);
+            maxValue = std::max(maxValue, (i32)rgba[i * 4 + channel]);
+        }
+
+        // value0 > value1 selects the 8 value mode, equal endpoints decode to value0 everywhere
+        output[0] = (u8)maxValue;
+        output[1] = (u8)minValue;
+
+        i32 palette[8];
+        palette[0] = maxValue;
+        palette[1] = minValue;
+        for (i32 i = 2; i < 8; ++i)
+            palette[i] = ((8 - i) * maxValue + (i - 1) * minValue) / 7;
+
+        u64 indices = 0;
+        if (maxValue != minValue)
+        {
+            for (u32 i = 0; i < 16; ++i)
+            {
+                u32 bestIndex = 0;
+                i32 bestError = INT32_MAX;
+                for (u32 p = 0; p < 8; ++p)
+                {
+                    i32 error = abs(rgba[i * 4 + channel] - palette[p]);
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        bestIndex = p;
+                    }
+                }
+                indices |= (u64)bestIndex << (3 * i);
+            }
+        }
+
+        for (u32 i = 0; i < 6; ++i)
+            output[2 + i] = (u8)(indices >> (8 * i));
+    }
+
+    struct BitWriter
+    {
+        u8* output;
+        u32 bit;
+
+        void Write(u32 value, u32 bitCount)
+        {
+            for (u32 i = 0; i < bitCount; ++i, ++bit)
+                if (value & (1u << i))
+                    output[bit / 8] |= (u8)(1u << (bit % 8));
+        }
+    };
+
+    // Quantizes an endpoint to 7 bits per channel plus a shared p-bit, picking the p-bit with less error
+    static void QuantizeBC7Endpoint(const f32 endpoint[4], u32 quantized[4], u32& pbit)
+    {
+        f32 bestError = FLT_MAX;
+        for (u32 p = 0; p < 2; ++p)
+        {
+            u32 candidate[4];
+            f32 error = 0.0f;
+            for (u32 c = 0; c < 4; ++c)
+            {
+                i32 q = (i32)((endpoint[c] - p) / 2.0f + 0.5f);
+                candidate[c] = (u32)glm::clamp(q, 0, 127);
+                f32 delta = endpoint[c] - (f32)(candidate[c] * 2 + p);
+                error += delta * delta;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pbit = p;
+                memcpy(quantized, candidate, sizeof(candidate));
+            }
+        }
+    }
+
+    // BC7 mode 6: one subset, RGBA 7.7.7.7 endpoints with p-bits and 4-bit indices
+    static void CompressBC7Block(const u8 rgba[16 * 4], u8* output)
+    {
+        static const i32 weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+        f32 endpoints[2][4];
+        ComputeEndpoints(rgba, 4, endpoints[0], endpoints[1]);
+
+        u32 quantized[2][4];
+        u32 pbits[2];
+        QuantizeBC7Endpoint(endpoints[0], quantized[0], pbits[0]);
+        QuantizeBC7Endpoint(endpoints[1], quantized[1], pbits[1]);
+
+        i32 palette[16][4];
+        for (u32 p = 0; p < 16; ++p)
+        {
+            for (u32 c = 0; c < 4; ++c)
+            {
+                i32 e0 = quantized[0][c] * 2 + pbits[0];
+                i32 e1 = quantized[1][c] * 2 + pbits[1];
+                palette[p][c] = ((64 - weights[p]) * e0 + weights[p] * e1 + 32) >> 6;
+            }
+        }
+
+        u32 indices[16];
+        for (u32 i = 0; i < 16; ++i)
+        {
+            i32 bestError = INT32_MAX;
+            for (u32 p = 0; p < 16; ++p)
+            {
+                i32 error = 0;
+                for (u32 c = 0; c < 4; ++c)
+                {
+                    i32 delta = rgba[i * 4 + c] - palette[p][c];
+                    error += delta * delta;
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    indices[i] = p;
+                }
+            }
+        }
+
+        // The anchor index is stored with its top bit implicitly 0
+        if (indices[0] & 8)
+        {
+            std::swap(quantized[0], quantized[1]);
+            std::swap(pbits[0], pbits[1]);
+            for (u32 i = 0; i < 16; ++i)
+                indices[i] = 15 - indices[i];
+        }
+
+        memset(output, 0, 16);
+        BitWriter writer = { output, 0 };
+        writer.Write(1u << 6, 7);
+        for (u32 c = 0; c < 4; ++c)
+        {
+            writer.Write(quantized[0][c], 7);
+            writer.Write(quantized[1][c], 7);
+        }
+        writer.Write(pbits[0], 1);
+        writer.Write(pbits[1], 1);
+        writer.Write(indices[0], 3);
+        for (u32 i = 1; i < 16; ++i)
+            writer.Write(indices[i], 4);
+    }
+
+    void CompressBlock(TextureCompressionFormat format, const u8 rgba[16 * 4], u8* output)
+    {
+        switch (format)
+        {
+        case TextureCompression_BC1:
+            CompressColorBlock(rgba, output);
+            break;
+        case TextureCompression_BC3:
+            CompressSingleChannelBlock(rgba, 3, output);
+            CompressColorBlock(rgba, output + 8);
+            break;
+        case TextureCompression_BC4:
+            CompressSingleChannelBlock(rgba, 0, output);
+            break;
+        case TextureCompression_BC5:
+            CompressSingleChannelBlock(rgba, 0, output);
+            CompressSingleChannelBlock(rgba, 1, output + 8);
+            break;
+        case TextureCompression_BC7:
+            CompressBC7Block(rgba, output);
+            break;
+        default:
+            ELOG("CompressBlock() - Unknown compression format");
+        }
+    }
+
+    static void CompressLevel(const u8* rgba, u32 width, u32 height, TextureCompressionFormat format, u8* output)
+    {
+        const u32 blocksX = (width + 3) / 4;
+        const u32 blocksY = (height + 3) / 4;
+        const u32 blockBytes = GetBlockBytes(format);
+
+        JobSystem::ParallelFor(blocksY, [&](u32 by)
+        {
+            u8 block[16 * 4];
+            for (u32 bx = 0; bx < blocksX; ++bx)
+            {
+                // Texels outside the image replicate the edge
+                for (u32 y = 0; y < 4; ++y)
+                {
+                    const u32 sy = std::min(by * 4 + y, height - 1);
+                    for (u32 x = 0; x < 4; ++x)
+                    {
+                        const u32 sx = std::min(bx * 4 + x, width - 1);
+                        memcpy(&block[(y * 4 + x) * 4], &rgba[(sy * width + sx) * 4], 4);
+                    }
+                }
+                CompressBlock(format, block, output + (by * blocksX + bx) * blockBytes);
+            }
+        });
+    }
+
+    void CompressMipChain(const MipChain& chain, TextureCompressionFormat format, const SourceStamp& source, std::vector<u8>& fileData, CompressionStats& stats)
+    {
+        const f64 startTime = glfwGetTime();
+
+        CompressedTextureHeader header = {};
+        header.magic = KTEX_MAGIC;
+        header.version = KTEX_VERSION;
+        header.source = source;
+        header.format = format;
+        header.width = chain.width;
+        header.height = chain.height;
+        header.levelCount = chain.levelCount;
+        header.dataOffset = BufferManager::Align(sizeof(CompressedTextureHeader), 16);
+
+        for (u32 i = 0; i < chain.levelCount; ++i)
+        {
+            CompressedTextureLevel& level = header.levels[i];
+            level.offset = header.dataSize;
+            level.size = GetLevelSize(format, chain.levels[i].width, chain.levels[i].height);
+            level.width = chain.levels[i].width;
+            level.height = chain.levels[i].height;
+            header.dataSize += level.size;
+        }
+
+        fileData.assign(header.dataOffset + header.dataSize, 0);
+        memcpy(fileData.data(), &header, sizeof(header));
+
+        u64 texelCount = 0;
+        for (u32 i = 0; i < header.levelCount; ++i)
+        {
+            const CompressedTextureLevel& level = header.levels[i];
+            const u8* rgba = chain.pixels.data() + chain.levels[i].offset;
+            u8* output = fileData.data() + header.dataOffset + level.offset;
+
+            if (format == TextureCompression_RGBA8)
+                memcpy(output, rgba, level.size);
+            else
+                CompressLevel(rgba, level.width, level.height, format, output);
+
+            texelCount += level.width * level.height;
+        }
+
+        stats.uncompressedBytes = (u32)chain.pixels.size();
+        stats.compressedBytes = header.dataSize;
+        stats.encodeMs = (glfwGetTime() - startTime) * 1000.0;
+        stats.megapixelsPerSecond = stats.encodeMs > 0.0 ? (texelCount / 1.0e6) / (stats.encodeMs / 1000.0) : 0.0;
+    }
+
+    std::string GetCompressedPath(const char* sourcePath)
+    {
+        return std::string(sourcePath) + KTEX_EXTENSION;
+    }
+
+    bool WriteCompressedTexture(const char* sourcePath, const MipChain& chain, TextureCompressionFormat format, CompressionStats& stats)
+    {
+        SourceStamp source = {};
+        if (!AssetPack::GetSourceStamp(sourcePath, source))
+            return false;
+
+        std::vector<u8> fileData;
+        CompressMipChain(chain, format, source, fileData, stats);
+
+        std::string compressedPath = GetCompressedPath(sourcePath);
+        if (!WriteBinaryFile(compressedPath.c_str(), fileData.data(), fileData.size()))
+            return false;
+
+        const char* formatNames[TextureCompression_Count] = { "BC1", "BC3", "BC4", "BC5", "BC7", "RGBA8" };
+        ILOG("Stored %s as %s: %u KB -> %u KB (%.1f%% saved), mips %.2f ms, encode %.2f ms, %.2f MP/s",
+             sourcePath, formatNames[format],
+             stats.uncompressedBytes / 1024, stats.compressedBytes / 1024,
+             100.0 * (1.0 - (f64)stats.compressedBytes / (f64)stats.uncompressedBytes),
+             stats.mipGenerationMs, stats.encodeMs, stats.megapixelsPerSecond);
+        return true;
+    }
+
+    bool CompressTextureFile(const char* sourcePath, bool highQuality, TextureUsage usage, CompressionStats& stats)
+    {
+        Image image = ModelLoader::LoadImage(sourcePath);
+        if (!image.pixels)
+            return false;
+
+        TextureCompressionFormat format = ChooseFormat(image.nchannels, highQuality, usage);
+
+        const f64 startTime = glfwGetTime();
+        MipChain chain;
+        MipGenerator::GenerateMipChain(image, usage == TextureUsage_Color, MIP_DEFAULT_FILTER, chain);
+        ModelLoader::FreeImage(image);
+        stats.mipGenerationMs = (glfwGetTime() - startTime) * 1000.0;
+
+        return WriteCompressedTexture(sourcePath, chain, format, stats);
+    }
+
+    // Levels must be the chain CompressMipChain writes: halving sizes, back to back from
+    // the finest, ending at dataSize, since the streamer uploads a level and the coarser
+    // ones as the single range from its offset to the end of the data
+    static bool IsLayoutValid(const CompressedTextureHeader& header, u64 fileSize)
+    {
+        if (header.format >= TextureCompression_Count ||
+            header.levelCount == 0 || header.levelCount > KTEX_MAX_LEVELS ||
+            header.width == 0 || header.width > KTEX_MAX_SIZE ||
+            header.height == 0 || header.height > KTEX_MAX_SIZE ||
+            (u64)header.dataOffset + header.dataSize > fileSize)
+            return false;
+
+        const TextureCompressionFormat format = (TextureCompressionFormat)header.format;
+        u32 offset = 0;
+        for (u32 i = 0; i < header.levelCount; ++i)
+        {
+            const CompressedTextureLevel& level = header.levels[i];
+            if (level.width != std::max(1u, header.width >> i) ||
+                level.height != std::max(1u, header.height >> i) ||
+                level.size != GetLevelSize(format, level.width, level.height) ||
+                level.offset != offset ||
+                level.size > header.dataSize - offset)
+                return false;
+            offset += level.size;
+        }
+        return offset == header.dataSize;
+    }
+
+    bool ReadCompressedTexture(const char* sourcePath, CompressedTexture& texture)
+    {
+        std::string compressedPath = GetCompressedPath(sourcePath);
+        texture = {};
+        if (!AssetPack::OpenAsset(compressedPath.c_str(), texture.file) || texture.file.size < sizeof(CompressedTextureHeader))
+        {
+            ReleaseCompressedTexture(texture);
+            return false;
+        }
+
+        const CompressedTextureHeader* header = (const CompressedTextureHeader*)texture.file.data;
+        bool valid = header->magic == KTEX_MAGIC &&
+                     header->version == KTEX_VERSION &&
+                     IsLayoutValid(*header, texture.file.size) &&
+                     AssetPack::IsSourceUnchanged(sourcePath, header->source);
+
+        if (!valid)
+        {
+            ReleaseCompressedTexture(texture);
+            return false;
+        }
+
+        texture.header = header;
+        texture.data = texture.file.data + header->dataOffset;
+        return true;
+    }
+
+    void ReleaseCompressedTexture(CompressedTexture& texture)
+    {
+        AssetPack::CloseAsset(texture.file);
+        texture = {};
+    }
+}
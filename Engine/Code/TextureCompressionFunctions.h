@@ -0,0 +1,121 @@
+#ifndef TEXTURE_COMPRESSION_FUNC
+#define TEXTURE_COMPRESSION_FUNC
+
+#include "Globals.h"
+#include "platform.h"
+#include "MipChainFunctions.h"
+#include "AssetPackFunctions.h"
+#include <vector>
+
+// S3TC is an extension, glad only exposes the core BC4/BC5/BC7 enums
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// Textures are stored next to their source as <source>.ktex, a KTX-like container
+// holding every mip level ready for glCompressedTexImage2D (or glTexImage2D for
+// chains stored uncompressed), so later loads skip decoding and mip generation.
+#define KTEX_EXTENSION ".ktex"
+#define KTEX_MAGIC     0x5845544b // "KTEX"
+#define KTEX_VERSION   3
+#define KTEX_MAX_LEVELS 16
+#define KTEX_MAX_SIZE   16384 // keeps the size of a level in 32 bits
+
+enum TextureCompressionFormat
+{
+    TextureCompression_BC1, // RGB, 4 bpp
+    TextureCompression_BC3, // RGBA, 8 bpp
+    TextureCompression_BC4, // R, 4 bpp
+    TextureCompression_BC5, // RG, 8 bpp (normal maps)
+    TextureCompression_BC7, // RGBA, 8 bpp, higher quality than BC3
+    TextureCompression_RGBA8, // uncompressed mip chain, 32 bpp
+    TextureCompression_Count
+};
+
+// What a texture holds, which picks its mip filtering and block format
+enum TextureUsage
+{
+    TextureUsage_Color,   // sRGB encoded, filtered in linear space
+    TextureUsage_Linear,  // data filtered as is
+    TextureUsage_Normals, // tangent space normal map, xy kept in BC5
+    TextureUsage_Count
+};
+
+struct CompressedTextureLevel
+{
+    u32 offset; // from the start of the level data
+    u32 size;
+    u32 width;
+    u32 height;
+};
+
+struct CompressedTextureHeader
+{
+    u32                    magic;
+    u32                    version;
+    SourceStamp            source;
+    u32                    format; // TextureCompressionFormat
+    u32                    width;
+    u32                    height;
+    u32                    levelCount;
+    u32                    dataOffset;
+    u32                    dataSize;
+    CompressedTextureLevel levels[KTEX_MAX_LEVELS];
+};
+
+// A .ktex file in memory, levels point into it
+struct CompressedTexture
+{
+    AssetFile                      file;
+    const CompressedTextureHeader* header;
+    const u8*                      data;
+};
+
+struct CompressionStats
+{
+    u32 uncompressedBytes;
+    u32 compressedBytes;
+    f64 mipGenerationMs;
+    f64 encodeMs;
+    f64 megapixelsPerSecond;
+};
+
+namespace TextureCompressor
+{
+    GLenum GetGLFormat(TextureCompressionFormat format);
+
+    u32 GetBlockBytes(TextureCompressionFormat format);
+
+    u32 GetLevelSize(TextureCompressionFormat format, u32 width, u32 height);
+
+    // Usage of a material texture slot (MaterialTextureSlot)
+    TextureUsage GetSlotUsage(u32 slot);
+
+    const char* GetUsageName(TextureUsage usage);
+
+    TextureCompressionFormat ChooseFormat(i32 nchannels, bool highQuality, TextureUsage usage);
+
+    // Compresses one 4x4 block of RGBA8 texels
+    void CompressBlock(TextureCompressionFormat format, const u8 rgba[16 * 4], u8* output);
+
+    // Compresses every level of the mip chain into a .ktex image in memory
+    void CompressMipChain(const MipChain& chain, TextureCompressionFormat format, const SourceStamp& source, std::vector<u8>& fileData, CompressionStats& stats);
+
+    std::string GetCompressedPath(const char* sourcePath);
+
+    // Writes the mip chain of sourcePath to <sourcePath>.ktex. Safe to call from worker threads.
+    bool WriteCompressedTexture(const char* sourcePath, const MipChain& chain, TextureCompressionFormat format, CompressionStats& stats);
+
+    // Decodes the source image, builds its mip chain, compresses it and writes <sourcePath>.ktex
+    bool CompressTextureFile(const char* sourcePath, bool highQuality, TextureUsage usage, CompressionStats& stats);
+
+    // Maps <sourcePath>.ktex if it exists and is up to date with the source
+    bool ReadCompressedTexture(const char* sourcePath, CompressedTexture& texture);
+
+    void ReleaseCompressedTexture(CompressedTexture& texture);
+}
+
+#endif // !TEXTURE_COMPRESSION_FUNC
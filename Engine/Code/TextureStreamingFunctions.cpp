@@ -0,0 +1,703 @@
+#include "engine.h"
+#include "TextureStreamingFunctions.h"
+#include "JobSystemFunctions.h"
+
+#include <algorithm>
+
+namespace TextureStreamer
+{
+    static u32 GetLevelOffset(const StreamedTexture& texture, u32 level)
+    {
+        return texture.compressed.header ? texture.compressed.header->levels[level].offset : texture.mips.levels[level].offset;
+    }
+
+    // Levels are stored back to back from the finest, so a level and the coarser ones are a single range
+    static u32 GetLevelsSize(const StreamedTexture& texture, u32 firstLevel)
+    {
+        const u32 dataSize = texture.compressed.header ? texture.compressed.header->dataSize : (u32)texture.mips.pixels.size();
+        return dataSize - GetLevelOffset(texture, firstLevel);
+    }
+
+    static const u8* GetLevelData(const StreamedTexture& texture, u32 firstLevel)
+    {
+        const u8* data = texture.compressed.header ? texture.compressed.data : texture.mips.pixels.data();
+        return data + GetLevelOffset(texture, firstLevel);
+    }
+
+    // Format, size and level count of the decoded source, whatever it is
+    static void DescribeSource(const StreamedTexture& texture, u32 description[4])
+    {
+        if (texture.compressed.header)
+        {
+            const CompressedTextureHeader& header = *texture.compressed.header;
+            description[0] = header.format;
+            description[1] = header.width;
+            description[2] = header.height;
+            description[3] = header.levelCount;
+        }
+        else
+        {
+            description[0] = TextureCompression_RGBA8;
+            description[1] = texture.mips.width;
+            description[2] = texture.mips.height;
+            description[3] = texture.mips.levelCount;
+        }
+    }
+
+    // Returns false when the decode failed
+    static bool InitLevels(StreamedTexture& texture)
+    {
+        u32 description[4];
+        DescribeSource(texture, description);
+        texture.width = description[1];
+        texture.height = description[2];
+        texture.levelCount = description[3];
+        if (texture.levelCount == 0)
+            return false;
+
+        texture.minLevel = texture.levelCount - 1;
+        for (u32 i = 0; i < texture.levelCount; ++i)
+        {
+            if (std::max(texture.width >> i, texture.height >> i) <= TEXTURE_STREAMING_MIN_SIZE)
+            {
+                texture.minLevel = i;
+                break;
+            }
+        }
+        texture.requestedLevel = texture.minLevel;
+        return true;
+    }
+
+    // Reads the source only, so the decode job can call it
+    static u64 HashContent(const StreamedTexture& texture)
+    {
+        u32 description[4];
+        DescribeSource(texture, description);
+        const u64 hash = HashBytes(description, sizeof(description));
+        return HashBytes(GetLevelData(texture, 0), GetLevelsSize(texture, 0), hash);
+    }
+
+    static bool IsSameContent(const StreamedTexture& a, const StreamedTexture& b)
+    {
+        u32 descriptionA[4];
+        u32 descriptionB[4];
+        DescribeSource(a, descriptionA);
+        DescribeSource(b, descriptionB);
+        if (memcmp(descriptionA, descriptionB, sizeof(descriptionA)) != 0)
+            return false;
+        const u32 size = GetLevelsSize(a, 0);
+        return size == GetLevelsSize(b, 0) && memcmp(GetLevelData(a, 0), GetLevelData(b, 0), size) == 0;
+    }
+
+    static void DecodeTexture(StreamedTexture* texture, TextureUpload* upload, const std::string& path, TextureUsage usage)
+    {
+        if (TextureCompressor::ReadCompressedTexture(path.c_str(), texture->compressed))
+        {
+            texture->contentHash = HashContent(*texture);
+            return;
+        }
+
+        Image image = ModelLoader::LoadImage(path.c_str());
+        if (!image.pixels)
+            return;
+
+        const f64 startTime = glfwGetTime();
+        MipGenerator::GenerateMipChain(image, usage == TextureUsage_Color, MIP_DEFAULT_FILTER, texture->mips);
+        ModelLoader::FreeImage(image);
+        upload->mipGenerationMs = (glfwGetTime() - startTime) * 1000.0;
+
+        texture->contentHash = HashContent(*texture);
+
+#if TEXTURE_COMPRESS_SOURCES_IN_BACKGROUND
+        // Compresses a copy of the chain, the streamer may drop its own before the job runs
+        const TextureCompressionFormat format = TextureCompressor::ChooseFormat(image.nchannels, TEXTURE_COMPRESSION_HIGH_QUALITY, usage);
+        const f64 mipGenerationMs = upload->mipGenerationMs;
+        JobSystem::SubmitBackground([path, format, mipGenerationMs, chain = texture->mips]()
+        {
+            CompressionStats stats = {};
+            stats.mipGenerationMs = mipGenerationMs;
+            TextureCompressor::WriteCompressedTexture(path.c_str(), chain, format, stats);
+        });
+#else
+        CompressionStats stats = {};
+        stats.mipGenerationMs = upload->mipGenerationMs;
+        TextureCompressor::WriteCompressedTexture(path.c_str(), texture->mips, TextureCompression_RGBA8, stats);
+#endif
+    }
+
+    static StagingBuffer AcquireStagingBuffer(App* app, u32 size)
+    {
+        for (u32 i = 0; i < app->freeStagingBuffers.size(); ++i)
+        {
+            if (app->freeStagingBuffers[i].capacity >= size)
+            {
+                StagingBuffer staging = app->freeStagingBuffers[i];
+                app->freeStagingBuffers.erase(app->freeStagingBuffers.begin() + i);
+                return staging;
+            }
+        }
+
+        StagingBuffer staging = {};
+        staging.capacity = size;
+        glGenBuffers(1, &staging.handle);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.handle);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return staging;
+    }
+
+    static void ReleaseStagingBuffer(App* app, StagingBuffer staging)
+    {
+        app->freeStagingBuffers.push_back(staging);
+    }
+
+    // levelData is the first level of the upload, NULL to source it from the bound staging buffer
+    static void UploadLevels(App* app, const StreamedTexture& texture, TextureUpload& upload, const u8* levelData)
+    {
+        if (texture.compressed.header)
+            TextureArrayManager::UploadCompressed(app->textureArrays, *texture.compressed.header, levelData, upload.firstLevel, upload.arrayIdx, upload.layer);
+        else
+            TextureArrayManager::UploadMipChain(app->textureArrays, texture.mips, levelData, upload.firstLevel, upload.arrayIdx, upload.layer);
+
+        upload.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        upload.stage = TextureUploadStage_Uploading;
+    }
+
+    // Recreates the texture from firstLevel on, the current one stays bound until the new one is uploaded
+    static void StartUpload(App* app, StreamedTexture& texture, u32 firstLevel)
+    {
+        TextureUpload* upload = new TextureUpload{};
+        upload->texture = &texture;
+        upload->firstLevel = firstLevel;
+        upload->stage = TextureUploadStage_Decoding;
+        texture.uploadLevel = firstLevel;
+
+        app->textureUploads.push_back(upload);
+    }
+
+    u32 RequestTexture2D(App* app, const char* filepath, TextureUsage usage)
+    {
+        u32 texIdx = ModelLoader::FindTexture2D(app, filepath);
+        if (texIdx != UINT32_MAX)
+            return texIdx;
+
+        Texture tex = {};
+        tex.arrayIdx = app->textures[app->whiteTexIdx].arrayIdx;
+        tex.layer = app->textures[app->whiteTexIdx].layer;
+        tex.filepath = filepath;
+        tex.state = TextureState_Loading;
+        tex.streamIdx = app->streamedTextures.size();
+
+        texIdx = app->textures.size();
+        app->textures.push_back(tex);
+
+        AssetId id = AssetRegistryManager::MakeAssetId(AssetType_Texture, filepath);
+        AssetRegistryManager::Insert(app->assets, id, texIdx, filepath);
+
+        // Heap allocated so the decode job can write into them while the lists grow
+        StreamedTexture* texture = new StreamedTexture{};
+        texture->texIdx = texIdx;
+        texture->arrayIdx = UINT32_MAX;
+        app->streamedTextures.push_back(texture);
+
+        StartUpload(app, *texture, 0); // the first level is known once decoded
+        TextureUpload* upload = app->textureUploads.back();
+
+        std::string path = filepath;
+        upload->job = JobSystem::Submit([texture, upload, path, usage]() { DecodeTexture(texture, upload, path, usage); });
+
+        app->textureInitialLoads++;
+        return texIdx;
+    }
+
+    // Streamed textures of the material slots, NULL for the others
+    static void GetMaterialTextures(const App* app, const Material& material, StreamedTexture* textures[MaterialTexture_Count])
+    {
+        const u32 textureIndices[MaterialTexture_Count] = {
+            material.albedoTextureIdx,
+            material.emissiveTextureIdx,
+            material.specularTextureIdx,
+            material.normalsTextureIdx,
+            material.bumpTextureIdx
+        };
+
+        for (u32 slot = 0; slot < MaterialTexture_Count; ++slot)
+        {
+            const Texture& tex = app->textures[textureIndices[slot]];
+            textures[slot] = tex.streamIdx != UINT32_MAX ? app->streamedTextures[tex.streamIdx] : NULL;
+        }
+    }
+
+    vec2 GetFeedbackTextureSize(const App* app, const Material& material)
+    {
+        StreamedTexture* textures[MaterialTexture_Count];
+        GetMaterialTextures(app, material, textures);
+
+        u32 width = 0;
+        u32 height = 0;
+        for (const StreamedTexture* texture : textures)
+        {
+            if (texture)
+            {
+                width = std::max(width, texture->width);
+                height = std::max(height, texture->height);
+            }
+        }
+        return vec2((f32)width, (f32)height);
+    }
+
+    static bool IsJobDone(std::future<void>& job)
+    {
+        return job.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    static void FinishInitialLoad(App* app)
+    {
+        if (--app->textureInitialLoads == 0)
+            ILOG("All textures resident %.2f ms after startup", (glfwGetTime() - app->startupTime) * 1000.0);
+    }
+
+    // Returns true when another texture has the same content, the duplicate then releases its source
+    static bool MergeDuplicate(App* app, StreamedTexture& texture)
+    {
+        const u32 texIdx = AssetRegistryManager::FindContent(app->assets, AssetType_TextureContent, texture.contentHash);
+        if (texIdx == UINT32_MAX || !IsSameContent(*app->streamedTextures[app->textures[texIdx].streamIdx], texture))
+        {
+            AssetRegistryManager::InsertContent(app->assets, AssetType_TextureContent, texture.contentHash, texture.texIdx);
+            return false;
+        }
+
+        const u32 savedBytes = GetLevelsSize(texture, 0);
+        DeduplicationStats& stats = app->deduplicationStats;
+        stats.duplicateTextures++;
+        stats.savedTextureBytes += savedBytes;
+
+        Texture& duplicate = app->textures[texture.texIdx];
+        ILOG("Texture %s has the same content as %s, %u KB saved", duplicate.filepath.c_str(), app->textures[texIdx].filepath.c_str(), savedBytes / 1024);
+        ModelLoader::MergeTexture(app, texture.texIdx, texIdx);
+
+        duplicate.arrayIdx = app->textures[app->whiteTexIdx].arrayIdx;
+        duplicate.layer = app->textures[app->whiteTexIdx].layer;
+        duplicate.state = TextureState_Duplicate;
+        duplicate.streamIdx = UINT32_MAX;
+
+        TextureCompressor::ReleaseCompressedTexture(texture.compressed);
+        std::vector<u8>().swap(texture.mips.pixels);
+        texture.levelCount = 0; // never streamed
+        texture.uploadLevel = UINT32_MAX;
+        return true;
+    }
+
+    // Returns true once the upload is finished and can be removed
+    static bool AdvanceUpload(App* app, TextureUpload& upload, u32& budget)
+    {
+        StreamedTexture& texture = *upload.texture;
+        Texture& tex = app->textures[texture.texIdx];
+
+        switch (upload.stage)
+        {
+        case TextureUploadStage_Decoding:
+        {
+            // Only the first upload of a texture decodes, later ones reuse its source
+            if (upload.job.valid())
+            {
+                if (!IsJobDone(upload.job))
+                    return false;
+                upload.job.get();
+
+                if (!InitLevels(texture))
+                {
+                    tex.arrayIdx = app->textures[app->magentaTexIdx].arrayIdx;
+                    tex.layer = app->textures[app->magentaTexIdx].layer;
+                    tex.state = TextureState_Failed;
+                    texture.uploadLevel = UINT32_MAX;
+                    FinishInitialLoad(app);
+                    return true;
+                }
+
+                if (MergeDuplicate(app, texture))
+                {
+                    FinishInitialLoad(app);
+                    return true;
+                }
+
+                upload.firstLevel = texture.minLevel;
+                texture.uploadLevel = texture.minLevel;
+            }
+
+            const u32 uploadSize = GetLevelsSize(texture, upload.firstLevel);
+            if (uploadSize > budget && budget < TEXTURE_UPLOAD_BUDGET_PER_FRAME)
+                return false; // wait for the next frame, unless nothing has been staged yet
+            budget -= std::min(budget, uploadSize);
+
+            upload.staging = AcquireStagingBuffer(app, uploadSize);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.staging.handle);
+            upload.mappedData = (u8*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, uploadSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            const u8* src = GetLevelData(texture, upload.firstLevel);
+            if (!upload.mappedData)
+            {
+                ELOG("Could not map the staging buffer of %s, uploading it from memory", tex.filepath.c_str());
+                ReleaseStagingBuffer(app, upload.staging);
+                upload.staging = StagingBuffer{};
+                UploadLevels(app, texture, upload, src);
+                return false;
+            }
+
+            u8* dst = upload.mappedData;
+            upload.job = JobSystem::Submit([dst, src, uploadSize]() { memcpy(dst, src, uploadSize); });
+            upload.stage = TextureUploadStage_Copying;
+            return false;
+        }
+        case TextureUploadStage_Copying:
+        {
+            if (!IsJobDone(upload.job))
+                return false;
+            upload.job.get();
+
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.staging.handle);
+            const GLboolean unmapped = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            upload.mappedData = NULL;
+            if (unmapped == GL_FALSE)
+            {
+                // The copy is undefined, stage the levels again
+                ELOG("Staging buffer of %s was lost while mapped, uploading it again", tex.filepath.c_str());
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                ReleaseStagingBuffer(app, upload.staging);
+                upload.staging = StagingBuffer{};
+                upload.stage = TextureUploadStage_Decoding;
+                return false;
+            }
+
+            // Sourcing from the bound PBO makes glTexSubImage3D return without waiting for the copy
+            UploadLevels(app, texture, upload, NULL);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return false;
+        }
+        case TextureUploadStage_Uploading:
+        {
+            GLenum status = glClientWaitSync(upload.fence, 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED)
+                return false;
+
+            glDeleteSync(upload.fence);
+            if (upload.staging.handle != 0)
+                ReleaseStagingBuffer(app, upload.staging);
+
+            if (texture.arrayIdx != UINT32_MAX)
+            {
+                // Draws still in flight are ordered before any upload reusing the layer
+                TextureArrayManager::FreeLayer(app->textureArrays[texture.arrayIdx], texture.layer);
+                if (upload.firstLevel < texture.residentLevel)
+                    app->textureStreamingStats.completedLoads++;
+                else
+                    app->textureStreamingStats.completedEvictions++;
+            }
+            else
+            {
+                app->textureMipGenerationMs += upload.mipGenerationMs;
+                FinishInitialLoad(app);
+            }
+
+            texture.arrayIdx = upload.arrayIdx;
+            texture.layer = upload.layer;
+            texture.residentLevel = upload.firstLevel;
+            texture.residentBytes = GetLevelsSize(texture, upload.firstLevel);
+            texture.uploadLevel = UINT32_MAX;
+
+            tex.arrayIdx = upload.arrayIdx;
+            tex.layer = upload.layer;
+            tex.state = TextureState_Resident;
+            tex.sizeInBytes = texture.residentBytes;
+            return true;
+        }
+        }
+
+        return true;
+    }
+
+    void BeginFeedback(App* app)
+    {
+        TextureFeedback& feedback = app->textureFeedback;
+
+        const u32 materialCount = app->materials.size();
+        if (materialCount > feedback.capacity)
+        {
+            if (feedback.capacity > 0)
+                glDeleteBuffers(TEXTURE_FEEDBACK_LATENCY, feedback.buffers);
+            for (GLsync& fence : feedback.fences)
+            {
+                if (fence)
+                    glDeleteSync(fence);
+                fence = 0;
+            }
+
+            feedback.capacity = std::max(materialCount, feedback.capacity * 2);
+            glGenBuffers(TEXTURE_FEEDBACK_LATENCY, feedback.buffers);
+            for (GLuint buffer : feedback.buffers)
+            {
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, feedback.capacity * sizeof(u32), NULL, GL_DYNAMIC_READ);
+            }
+        }
+
+        if (feedback.capacity == 0)
+            return; // no materials yet
+
+        // A slot whose readback never happened is overwritten, its requests are simply lost
+        const u32 slot = feedback.frame % TEXTURE_FEEDBACK_LATENCY;
+        if (feedback.fences[slot])
+        {
+            glDeleteSync(feedback.fences[slot]);
+            feedback.fences[slot] = 0;
+        }
+
+        // The shaders atomicMin into it, untouched materials read back as UINT32_MAX
+        const u32 clearValue = UINT32_MAX;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, feedback.buffers[slot]);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &clearValue);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TEXTURE_FEEDBACK_BINDING, feedback.buffers[slot]);
+    }
+
+    void EndFeedback(App* app)
+    {
+        TextureFeedback& feedback = app->textureFeedback;
+        if (feedback.capacity == 0)
+            return;
+
+        const u32 slot = feedback.frame % TEXTURE_FEEDBACK_LATENCY;
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TEXTURE_FEEDBACK_BINDING, 0);
+        feedback.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        feedback.frame++;
+    }
+
+    // Reads the slot BeginFeedback is about to reuse, written TEXTURE_FEEDBACK_LATENCY frames ago
+    static void ReadFeedback(App* app)
+    {
+        TextureFeedback& feedback = app->textureFeedback;
+        const u32 slot = feedback.frame % TEXTURE_FEEDBACK_LATENCY;
+        GLsync fence = feedback.fences[slot];
+        if (!fence || glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            return;
+        glDeleteSync(fence);
+        feedback.fences[slot] = 0;
+
+        const u32 materialCount = std::min((u32)app->materials.size(), feedback.capacity);
+        feedback.requestedLevels.resize(materialCount);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, feedback.buffers[slot]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, materialCount * sizeof(u32), feedback.requestedLevels.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        for (u32 i = 0; i < materialCount; ++i)
+        {
+            const u32 level = feedback.requestedLevels[i];
+            if (level == UINT32_MAX)
+                continue; // not drawn, or none of its pixels were sampled
+
+            StreamedTexture* textures[MaterialTexture_Count];
+            GetMaterialTextures(app, app->materials[i], textures);
+            const vec2 feedbackSize = GetFeedbackTextureSize(app, app->materials[i]);
+            const u32 feedbackWidth = (u32)feedbackSize.x;
+            const u32 feedbackHeight = (u32)feedbackSize.y;
+
+            for (StreamedTexture* slotTexture : textures)
+            {
+                if (!slotTexture || slotTexture->levelCount == 0)
+                    continue;
+                StreamedTexture& texture = *slotTexture;
+
+                // Smaller textures of the material need coarser levels, by whole halvings on both axes
+                u32 sizeShift = 0;
+                while ((feedbackWidth >> (sizeShift + 1)) >= texture.width && (feedbackHeight >> (sizeShift + 1)) >= texture.height)
+                    sizeShift++;
+
+                // Materials sharing the texture get the finest of their requests
+                const u32 requestedLevel = std::min(level > sizeShift ? level - sizeShift : 0, texture.minLevel);
+                if (texture.lastSeenFrame != feedback.frame)
+                    texture.requestedLevel = requestedLevel;
+                else
+                    texture.requestedLevel = std::min(texture.requestedLevel, requestedLevel);
+                texture.lastSeenFrame = feedback.frame;
+            }
+        }
+    }
+
+    static bool IsSeen(const App* app, const StreamedTexture& texture)
+    {
+        return app->textureFeedback.frame - texture.lastSeenFrame <= TEXTURE_STREAMING_UNSEEN_FRAMES;
+    }
+
+    // Coarsest level an evicted texture keeps: what it is still asked for, its minimum once unseen
+    static u32 GetEvictionLevel(const App* app, const StreamedTexture& texture)
+    {
+        return IsSeen(app, texture) && texture.requestedLevel > texture.residentLevel ? texture.requestedLevel : texture.minLevel;
+    }
+
+    static bool IsSurplus(const App* app, const StreamedTexture& texture)
+    {
+        return !IsSeen(app, texture) || texture.requestedLevel > texture.residentLevel;
+    }
+
+    // Starts the loads the budget allows, most recently requested first. Textures give back
+    // their levels when the budget runs out, the ones holding levels nobody asks for first,
+    // then the least recently used. Budget accounting counts textures at the size they will
+    // have once their uploads are done.
+    static void StreamLevels(App* app)
+    {
+        u64 committedBytes = 0;
+        std::vector<StreamedTexture*> loads;
+        std::vector<StreamedTexture*> victims;
+        for (StreamedTexture* texture : app->streamedTextures)
+        {
+            if (texture->levelCount == 0)
+                continue; // decoding or failed
+
+            if (texture->uploadLevel != UINT32_MAX)
+            {
+                committedBytes += GetLevelsSize(*texture, texture->uploadLevel);
+                continue;
+            }
+            committedBytes += texture->residentBytes;
+
+            if (IsSeen(app, *texture) && texture->requestedLevel < texture->residentLevel)
+                loads.push_back(texture);
+            else if (texture->residentLevel < texture->minLevel)
+                victims.push_back(texture);
+        }
+
+        std::sort(loads.begin(), loads.end(), [](const StreamedTexture* a, const StreamedTexture* b)
+        {
+            return a->lastSeenFrame > b->lastSeenFrame;
+        });
+        std::sort(victims.begin(), victims.end(), [app](const StreamedTexture* a, const StreamedTexture* b)
+        {
+            const bool surplusA = IsSurplus(app, *a);
+            const bool surplusB = IsSurplus(app, *b);
+            if (surplusA != surplusB)
+                return surplusA;
+            return a->lastSeenFrame < b->lastSeenFrame;
+        });
+
+        const u64 budget = app->textureStreamingBudget;
+        u32 nextVictim = 0;
+        u32 waitingLoads = 0;
+        for (StreamedTexture* load : loads)
+        {
+            const u64 neededBytes = GetLevelsSize(*load, load->requestedLevel) - load->residentBytes;
+            while (committedBytes + neededBytes > budget && nextVictim < victims.size())
+            {
+                StreamedTexture& victim = *victims[nextVictim];
+                if (!IsSurplus(app, victim) && victim.lastSeenFrame >= load->lastSeenFrame)
+                    break; // used as recently as the load
+
+                const u32 level = GetEvictionLevel(app, victim);
+                committedBytes -= victim.residentBytes - GetLevelsSize(victim, level);
+                StartUpload(app, victim, level);
+                nextVictim++;
+            }
+
+            if (committedBytes + neededBytes > budget)
+            {
+                waitingLoads++;
+                continue;
+            }
+            committedBytes += neededBytes;
+            StartUpload(app, *load, load->requestedLevel);
+        }
+
+        // Lowering the budget gives levels back without anything to load
+        while (committedBytes > budget && nextVictim < victims.size())
+        {
+            StreamedTexture& victim = *victims[nextVictim++];
+            const u32 level = GetEvictionLevel(app, victim);
+            committedBytes -= victim.residentBytes - GetLevelsSize(victim, level);
+            StartUpload(app, victim, level);
+        }
+
+        TextureStreamingStats& stats = app->textureStreamingStats;
+        stats.residentBytes = 0;
+        stats.pendingLoads = waitingLoads;
+        stats.pendingEvictions = 0;
+        for (const StreamedTexture* texture : app->streamedTextures)
+        {
+            stats.residentBytes += texture->residentBytes;
+            if (texture->arrayIdx == UINT32_MAX || texture->uploadLevel == UINT32_MAX)
+                continue;
+            if (texture->uploadLevel < texture->residentLevel)
+                stats.pendingLoads++;
+            else
+                stats.pendingEvictions++;
+        }
+    }
+
+    void Update(App* app)
+    {
+        ReadFeedback(app);
+        StreamLevels(app);
+
+        u32 budget = TEXTURE_UPLOAD_BUDGET_PER_FRAME;
+
+        for (u32 i = 0; i < app->textureUploads.size();)
+        {
+            if (AdvanceUpload(app, *app->textureUploads[i], budget))
+            {
+                delete app->textureUploads[i];
+                app->textureUploads.erase(app->textureUploads.begin() + i);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+
+    void Shutdown(App* app)
+    {
+        for (TextureUpload* pendingUpload : app->textureUploads)
+        {
+            TextureUpload& upload = *pendingUpload;
+            if (upload.job.valid())
+                JobSystem::Wait(upload.job);
+
+            if (upload.mappedData)
+            {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.staging.handle);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+
+            if (upload.fence)
+                glDeleteSync(upload.fence);
+
+            if (upload.staging.handle)
+                glDeleteBuffers(1, &upload.staging.handle);
+
+            delete pendingUpload;
+        }
+        app->textureUploads.clear();
+
+        for (StreamedTexture* texture : app->streamedTextures)
+        {
+            TextureCompressor::ReleaseCompressedTexture(texture->compressed);
+            delete texture;
+        }
+        app->streamedTextures.clear();
+
+        for (StagingBuffer& staging : app->freeStagingBuffers)
+            glDeleteBuffers(1, &staging.handle);
+        app->freeStagingBuffers.clear();
+
+        TextureFeedback& feedback = app->textureFeedback;
+        for (GLsync fence : feedback.fences)
+        {
+            if (fence)
+                glDeleteSync(fence);
+        }
+        if (feedback.capacity > 0)
+            glDeleteBuffers(TEXTURE_FEEDBACK_LATENCY, feedback.buffers);
+        feedback = TextureFeedback{};
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef TEXTURE_STREAMING_FUNC
+#define TEXTURE_STREAMING_FUNC
+
+#include "Globals.h"
+#include "TextureCompressionFunctions.h"
+#include <future>
+
+struct App;
+
+// Textures are decoded on the job system and uploaded through pixel unpack
+// buffers, so neither the decode nor the copy blocks the render thread. Until
+// the upload is done the texture points to the layer of a placeholder (white
+// while loading, magenta if the load failed), so it can be drawn at any moment.
+// A staging buffer that can't be mapped falls back to glTexSubImage3D from
+// memory, one lost while mapped is staged again.
+// Up to date <source>.ktex files are preferred over the source image. Otherwise
+// the source is decoded and its mip chain built on the job system, and the
+// chain is persisted: block compressed in the background if enabled, stored
+// uncompressed otherwise, so the next run finds the .ktex.
+//
+// Only the levels up to TEXTURE_STREAMING_MIN_SIZE are uploaded at first. The
+// geometry pass writes the finest level each material needs, from the screen
+// space derivatives of its texture coordinates, into a small shader storage
+// buffer read back a few frames later. The level is measured against the
+// largest streamed texture of the material, every streamed slot gets it,
+// coarser by the size difference. The streamer then moves textures to a
+// layer of the texture array with more or fewer levels: the most recently
+// requested ones are loaded first, and under the memory budget the least
+// recently requested ones drop back to the level they need, or to the minimum
+// once they are no longer seen. The levels come from the mapped .ktex, or from
+// the decoded chain kept in memory.
+//
+// Decoded textures are hashed by content: one with the same levels as a texture
+// already decoded is dropped, and the materials using it move to the other one.
+// Content is compared as uploaded, so a copy only matches once both have been
+// decoded the same way (both from their .ktex, or both from the source image).
+#define TEXTURE_UPLOAD_BUDGET_PER_FRAME        MB(16)
+#define TEXTURE_COMPRESS_SOURCES_IN_BACKGROUND 1
+#define TEXTURE_COMPRESSION_HIGH_QUALITY       false
+#define TEXTURE_STREAMING_DEFAULT_BUDGET       MB(128)
+#define TEXTURE_STREAMING_MIN_SIZE             64  // levels up to this size stay resident
+#define TEXTURE_STREAMING_UNSEEN_FRAMES        60  // frames without feedback before a texture only needs its minimum
+#define TEXTURE_FEEDBACK_LATENCY               3   // frames between a feedback pass and its readback
+#define TEXTURE_FEEDBACK_BINDING               0   // shader storage binding of the requested levels
+
+enum TextureUploadStage
+{
+    TextureUploadStage_Decoding,  // worker: map the .ktex or stbi_load the source and build its mips
+    TextureUploadStage_Copying,   // worker: the uploaded levels -> mapped PBO
+    TextureUploadStage_Uploading, // GPU: PBO -> texture, waiting on the fence
+};
+
+struct StagingBuffer
+{
+    GLuint handle;
+    u32    capacity;
+};
+
+// A texture whose levels are streamed in and out, owns the source of its levels
+struct StreamedTexture
+{
+    u32               texIdx;
+    CompressedTexture compressed;     // mapped .ktex, when there is an up to date one
+    MipChain          mips;           // otherwise the decoded chain, kept in memory
+    u32               levelCount;     // 0 until decoded
+    u32               width;          // of level 0
+    u32               height;
+    u32               minLevel;       // coarsest level streaming starts from
+    u32               arrayIdx;       // UINT32_MAX until the first upload is done
+    u32               layer;
+    u32               residentLevel;  // finest level in the layer
+    u32               residentBytes;
+    u32               requestedLevel; // finest level asked by the feedback
+    u32               lastSeenFrame;  // feedback frame that last asked for it
+    u32               uploadLevel;    // finest level of the upload in flight, UINT32_MAX when none
+    u64               contentHash;    // of the format, size and level data, set by the decode
+};
+
+struct TextureUpload
+{
+    StreamedTexture*   texture;
+    u32                firstLevel; // finest level of the new texture
+    TextureUploadStage stage;
+    f64                mipGenerationMs;
+    std::future<void>  job;
+    StagingBuffer      staging;
+    u8*                mappedData;
+    GLsync             fence;
+    u32                arrayIdx;   // layer the levels are uploaded to
+    u32                layer;
+};
+
+// Ring of per material buffers, TEXTURE_FEEDBACK_LATENCY frames deep so the readback doesn't stall
+struct TextureFeedback
+{
+    GLuint           buffers[TEXTURE_FEEDBACK_LATENCY];
+    GLsync           fences[TEXTURE_FEEDBACK_LATENCY];
+    u32              capacity; // materials per buffer
+    u32              frame;
+    std::vector<u32> requestedLevels;
+};
+
+struct TextureStreamingStats
+{
+    u64 residentBytes;
+    u32 pendingLoads;       // finer levels uploading or waiting for the budget
+    u32 pendingEvictions;   // coarser versions uploading
+    u32 completedLoads;     // since startup
+    u32 completedEvictions;
+};
+
+namespace TextureStreamer
+{
+    // Returns the texture index right away, the pixels are streamed in later
+    u32 RequestTexture2D(App* app, const char* filepath, TextureUsage usage);
+
+    // Per axis largest level 0 size of the streamed textures of the material, whatever is
+    // resident, 0 when none is streamed. The feedback levels are relative to it.
+    vec2 GetFeedbackTextureSize(const App* app, const Material& material);
+
+    // Binds and clears this frame's feedback buffer, before the geometry pass
+    void BeginFeedback(App* app);
+
+    // Fences the feedback buffer, after the geometry pass
+    void EndFeedback(App* app);
+
+    // Reads back the feedback, picks the levels to load or evict and advances
+    // the pending uploads, called once per frame from the render thread
+    void Update(App* app);
+
+    void Shutdown(App* app);
+}
+
+#endif // !TEXTURE_STREAMING_FUNC
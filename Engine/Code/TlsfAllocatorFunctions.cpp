@@ -0,0 +1,353 @@
+#include "TlsfAllocatorFunctions.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Tlsf
+{
+    // Index of the highest set bit, value != 0
+    static u32 FindLastSet(u32 value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse(&index, value);
+        return index;
+#else
+        return 31 - __builtin_clz(value);
+#endif
+    }
+
+    // Index of the lowest set bit, value != 0
+    static u32 FindFirstSet(u32 value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return index;
+#else
+        return __builtin_ctz(value);
+#endif
+    }
+
+    // Size class holding blocks of exactly this size
+    static void MapInsert(u32 size, u32& firstLevel, u32& secondLevel)
+    {
+        if (size < TLSF_SECOND_LEVEL_COUNT)
+        {
+            firstLevel = 0;
+            secondLevel = size;
+        }
+        else
+        {
+            const u32 log2 = FindLastSet(size);
+            firstLevel = log2 - (TLSF_SECOND_LEVEL_LOG2 - 1);
+            secondLevel = (size >> (log2 - TLSF_SECOND_LEVEL_LOG2)) - TLSF_SECOND_LEVEL_COUNT;
+        }
+    }
+
+    // First size class whose every block fits the size, so the search never walks a list
+    static void MapSearch(u32 size, u32& firstLevel, u32& secondLevel)
+    {
+        u64 rounded = size;
+        if (size >= TLSF_SECOND_LEVEL_COUNT)
+            rounded += (1u << (FindLastSet(size) - TLSF_SECOND_LEVEL_LOG2)) - 1;
+        if (rounded > UINT32_MAX)
+            rounded = UINT32_MAX;
+        MapInsert((u32)rounded, firstLevel, secondLevel);
+    }
+
+    static u32 NewBlock(TlsfAllocator& allocator)
+    {
+        if (!allocator.unusedBlocks.empty())
+        {
+            const u32 block = allocator.unusedBlocks.back();
+            allocator.unusedBlocks.pop_back();
+            return block;
+        }
+        allocator.blocks.push_back(TlsfBlock{});
+        return allocator.blocks.size() - 1;
+    }
+
+    static void InsertFreeBlock(TlsfAllocator& allocator, u32 blockIdx)
+    {
+        TlsfBlock& block = allocator.blocks[blockIdx];
+        u32 firstLevel, secondLevel;
+        MapInsert(block.size, firstLevel, secondLevel);
+
+        u32& head = allocator.freeLists[firstLevel][secondLevel];
+        block.isFree = true;
+        block.prevFree = UINT32_MAX;
+        block.nextFree = head;
+        if (head != UINT32_MAX)
+            allocator.blocks[head].prevFree = blockIdx;
+        head = blockIdx;
+
+        allocator.firstLevelBitmap |= 1u << firstLevel;
+        allocator.secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+    }
+
+    static void RemoveFreeBlock(TlsfAllocator& allocator, u32 blockIdx)
+    {
+        TlsfBlock& block = allocator.blocks[blockIdx];
+        u32 firstLevel, secondLevel;
+        MapInsert(block.size, firstLevel, secondLevel);
+
+        if (block.prevFree != UINT32_MAX)
+            allocator.blocks[block.prevFree].nextFree = block.nextFree;
+        else
+            allocator.freeLists[firstLevel][secondLevel] = block.nextFree;
+        if (block.nextFree != UINT32_MAX)
+            allocator.blocks[block.nextFree].prevFree = block.prevFree;
+
+        if (allocator.freeLists[firstLevel][secondLevel] == UINT32_MAX)
+        {
+            allocator.secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+            if (allocator.secondLevelBitmaps[firstLevel] == 0)
+                allocator.firstLevelBitmap &= ~(1u << firstLevel);
+        }
+        block.isFree = false;
+    }
+
+    static u32 FindFreeBlock(const TlsfAllocator& allocator, u32 size)
+    {
+        u32 firstLevel, secondLevel;
+        MapSearch(size, firstLevel, secondLevel);
+        if (firstLevel >= TLSF_FIRST_LEVEL_COUNT)
+            return UINT32_MAX;
+
+        u32 secondLevelMap = allocator.secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+        if (secondLevelMap == 0)
+        {
+            const u32 firstLevelMap = firstLevel + 1 < 32 ? allocator.firstLevelBitmap & (~0u << (firstLevel + 1)) : 0;
+            if (firstLevelMap == 0)
+                return UINT32_MAX;
+
+            firstLevel = FindFirstSet(firstLevelMap);
+            secondLevelMap = allocator.secondLevelBitmaps[firstLevel];
+        }
+        return allocator.freeLists[firstLevel][FindFirstSet(secondLevelMap)];
+    }
+
+    // Unlinks nextIdx, which must follow blockIdx physically, and gives its space to blockIdx
+    static void MergeWithNext(TlsfAllocator& allocator, u32 blockIdx, u32 nextIdx)
+    {
+        TlsfBlock& block = allocator.blocks[blockIdx];
+        const TlsfBlock& next = allocator.blocks[nextIdx];
+        block.size += next.size;
+        block.nextPhysical = next.nextPhysical;
+        if (next.nextPhysical != UINT32_MAX)
+            allocator.blocks[next.nextPhysical].prevPhysical = blockIdx;
+        else
+            allocator.lastBlock = blockIdx;
+        allocator.unusedBlocks.push_back(nextIdx);
+    }
+
+    static void ResetFreeLists(TlsfAllocator& allocator)
+    {
+        allocator.firstLevelBitmap = 0;
+        for (u32 i = 0; i < TLSF_FIRST_LEVEL_COUNT; ++i)
+        {
+            allocator.secondLevelBitmaps[i] = 0;
+            for (u32 j = 0; j < TLSF_SECOND_LEVEL_COUNT; ++j)
+                allocator.freeLists[i][j] = UINT32_MAX;
+        }
+    }
+
+    void Init(TlsfAllocator& allocator, u32 capacity)
+    {
+        ASSERT(capacity > 0, "TLSF allocators need some capacity");
+
+        allocator.blocks.clear();
+        allocator.unusedBlocks.clear();
+        ResetFreeLists(allocator);
+        allocator.capacity = capacity;
+        allocator.usedSize = 0;
+        allocator.allocationCount = 0;
+
+        const u32 blockIdx = NewBlock(allocator);
+        TlsfBlock& block = allocator.blocks[blockIdx];
+        block.offset = 0;
+        block.size = capacity;
+        block.prevPhysical = UINT32_MAX;
+        block.nextPhysical = UINT32_MAX;
+        allocator.lastBlock = blockIdx;
+        InsertFreeBlock(allocator, blockIdx);
+    }
+
+    u32 Allocate(TlsfAllocator& allocator, u32 size)
+    {
+        if (size == 0)
+            size = 1;
+
+        const u32 blockIdx = FindFreeBlock(allocator, size);
+        if (blockIdx == UINT32_MAX)
+            return UINT32_MAX;
+
+        RemoveFreeBlock(allocator, blockIdx);
+
+        // The remainder goes back to the free lists
+        if (allocator.blocks[blockIdx].size > size)
+        {
+            const u32 remainderIdx = NewBlock(allocator); // may reallocate blocks
+            TlsfBlock& block = allocator.blocks[blockIdx];
+            TlsfBlock& remainder = allocator.blocks[remainderIdx];
+            remainder.offset = block.offset + size;
+            remainder.size = block.size - size;
+            remainder.prevPhysical = blockIdx;
+            remainder.nextPhysical = block.nextPhysical;
+            if (block.nextPhysical != UINT32_MAX)
+                allocator.blocks[block.nextPhysical].prevPhysical = remainderIdx;
+            else
+                allocator.lastBlock = remainderIdx;
+            block.nextPhysical = remainderIdx;
+            block.size = size;
+            InsertFreeBlock(allocator, remainderIdx);
+        }
+
+        allocator.usedSize += size;
+        allocator.allocationCount++;
+        return blockIdx;
+    }
+
+    void Free(TlsfAllocator& allocator, u32 allocation)
+    {
+        ASSERT(allocation < allocator.blocks.size() && !allocator.blocks[allocation].isFree, "Freeing an invalid TLSF allocation");
+
+        u32 blockIdx = allocation;
+        allocator.usedSize -= allocator.blocks[blockIdx].size;
+        allocator.allocationCount--;
+
+        const u32 nextIdx = allocator.blocks[blockIdx].nextPhysical;
+        if (nextIdx != UINT32_MAX && allocator.blocks[nextIdx].isFree)
+        {
+            RemoveFreeBlock(allocator, nextIdx);
+            MergeWithNext(allocator, blockIdx, nextIdx);
+        }
+
+        const u32 prevIdx = allocator.blocks[blockIdx].prevPhysical;
+        if (prevIdx != UINT32_MAX && allocator.blocks[prevIdx].isFree)
+        {
+            RemoveFreeBlock(allocator, prevIdx);
+            MergeWithNext(allocator, prevIdx, blockIdx);
+            blockIdx = prevIdx;
+        }
+
+        InsertFreeBlock(allocator, blockIdx);
+    }
+
+    u32 GetOffset(const TlsfAllocator& allocator, u32 allocation)
+    {
+        return allocator.blocks[allocation].offset;
+    }
+
+    void Grow(TlsfAllocator& allocator, u32 newCapacity)
+    {
+        if (newCapacity <= allocator.capacity)
+            return;
+
+        const u32 extraSize = newCapacity - allocator.capacity;
+        allocator.capacity = newCapacity;
+
+        const u32 lastIdx = allocator.lastBlock;
+        if (allocator.blocks[lastIdx].isFree)
+        {
+            RemoveFreeBlock(allocator, lastIdx);
+            allocator.blocks[lastIdx].size += extraSize;
+            InsertFreeBlock(allocator, lastIdx);
+            return;
+        }
+
+        const u32 blockIdx = NewBlock(allocator);
+        TlsfBlock& block = allocator.blocks[blockIdx];
+        TlsfBlock& last = allocator.blocks[lastIdx];
+        block.offset = last.offset + last.size;
+        block.size = extraSize;
+        block.prevPhysical = lastIdx;
+        block.nextPhysical = UINT32_MAX;
+        last.nextPhysical = blockIdx;
+        allocator.lastBlock = blockIdx;
+        InsertFreeBlock(allocator, blockIdx);
+    }
+
+    std::vector<TlsfMove> Defragment(TlsfAllocator& allocator)
+    {
+        std::vector<TlsfMove> moves;
+
+        u32 firstIdx = allocator.lastBlock;
+        while (allocator.blocks[firstIdx].prevPhysical != UINT32_MAX)
+            firstIdx = allocator.blocks[firstIdx].prevPhysical;
+
+        // Relink the allocations next to each other, free blocks are dropped
+        u32 offset = 0;
+        u32 prevIdx = UINT32_MAX;
+        for (u32 blockIdx = firstIdx; blockIdx != UINT32_MAX;)
+        {
+            TlsfBlock& block = allocator.blocks[blockIdx];
+            const u32 nextIdx = block.nextPhysical;
+            if (block.isFree)
+            {
+                allocator.unusedBlocks.push_back(blockIdx);
+            }
+            else
+            {
+                moves.push_back(TlsfMove{ blockIdx, block.offset, offset, block.size });
+
+                block.offset = offset;
+                block.prevPhysical = prevIdx;
+                if (prevIdx != UINT32_MAX)
+                    allocator.blocks[prevIdx].nextPhysical = blockIdx;
+                offset += block.size;
+                prevIdx = blockIdx;
+            }
+            blockIdx = nextIdx;
+        }
+
+        ResetFreeLists(allocator);
+
+        u32 tailIdx = UINT32_MAX;
+        if (offset < allocator.capacity)
+        {
+            tailIdx = NewBlock(allocator);
+            TlsfBlock& tail = allocator.blocks[tailIdx];
+            tail.offset = offset;
+            tail.size = allocator.capacity - offset;
+            tail.prevPhysical = prevIdx;
+            tail.nextPhysical = UINT32_MAX;
+            if (prevIdx != UINT32_MAX)
+                allocator.blocks[prevIdx].nextPhysical = tailIdx;
+            InsertFreeBlock(allocator, tailIdx);
+        }
+
+        if (tailIdx != UINT32_MAX)
+        {
+            allocator.lastBlock = tailIdx;
+        }
+        else
+        {
+            allocator.blocks[prevIdx].nextPhysical = UINT32_MAX;
+            allocator.lastBlock = prevIdx;
+        }
+
+        return moves;
+    }
+
+    TlsfStats GetStats(const TlsfAllocator& allocator)
+    {
+        TlsfStats stats = {};
+        stats.capacity = allocator.capacity;
+        stats.usedSize = allocator.usedSize;
+        stats.allocationCount = allocator.allocationCount;
+
+        for (u32 blockIdx = allocator.lastBlock; blockIdx != UINT32_MAX; blockIdx = allocator.blocks[blockIdx].prevPhysical)
+        {
+            const TlsfBlock& block = allocator.blocks[blockIdx];
+            if (block.isFree)
+            {
+                stats.freeBlockCount++;
+                stats.largestFreeBlock = block.size > stats.largestFreeBlock ? block.size : stats.largestFreeBlock;
+            }
+        }
+        return stats;
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef TLSF_ALLOCATOR_FUNC
+#define TLSF_ALLOCATOR_FUNC
+
+#include "Globals.h"
+#include <vector>
+
+// Two level segregated fit allocator (Masmano et al.) over an abstract range of
+// units, e.g. the vertices or indices of a GL buffer: it hands out offsets and
+// never touches the memory itself. Free blocks are kept in lists by size class,
+// a first level per power of two split into TLSF_SECOND_LEVEL_COUNT linear
+// steps, and two bitmaps find a large enough list in constant time. Freed
+// blocks merge with their free physical neighbours right away.
+#define TLSF_SECOND_LEVEL_LOG2  4
+#define TLSF_SECOND_LEVEL_COUNT (1 << TLSF_SECOND_LEVEL_LOG2)
+#define TLSF_FIRST_LEVEL_COUNT  (32 - TLSF_SECOND_LEVEL_LOG2 + 1)
+
+struct TlsfBlock
+{
+    u32  offset;
+    u32  size;
+    u32  prevPhysical; // UINT32_MAX at the ends of the range
+    u32  nextPhysical;
+    u32  prevFree;     // links of the free list of its size class
+    u32  nextFree;
+    bool isFree;
+};
+
+struct TlsfAllocator
+{
+    std::vector<TlsfBlock> blocks;       // allocations are indices into it and stay valid until freed
+    std::vector<u32>       unusedBlocks; // recycled entries of blocks
+    u32 firstLevelBitmap;
+    u32 secondLevelBitmaps[TLSF_FIRST_LEVEL_COUNT];
+    u32 freeLists[TLSF_FIRST_LEVEL_COUNT][TLSF_SECOND_LEVEL_COUNT];
+    u32 lastBlock; // physically last, the one Grow extends
+    u32 capacity;
+    u32 usedSize;
+    u32 allocationCount;
+};
+
+// Where a block went during Defragment
+struct TlsfMove
+{
+    u32 allocation;
+    u32 srcOffset;
+    u32 dstOffset;
+    u32 size;
+};
+
+struct TlsfStats
+{
+    u32 capacity;
+    u32 usedSize;
+    u32 allocationCount;
+    u32 freeBlockCount;
+    u32 largestFreeBlock;
+};
+
+namespace Tlsf
+{
+    void Init(TlsfAllocator& allocator, u32 capacity);
+
+    // Returns the allocation, or UINT32_MAX when no free block is large enough
+    u32 Allocate(TlsfAllocator& allocator, u32 size);
+
+    void Free(TlsfAllocator& allocator, u32 allocation);
+
+    u32 GetOffset(const TlsfAllocator& allocator, u32 allocation);
+
+    // Appends capacity at the end of the range
+    void Grow(TlsfAllocator& allocator, u32 newCapacity);
+
+    // Packs every allocation at the start of the range, in offset order, leaving a
+    // single free block at the end. Allocations keep their handles; there is one
+    // move per allocation, unmoved ones included, telling where its data goes.
+    std::vector<TlsfMove> Defragment(TlsfAllocator& allocator);
+
+    TlsfStats GetStats(const TlsfAllocator& allocator);
+}
+
+#endif // !TLSF_ALLOCATOR_FUNC
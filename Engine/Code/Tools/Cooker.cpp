@@ -0,0 +1,441 @@
+//
+// Cooker.cpp : Offline import of the asset tree into the runtime formats, so the
+// engine finds every .kmesh and .ktex up to date instead of importing at startup.
+//
+//   Cooker [asset directory] [--force]   run from WorkingDir, the directory defaults to Assets
+//
+// Every model under the directory is cooked to its mesh cache, and every texture
+// its materials reference to a block compressed .ktex. Cook.manifest, written in
+// the asset directory, keeps the content hash of each source and of the files its
+// import read (material libraries), the version of the importer and the output.
+// An asset is only cooked again when one of those changed or its output is gone;
+// the checks hash the sources instead of trusting their timestamps, all in parallel.
+//
+
+#include "../engine.h"
+#include "../ModelLoadingFunctions.h"
+#include "../MeshCacheFunctions.h"
+#include "../TextureCompressionFunctions.h"
+#include "../TextureStreamingFunctions.h"
+#include "../JobSystemFunctions.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+
+#define COOK_MANIFEST_FILENAME "Cook.manifest"
+#define COOK_VERTEX_QUANTIZATION VertexQuantization_Default // the quantization the engine loads its models with
+
+enum CookAssetType
+{
+    CookAsset_Mesh,
+    CookAsset_Texture,
+};
+
+struct CookDependency
+{
+    std::string path;
+    u64         hash;
+};
+
+struct CookTexture
+{
+    std::string  path;
+    TextureUsage usage;
+};
+
+// One asset of the manifest
+struct CookRecord
+{
+    CookAssetType               type;
+    std::string                 path;
+    u64                         version;    // of the importer and its settings
+    u64                         sourceHash;
+    std::string                 output;
+    u64                         outputSize;
+    std::vector<CookDependency> dependencies;
+    std::vector<CookTexture>    textures;   // meshes, referenced by their materials
+};
+
+struct CookJob
+{
+    CookRecord record;
+    bool       cooked;
+    bool       failed;
+};
+
+static const char* ModelExtensions[] = { ".obj", ".fbx", ".dae", ".gltf", ".glb", ".3ds", ".blend", ".ply", ".stl" };
+
+static bool IsModelFile(const std::string& filepath)
+{
+    const size_t dot = filepath.find_last_of('.');
+    if (dot == std::string::npos)
+        return false;
+
+    std::string extension = filepath.substr(dot);
+    for (char& c : extension)
+        c = (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+
+    for (const char* modelExtension : ModelExtensions)
+    {
+        if (extension == modelExtension)
+            return true;
+    }
+    return false;
+}
+
+static u64 GetMeshVersion()
+{
+    return ((u64)MESH_CACHE_VERSION << 32) | COOK_VERTEX_QUANTIZATION;
+}
+
+static u64 GetTextureVersion(TextureUsage usage)
+{
+    return ((u64)KTEX_VERSION << 32) | ((u64)MIP_DEFAULT_FILTER << 16) | ((u64)TEXTURE_COMPRESSION_HIGH_QUALITY << 8) | usage;
+}
+
+static bool HashFile(const char* filepath, u64& hash)
+{
+    MappedFile file = MapFile(filepath);
+    if (file.data == NULL)
+        return false;
+
+    hash = HashBytes(file.data, file.size);
+    UnmapFile(file);
+    return true;
+}
+
+static u64 GetFileBytes(const char* filepath)
+{
+    MappedFile file = MapFile(filepath);
+    const u64 size = file.size;
+    UnmapFile(file);
+    return size;
+}
+
+// Paths run to the end of their line, after the other fields
+static void ReadManifest(const std::string& manifestPath, std::map<std::string, CookRecord>& records)
+{
+    MappedFile file = MapFile(manifestPath.c_str());
+    if (file.data == NULL)
+        return;
+
+    const char* s = (const char*)file.data;
+    const char* end = s + file.size;
+    CookRecord* record = NULL;
+    while (s < end)
+    {
+        const char* lineEnd = (const char*)memchr(s, '\n', end - s);
+        if (lineEnd == NULL)
+            lineEnd = end;
+
+        const std::string line(s, lineEnd > s && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd);
+        s = lineEnd + 1;
+
+        const size_t space = line.find(' ');
+        if (line.empty() || line[0] == '#' || space == std::string::npos)
+            continue;
+
+        const std::string key = line.substr(0, space);
+        const char* value = line.c_str() + space + 1;
+        char* rest = NULL;
+        if (key == "mesh" || key == "texture")
+        {
+            CookRecord& newRecord = records[value];
+            newRecord = {};
+            newRecord.type = key == "mesh" ? CookAsset_Mesh : CookAsset_Texture;
+            newRecord.path = value;
+            record = &newRecord;
+        }
+        else if (record == NULL)
+        {
+            continue;
+        }
+        else if (key == "version")
+        {
+            record->version = strtoull(value, NULL, 16);
+        }
+        else if (key == "source")
+        {
+            record->sourceHash = strtoull(value, NULL, 16);
+        }
+        else if (key == "output")
+        {
+            record->outputSize = strtoull(value, &rest, 10);
+            if (*rest == ' ')
+                record->output = rest + 1;
+        }
+        else if (key == "dependency")
+        {
+            const u64 hash = strtoull(value, &rest, 16);
+            if (*rest == ' ')
+                record->dependencies.push_back(CookDependency{ rest + 1, hash });
+        }
+        else if (key == "uses")
+        {
+            for (u32 usage = 0; usage < TextureUsage_Count; ++usage)
+            {
+                const char* name = TextureCompressor::GetUsageName((TextureUsage)usage);
+                const size_t nameLength = strlen(name);
+                if (strncmp(value, name, nameLength) == 0 && value[nameLength] == ' ')
+                    record->textures.push_back(CookTexture{ value + nameLength + 1, (TextureUsage)usage });
+            }
+        }
+    }
+
+    UnmapFile(file);
+}
+
+static bool WriteManifest(const std::string& manifestPath, const std::vector<const CookRecord*>& records)
+{
+    FILE* file = fopen(manifestPath.c_str(), "wb");
+    if (file == NULL)
+    {
+        ELOG("fopen() failed writing file %s", manifestPath.c_str());
+        return false;
+    }
+
+    fprintf(file, "# Written by the Cooker, one block per cooked asset\n");
+    for (const CookRecord* record : records)
+    {
+        fprintf(file, "%s %s\n", record->type == CookAsset_Mesh ? "mesh" : "texture", record->path.c_str());
+        fprintf(file, "version %016llx\n", (unsigned long long)record->version);
+        fprintf(file, "source %016llx\n", (unsigned long long)record->sourceHash);
+        fprintf(file, "output %llu %s\n", (unsigned long long)record->outputSize, record->output.c_str());
+        for (const CookDependency& dependency : record->dependencies)
+            fprintf(file, "dependency %016llx %s\n", (unsigned long long)dependency.hash, dependency.path.c_str());
+        for (const CookTexture& texture : record->textures)
+            fprintf(file, "uses %s %s\n", TextureCompressor::GetUsageName(texture.usage), texture.path.c_str());
+    }
+
+    return fclose(file) == 0;
+}
+
+// Same version and source, same dependencies and the output still there
+static bool IsUpToDate(const CookRecord& current, const std::map<std::string, CookRecord>& records, bool force)
+{
+    std::map<std::string, CookRecord>::const_iterator it = records.find(current.path);
+    if (force || it == records.end())
+        return false;
+
+    const CookRecord& previous = it->second;
+    if (previous.type != current.type || previous.version != current.version || previous.sourceHash != current.sourceHash)
+        return false;
+
+    for (const CookDependency& dependency : previous.dependencies)
+    {
+        u64 hash;
+        if (!HashFile(dependency.path.c_str(), hash) || hash != dependency.hash)
+            return false;
+    }
+
+    return GetFileBytes(previous.output.c_str()) == previous.outputSize;
+}
+
+static void CookMesh(CookJob& job, const std::map<std::string, CookRecord>& records, bool force)
+{
+    CookRecord& record = job.record;
+    record.type = CookAsset_Mesh;
+    record.version = GetMeshVersion();
+    if (!HashFile(record.path.c_str(), record.sourceHash))
+    {
+        job.failed = true;
+        return;
+    }
+
+    if (IsUpToDate(record, records, force))
+    {
+        record = records.find(record.path)->second;
+        return;
+    }
+
+    ModelImport import = {};
+    import.filepath = record.path;
+    import.vertexQuantization = COOK_VERTEX_QUANTIZATION;
+    if (!ModelLoader::ImportModelSource(import) || !MeshCache::WriteModel(import))
+    {
+        job.failed = true;
+        return;
+    }
+
+    for (const std::string& dependency : import.dependencies)
+    {
+        const std::string path = AssetPack::NormalizePath(dependency.c_str());
+        bool listed = false;
+        for (const CookDependency& existing : record.dependencies)
+            listed |= existing.path == path;
+
+        u64 hash;
+        if (!listed && HashFile(path.c_str(), hash))
+            record.dependencies.push_back(CookDependency{ path, hash });
+    }
+
+    for (const MaterialSource& material : import.materials)
+    {
+        for (u32 slot = 0; slot < MaterialTexture_Count; ++slot)
+        {
+            if (material.texturePaths[slot].empty())
+                continue;
+
+            const std::string path = AssetPack::NormalizePath(material.texturePaths[slot].c_str());
+            bool listed = false;
+            for (const CookTexture& existing : record.textures)
+                listed |= existing.path == path;
+
+            if (!listed)
+                record.textures.push_back(CookTexture{ path, TextureCompressor::GetSlotUsage(slot) });
+        }
+    }
+
+    record.output = MeshCache::GetCachePath(record.path.c_str());
+    record.outputSize = GetFileBytes(record.output.c_str());
+    job.cooked = true;
+}
+
+static void CookTextureFile(CookJob& job, TextureUsage usage, const std::map<std::string, CookRecord>& records, bool force)
+{
+    CookRecord& record = job.record;
+    record.type = CookAsset_Texture;
+    record.version = GetTextureVersion(usage);
+    if (!HashFile(record.path.c_str(), record.sourceHash))
+    {
+        ELOG("Could not read texture %s", record.path.c_str());
+        job.failed = true;
+        return;
+    }
+
+    if (IsUpToDate(record, records, force))
+    {
+        record = records.find(record.path)->second;
+        return;
+    }
+
+    CompressionStats stats = {};
+    if (!TextureCompressor::CompressTextureFile(record.path.c_str(), TEXTURE_COMPRESSION_HIGH_QUALITY, usage, stats))
+    {
+        job.failed = true;
+        return;
+    }
+
+    record.output = TextureCompressor::GetCompressedPath(record.path.c_str());
+    record.outputSize = GetFileBytes(record.output.c_str());
+    job.cooked = true;
+}
+
+// One job per asset rather than a ParallelFor: import times vary by orders of magnitude
+static void RunJobs(std::vector<CookJob>& jobs, const std::function<void(CookJob& job)>& cook)
+{
+    std::vector<std::future<void>> futures;
+    for (CookJob& job : jobs)
+        futures.push_back(JobSystem::Submit([&cook, &job]() { cook(job); }));
+
+    for (std::future<void>& future : futures)
+        JobSystem::Wait(future);
+}
+
+static int Cook(const std::string& assetDirectory, bool force)
+{
+    const f64 startTime = glfwGetTime();
+    const std::string manifestPath = assetDirectory + "/" + COOK_MANIFEST_FILENAME;
+
+    std::map<std::string, CookRecord> records;
+    ReadManifest(manifestPath, records);
+
+    std::vector<std::string> filepaths;
+    ListFiles(assetDirectory.c_str(), filepaths);
+    std::sort(filepaths.begin(), filepaths.end());
+
+    std::vector<CookJob> meshJobs;
+    for (const std::string& filepath : filepaths)
+    {
+        if (IsModelFile(filepath))
+        {
+            meshJobs.push_back(CookJob{});
+            meshJobs.back().record.path = AssetPack::NormalizePath(filepath.c_str());
+        }
+    }
+
+    RunJobs(meshJobs, [&records, force](CookJob& job) { CookMesh(job, records, force); });
+
+    // Textures are known once the materials are, each one cooked once for all its users
+    std::map<std::string, TextureUsage> textureUses;
+    for (const CookJob& job : meshJobs)
+    {
+        for (const CookTexture& texture : job.record.textures)
+        {
+            std::map<std::string, TextureUsage>::iterator it = textureUses.find(texture.path);
+            if (it == textureUses.end())
+            {
+                textureUses[texture.path] = texture.usage;
+            }
+            else if (it->second != texture.usage)
+            {
+                ELOG("%s is used both as %s and as %s, cooked as %s", texture.path.c_str(),
+                     TextureCompressor::GetUsageName(it->second), TextureCompressor::GetUsageName(texture.usage), TextureCompressor::GetUsageName(it->second));
+            }
+        }
+    }
+
+    std::vector<CookJob> textureJobs;
+    for (const std::pair<const std::string, TextureUsage>& texture : textureUses)
+    {
+        textureJobs.push_back(CookJob{});
+        textureJobs.back().record.path = texture.first;
+    }
+
+    RunJobs(textureJobs, [&records, &textureUses, force](CookJob& job) { CookTextureFile(job, textureUses.find(job.record.path)->second, records, force); });
+
+    // Failed assets are left out so the next run retries them
+    std::vector<const CookRecord*> cookedRecords;
+    u32 cookedMeshes = 0;
+    u32 cookedTextures = 0;
+    u32 failures = 0;
+    for (const CookJob& job : meshJobs)
+    {
+        cookedMeshes += job.cooked ? 1 : 0;
+        failures += job.failed ? 1 : 0;
+        if (!job.failed)
+            cookedRecords.push_back(&job.record);
+    }
+    for (const CookJob& job : textureJobs)
+    {
+        cookedTextures += job.cooked ? 1 : 0;
+        failures += job.failed ? 1 : 0;
+        if (!job.failed)
+            cookedRecords.push_back(&job.record);
+    }
+
+    if (!WriteManifest(manifestPath, cookedRecords))
+        return 1;
+
+    ILOG("Cooked %u/%u meshes and %u/%u textures in %.2f ms on %u threads, %u failed",
+         cookedMeshes, (u32)meshJobs.size(), cookedTextures, (u32)textureJobs.size(),
+         (glfwGetTime() - startTime) * 1000.0, JobSystem::GetWorkerCount(), failures);
+    return failures > 0 ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+    std::string assetDirectory = "Assets";
+    bool force = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--force") == 0)
+            force = true;
+        else
+            assetDirectory = AssetPack::NormalizePath(argv[i]);
+    }
+
+    // Only for glfwGetTime, no window is created
+    if (!glfwInit())
+        return 1;
+    JobSystem::Init();
+
+    const int result = Cook(assetDirectory, force);
+
+    JobSystem::Shutdown();
+    glfwTerminate();
+    return result;
+}
@@ -0,0 +1,132 @@
+//
+// Packer.cpp : Builds the asset pack the engine mounts at startup, and measures
+// cold reads from it against the same assets as loose files.
+//
+//   Packer <pack> <file or directory>...   run from WorkingDir, entries are named after the paths as given
+//   Packer --benchmark <pack>              evicts the files from the OS cache before each pass
+//
+
+#include "../Globals.h"
+#include "../platform.h"
+#include "../JobSystemFunctions.h"
+#include "../AssetPackFunctions.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int BuildPack(const char* packPath, int inputCount, char** inputs)
+{
+    const std::string packName = AssetPack::NormalizePath(packPath);
+
+    std::vector<std::string> filepaths;
+    for (int i = 0; i < inputCount; ++i)
+    {
+        const u32 listed = filepaths.size();
+        ListFiles(inputs[i], filepaths);
+        if (filepaths.size() == listed)
+            filepaths.push_back(inputs[i]); // not a directory
+    }
+
+    // A previous pack inside one of the directories must not end up in the new one
+    for (u32 i = 0; i < filepaths.size();)
+    {
+        if (AssetPack::NormalizePath(filepaths[i].c_str()) == packName)
+            filepaths.erase(filepaths.begin() + i);
+        else
+            ++i;
+    }
+
+    const f64 startTime = glfwGetTime();
+    AssetPackBuildStats stats = {};
+    if (!AssetPack::Build(packPath, filepaths, stats))
+        return 1;
+
+    ILOG("Packed %u files (%u LZ4 compressed) into %s in %.2f ms: %.2f MB -> %.2f MB", stats.entryCount, stats.compressedCount, packPath,
+         (glfwGetTime() - startTime) * 1000.0, stats.sourceBytes / (1024.0 * 1024.0), stats.packBytes / (1024.0 * 1024.0));
+    return 0;
+}
+
+static int Benchmark(const char* packPath)
+{
+    if (!AssetPack::Mount(packPath))
+        return 1;
+    const std::vector<std::string> filepaths = AssetPack::GetEntryPaths();
+    AssetPack::Unmount();
+
+    // Loose files, opened one by one as the engine did before the pack
+    u64 looseBytes = 0;
+    u64 looseHash = 0;
+    u32 missing = 0;
+    for (const std::string& filepath : filepaths)
+        EvictFileFromCache(filepath.c_str());
+
+    f64 startTime = glfwGetTime();
+    for (const std::string& filepath : filepaths)
+    {
+        MappedFile file = MapFile(filepath.c_str());
+        if (file.data == NULL)
+        {
+            missing++;
+            continue;
+        }
+        looseHash ^= HashBytes(file.data, file.size); // touches every page
+        looseBytes += file.size;
+        UnmapFile(file);
+    }
+    const f64 looseMs = (glfwGetTime() - startTime) * 1000.0;
+
+    // The same assets through the pack, mount included
+    u64 packBytes = 0;
+    u64 packHash = 0;
+    EvictFileFromCache(packPath);
+
+    startTime = glfwGetTime();
+    AssetPack::Mount(packPath);
+    for (const std::string& filepath : filepaths)
+    {
+        AssetFile file = {};
+        if (AssetPack::OpenAsset(filepath.c_str(), file))
+        {
+            packHash ^= HashBytes(file.data, file.size);
+            packBytes += file.size;
+            AssetPack::CloseAsset(file);
+        }
+    }
+    const f64 packMs = (glfwGetTime() - startTime) * 1000.0;
+    const AssetPackStats stats = AssetPack::GetStats();
+    AssetPack::Unmount();
+
+    if (missing > 0)
+    {
+        ELOG("%u entries have no loose file, the loose pass read less than the pack", missing);
+    }
+    else if (looseHash != packHash)
+    {
+        ELOG("Loose files differ from the pack contents, it is out of date");
+    }
+
+    ILOG("Loose files: %u files, %.2f MB in %.2f ms", (u32)filepaths.size() - missing, looseBytes / (1024.0 * 1024.0), looseMs);
+    ILOG("Asset pack: %u entries, %.2f MB in %.2f ms (%.2f ms decompressing %.2f MB)", stats.entryCount, packBytes / (1024.0 * 1024.0), packMs,
+         stats.decompressMs, stats.decompressedBytes / (1024.0 * 1024.0));
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage:\n  Packer <pack> <file or directory>...\n  Packer --benchmark <pack>\n");
+        return 1;
+    }
+
+    // Only for glfwGetTime, no window is created
+    if (!glfwInit())
+        return 1;
+    JobSystem::Init();
+
+    const int result = strcmp(argv[1], "--benchmark") == 0 ? Benchmark(argv[2]) : BuildPack(argv[1], argc - 2, argv + 2);
+
+    JobSystem::Shutdown();
+    glfwTerminate();
+    return result;
+}
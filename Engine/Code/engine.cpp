@@ -10,6 +10,8 @@
 #include <stb_image.h>
 #include <stb_image_write.h>
 #include "Globals.h"
+#include "JobSystemFunctions.h"
+#include "SceneFunctions.h"
 
 GLuint CreateProgramFromSource(String programSource, const char* shaderName)
 {
@@ -92,7 +94,12 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
 
 u32 LoadProgram(App* app, const char* filepath, const char* programName)
 {
-    String programSource = ReadTextFile(filepath);
+    AssetId id = AssetRegistryManager::MakeAssetId(AssetType_Program, filepath, programName);
+    u32 programIdx = AssetRegistryManager::Find(app->assets, id);
+    if (programIdx != UINT32_MAX)
+        return programIdx;
+
+    String programSource = AssetPack::ReadTextAsset(filepath);
 
     Program program = {};
     program.handle = CreateProgramFromSource(programSource, programName);
@@ -116,25 +123,29 @@ u32 LoadProgram(App* app, const char* filepath, const char* programName)
             &type,
             name);
 
-        u8 location = glGetAttribLocation(program.handle, name);
-        program.shaderLayout.attributes.push_back(VertexShaderAttribute{ location, (u8)size });
+        const GLint location = glGetAttribLocation(program.handle, name);
+        if (location < 0)
+            continue; // built-in inputs like gl_VertexID
+
+        program.shaderLayout.attributes.push_back(VertexShaderAttribute{ (u8)location, (u8)size });
     }
 
+    programIdx = app->programs.size();
     app->programs.push_back(program);
+    AssetRegistryManager::Insert(app->assets, id, programIdx, filepath, programName);
 
-    return app->programs.size() - 1;
+    return programIdx;
 }
 
-GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
+GLuint FindVAO(GeometryPool& pool, const Program& program, const InstanceBuffers& instanceBuffers)
 {
     GLuint ReturnValue = 0;
 
-    SubMesh& Submesh = mesh.submeshes[submeshIndex];
-    for (u32 i = 0; i < (u32)Submesh.vaos.size(); ++i)
+    for (u32 i = 0; i < (u32)pool.vaos.size(); ++i)
     {
-        if (Submesh.vaos[i].programHandle == program.handle)
+        if (pool.vaos[i].programHandle == program.handle)
         {
-            ReturnValue = Submesh.vaos[i].handle;
+            ReturnValue = pool.vaos[i].handle;
             break;
         }
     }
@@ -144,24 +155,40 @@ GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
         glGenVertexArrays(1, &ReturnValue);
         glBindVertexArray(ReturnValue);
 
-        glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.indexBufferHandle);
 
+        // Attributes start at the beginning of their stream, draws select their vertices with a base vertex.
+        // Only the streams holding an attribute of the program are bound.
         auto& ShaderLayout = program.shaderLayout.attributes;
         for (auto ShaderIt = ShaderLayout.cbegin(); ShaderIt != ShaderLayout.cend(); ++ShaderIt)
         {
+            if (ShaderIt->location == INSTANCE_ATTRIBUTE_LOCATION)
+            {
+                InstanceBatcher::BindInstanceAttribute(instanceBuffers);
+                continue;
+            }
+
             bool attributeWasLinked = false;
-            auto SubmeshLayout = Submesh.vertexBufferLayout.attributes;
-            for (auto SubmeshIt = SubmeshLayout.cbegin(); SubmeshIt != SubmeshLayout.cend(); ++SubmeshIt)
+            for (const GeometryStream& stream : pool.streams)
             {
-                if (ShaderIt->location == SubmeshIt->location)
+                for (auto PoolIt = stream.layout.attributes.cbegin(); PoolIt != stream.layout.attributes.cend(); ++PoolIt)
                 {
-                    const u32 index = SubmeshIt->location;
-                    const u32 ncomp = SubmeshIt->componentCount;
-                    const u32 offset = SubmeshIt->offset + Submesh.vertexOffset;
-                    const u32 stride = Submesh.vertexBufferLayout.stride;
-
-                    glVertexAttribPointer(index, ncomp, GL_FLOAT, GL_FALSE, stride, (void*)(u64)(offset));
+                    if (ShaderIt->location != PoolIt->location)
+                        continue;
+
+                    if (stream.handle == 0)
+                    {
+                        ELOG("Program %s reads attribute %u, its stream was not created with the pool", program.programName.c_str(), (u32)PoolIt->location);
+                        break;
+                    }
+
+                    const u32 index = PoolIt->location;
+                    const u32 ncomp = PoolIt->componentCount;
+                    const u32 offset = PoolIt->offset;
+                    const u32 stride = stream.layout.stride;
+
+                    glBindBuffer(GL_ARRAY_BUFFER, stream.handle);
+                    glVertexAttribPointer(index, ncomp, PoolIt->type, PoolIt->normalized, stride, (void*)(u64)(offset));
                     glEnableVertexAttribArray(index);
 
                     attributeWasLinked = true;
@@ -173,7 +200,7 @@ GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
         glBindVertexArray(0);
 
         VAO vao = { ReturnValue, program.handle };
-        Submesh.vaos.push_back(vao);
+        pool.vaos.push_back(vao);
     }
 
     return ReturnValue;
@@ -262,6 +289,12 @@ void App::ConfigureFrameBuffer(FrameBuffer& aConfigFB)
 
 void Init(App* app)
 {
+    app->startupTime = glfwGetTime();
+    JobSystem::Init();
+
+    // Optional, without it every asset is read from its loose file
+    AssetPack::Mount(ASSET_PACK_FILENAME);
+
     //Get OPENGL info.
     app->openglDebugInfo += "OpeGL version:\n" + std::string(reinterpret_cast<const char*>(glGetString(GL_VERSION)));
 
@@ -290,22 +323,31 @@ void Init(App* app)
     app->renderToBackBufferShader = LoadProgram(app, "RENDER_TO_BB.glsl", "RENDER_TO_BB");
     app->renderToFrameBufferShader = LoadProgram(app, "RENDER_TO_FB.glsl", "RENDER_TO_FB");
     app->framebufferToQuadShader = LoadProgram(app, "FB_TO_BB.glsl", "FB_TO_BB");
-
-    const Program& texturedMeshProgram = app->programs[app->renderToFrameBufferShader];
-    app->texturedMeshProgram_uTexture = glGetUniformLocation(texturedMeshProgram.handle, "uTexture");
-    u32 PatrickModelIndex = ModelLoader::LoadModel(app, "Assets/Patrick.obj");
-    u32 GroundModelIndex = ModelLoader::LoadModel(app, "Assets/Ground.obj");
-    u32 SphereModelIndex = ModelLoader::LoadModel(app, "Assets/sphere.obj");
-    u32 QuadModelIndex = ModelLoader::LoadModel(app, "Assets/quad.obj");
-    u32 SquidwardModelIndex = ModelLoader::LoadModel(app, "Assets/squidward2.obj");
-    u32 HollowModelIndex = ModelLoader::LoadModel(app, "Assets/jojoHollow.obj");
-    u32 MoonModelIndex = ModelLoader::LoadModel(app, "Assets/moon.obj");
-
-    //app->diceTexIdx = ModelLoader::LoadTexture2D(app, "dice.png");
+    app->depthPrepassShader = LoadProgram(app, "DEPTH_PREPASS.glsl", "DEPTH_PREPASS");
+
+    // Placeholders are loaded synchronously, streamed textures point to them until they are resident
+    app->whiteTexIdx = ModelLoader::LoadTexture2D(app, "color_white.png", true);
+    app->blackTexIdx = ModelLoader::LoadTexture2D(app, "color_black.png", true);
+    app->normalTexIdx = ModelLoader::LoadTexture2D(app, "color_normal.png", false);
+    app->magentaTexIdx = ModelLoader::LoadTexture2D(app, "color_magenta.png", true);
+
+    // All models are imported in parallel on the job system, only the GL objects are created here
+    const f64 modelLoadStartTime = glfwGetTime();
+    const u64 peakMemoryBeforeModels = GetPeakMemoryUsage();
+    // Requests the models of the scene, its entities and lights are added right away
+    SceneLoader::LoadScene(app, "Assets/Main.scene");
+    ModelLoader::UpdatePendingModels(app, true);
+    app->modelLoadWallMs = (glfwGetTime() - modelLoadStartTime) * 1000.0;
+    app->modelLoadPeakMemory = GetPeakMemoryUsage();
+    app->modelLoadPeakMemoryGrowth = app->modelLoadPeakMemory - peakMemoryBeforeModels;
+    ILOG("Loaded %u models in %.2f ms using %u workers, peak memory %.2f MB (+%.2f MB)", (u32)app->modelLoadStats.size(),
+         app->modelLoadWallMs, JobSystem::GetWorkerCount(), app->modelLoadPeakMemory / (1024.0 * 1024.0), app->modelLoadPeakMemoryGrowth / (1024.0 * 1024.0));
+
+    //app->diceTexIdx = ModelLoader::LoadTexture2D(app, "dice.png", true);
 
     VertexBufferLayout vertexBufferLayout = {};
-    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 0, 3, 0 });
-    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 2, 2, 3 * sizeof(float) });
+    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 0, 3, 0, GL_FALSE, GL_FLOAT });
+    vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 2, 2, 3 * sizeof(float), GL_FALSE, GL_FLOAT });
     vertexBufferLayout.stride = 5 * sizeof(float);
 
     glEnable(GL_DEPTH_TEST);
@@ -316,28 +358,11 @@ void Init(App* app)
 
     app->localUniformBuffer = CreateConstantBuffer(app->maxUniformBufferSize);
 
-    app->entities.push_back({TransformPositionScale(vec3(0.f, 0.0f, 2.0), vec3(0.45f)),PatrickModelIndex,0,0 });
-    app->entities.push_back({TransformPositionScale(vec3(2.f, 0.0f, 2.0), vec3(0.45f)),PatrickModelIndex,0,0 });
-    app->entities.push_back({ TransformPositionScale(vec3(3.f, -2.0f, 2.0), vec3(0.05f)),SquidwardModelIndex,0,0 });
-    app->entities.push_back({ TransformPositionScale(vec3(0.f, -12.0f, -6.0), vec3(0.85f)),HollowModelIndex,0,0 });
-    app->entities.push_back({ TransformPositionScale(vec3(0.f, -12.0f, -16.0), vec3(0.85f)),MoonModelIndex,0,0 });
-
-    app->entities.push_back({TransformPositionScale(vec3(0.0, -5.0, 0.0), vec3(1.0, 1.0, 1.0)), GroundModelIndex, 0, 0 });
-
-    app->AddDirectionalLight(QuadModelIndex, vec3(7.0, 2.0, 3.0), vec3(-1.0, -1.0, 0.0), vec3(1.0, 1.0, 1.0));
-    app->AddDirectionalLight(QuadModelIndex, vec3(4.0, 1.0, 1.0), vec3(1.0, 1.0, 0.0), vec3(1.0, 1.0, 1.0));
-    app->AddPointLight(SphereModelIndex, vec3(2.0, 1.0, 1.0), vec3(0.0, 1.0, 0.0));
-    app->AddPointLight(SphereModelIndex, vec3(-2.0, 1.0, 1.0), vec3(0.0, 1.0, 0.0));
-    app->AddPointLight(SphereModelIndex, vec3(0.0, 2.0, -8.0), vec3(1.0, 1.0, 1.0));
-    app->AddPointLight(SphereModelIndex, vec3(6.0, 4.0, 5.0), vec3(1.0, 0.0, 0.0));
-    app->AddPointLight(SphereModelIndex, vec3(2.0, 2.0, 2.0), vec3(0.0, 0.0, 1.0));
-    app->AddPointLight(SphereModelIndex, vec3(0.f, 8.0f, -32.0), vec3(1.0, 0.0, 0.0));
-    app->AddPointLight(SphereModelIndex, vec3(13.0f, 8.0f, -37.0), vec3(0.0, 1.0, 0.0));
-    app->AddPointLight(SphereModelIndex, vec3(-10.0f, 7.0f, -37.0), vec3(0.0, 0.0, 1.0));
-
     app->ConfigureFrameBuffer(app->deferredFrameBuffer);
 
     app->mode = Mode_Deferred;
+
+    ILOG("Init done in %.2f ms, %u textures still streaming", (glfwGetTime() - app->startupTime) * 1000.0, (u32)app->textureUploads.size());
 }
 
 void Gui(App* app)
@@ -391,6 +416,134 @@ void Gui(App* app)
     }
     
 
+    if (ImGui::CollapsingHeader("Model Loading"))
+    {
+        ImGui::Text("Startup wall time: %.2f ms (%u workers)", app->modelLoadWallMs, JobSystem::GetWorkerCount());
+        ImGui::Text("Peak memory after model loading: %.2f MB (+%.2f MB while loading)",
+                    app->modelLoadPeakMemory / (1024.0 * 1024.0), app->modelLoadPeakMemoryGrowth / (1024.0 * 1024.0));
+        ImGui::Text("Textures streaming: %u", (u32)app->textureUploads.size());
+
+        const AssetPackStats packStats = AssetPack::GetStats();
+        if (AssetPack::IsMounted())
+            ImGui::Text("Asset pack: %u entries, %.2f MB", packStats.entryCount, packStats.packSize / (1024.0 * 1024.0));
+        else
+            ImGui::Text("Asset pack: not mounted, loose files only");
+        ImGui::Text("Asset reads: %u from the pack, %u loose, %.2f MB decompressed in %.2f ms", packStats.packReads, packStats.looseReads,
+                    packStats.decompressedBytes / (1024.0 * 1024.0), packStats.decompressMs);
+
+        u64 textureMemory = 0;
+        for (const Texture& texture : app->textures)
+            textureMemory += texture.sizeInBytes;
+        ImGui::Text("Texture memory: %.2f MB in %u textures", textureMemory / (1024.0 * 1024.0), (u32)app->textures.size());
+        ImGui::Text("Mip generation: %.2f ms (%s)", app->textureMipGenerationMs, MipGenerator::IsAVX2Enabled() ? "AVX2" : "SSE");
+
+        const TextureStreamingStats& streamingStats = app->textureStreamingStats;
+        int budgetMB = (int)(app->textureStreamingBudget / MB(1));
+        if (ImGui::SliderInt("Texture budget (MB)", &budgetMB, 16, 1024))
+            app->textureStreamingBudget = (u64)budgetMB * MB(1);
+        ImGui::Text("Streamed textures: %.2f MB resident in %u textures", streamingStats.residentBytes / (1024.0 * 1024.0), (u32)app->streamedTextures.size());
+        ImGui::Text("    %u loads and %u evictions pending, %u loads and %u evictions done", streamingStats.pendingLoads,
+                    streamingStats.pendingEvictions, streamingStats.completedLoads, streamingStats.completedEvictions);
+
+        TextureArrayStats& arrayStats = app->textureArrayStats;
+        TextureArrayManager::GetStats(app->textureArrays, arrayStats);
+        ImGui::Text("Texture arrays: %u, %.2f / %.2f MB of layers used", (u32)app->textureArrays.size(),
+                    arrayStats.usedBytes / (1024.0 * 1024.0), arrayStats.allocatedBytes / (1024.0 * 1024.0));
+        ImGui::Text("    %u texture binds per pass (%u arrays bound)", arrayStats.arrayBinds, arrayStats.boundArrays);
+
+        const DeduplicationStats& dedupStats = app->deduplicationStats;
+        ImGui::Text("Duplicates merged: %u textures (%.2f MB), %u materials (%u bytes)", dedupStats.duplicateTextures,
+                    dedupStats.savedTextureBytes / (1024.0 * 1024.0), dedupStats.duplicateMaterials, (u32)dedupStats.savedMaterialBytes);
+
+        u64 residentGeometryBytes = 0;
+        u64 reclaimedGeometryBytes = 0;
+        for (const ModelLoadStats& stats : app->modelLoadStats)
+        {
+            residentGeometryBytes += stats.residentGeometryBytes;
+            reclaimedGeometryBytes += stats.reclaimedGeometryBytes;
+        }
+        ImGui::Text("CPU geometry: %.2f MB resident, %.2f MB reclaimed after upload",
+                    residentGeometryBytes / (1024.0 * 1024.0), reclaimedGeometryBytes / (1024.0 * 1024.0));
+
+        for (u32 i = 0; i < app->geometryPools.size(); ++i)
+        {
+            const GeometryPool& pool = app->geometryPools[i];
+            const TlsfStats vertexStats = Tlsf::GetStats(pool.vertexAllocator);
+            const TlsfStats indexStats = Tlsf::GetStats(pool.indexAllocator);
+            ImGui::Text("Geometry pool %u (%u byte vertices, %u bit indices): %u meshes", i, pool.vertexBufferLayout.stride,
+                        pool.indexType == GL_UNSIGNED_SHORT ? 16 : 32, vertexStats.allocationCount);
+            ImGui::Text("    streams of %u / %u / %u bytes, %u uploaded per vertex", pool.streams[0].layout.stride, pool.streams[1].layout.stride,
+                        pool.streams[2].layout.stride, GeometryPoolManager::GetStreamedVertexSize(pool));
+            ImGui::Text("    vertices %u / %u, %u free blocks (largest %u)", vertexStats.usedSize, vertexStats.capacity,
+                        vertexStats.freeBlockCount, vertexStats.largestFreeBlock);
+            ImGui::Text("    indices %u / %u, %u free blocks (largest %u)", indexStats.usedSize, indexStats.capacity,
+                        indexStats.freeBlockCount, indexStats.largestFreeBlock);
+        }
+        ImGui::Text("Geometry VAO binds: %u", app->geometryVaoBinds);
+        ImGui::Checkbox("Depth prepass (position stream only)", &app->useDepthPrepass);
+        if (ImGui::Button("Defragment geometry pools"))
+            GeometryPoolManager::Defragment(app->geometryPools, app->meshes);
+
+        const InstancingStats& instancingStats = app->instancingStats;
+        ImGui::Checkbox("Instancing", &app->useInstancing);
+        ImGui::Text("Entities: %u visible, %u frustum culled", instancingStats.visibleEntities, instancingStats.culledEntities);
+        ImGui::Text("Draw calls: %u, %u batches (%u instanced), %u commands", instancingStats.drawCalls, instancingStats.batches,
+                    instancingStats.instancedBatches, instancingStats.commands);
+        ImGui::Checkbox("Multi-draw indirect", &app->useIndirectDraws);
+        ImGui::Text("CPU submission: %.3f ms direct, %.3f ms indirect", instancingStats.directSubmitMs, instancingStats.indirectSubmitMs);
+        if (ImGui::Button("Spawn benchmark entities"))
+            InstanceBatcher::SpawnBenchmarkEntities(app, INSTANCE_BENCHMARK_ENTITIES);
+
+        const RenderQueueStats& queueStats = app->renderQueueStats;
+        ImGui::Text("Render queue: %u draws sorted in %.3f ms", queueStats.items, queueStats.sortMs);
+        ImGui::Text("    pool changes %u (unsorted %u), array %u (%u)", queueStats.sorted.pools, queueStats.unsorted.pools,
+                    queueStats.sorted.arrays, queueStats.unsorted.arrays);
+        ImGui::Text("    material changes %u (%u), mesh %u (%u)", queueStats.sorted.materials, queueStats.unsorted.materials,
+                    queueStats.sorted.meshes, queueStats.unsorted.meshes);
+
+        const MeshletCullingStats& meshletStats = app->meshletStats;
+        ImGui::Checkbox("Meshlet culling", &app->useMeshletCulling);
+        ImGui::Text("Meshlets: %u / %u drawn, %u frustum culled, %u backface culled", meshletStats.visibleMeshlets,
+                    meshletStats.totalMeshlets, meshletStats.frustumCulled, meshletStats.backfaceCulled);
+
+        const LodSelectionStats& lodStats = app->lodStats;
+        ImGui::Checkbox("Levels of detail", &app->useLods);
+        ImGui::SliderFloat("LOD error (pixels)", &app->lodErrorThreshold, 0.25f, 8.0f);
+        ImGui::Text("Triangles: %u drawn, %u at full detail", lodStats.trianglesDrawn, lodStats.trianglesFullDetail);
+        ImGui::Text("Submeshes per level: %u %u %u %u %u", lodStats.submeshesPerLevel[0], lodStats.submeshesPerLevel[1],
+                    lodStats.submeshesPerLevel[2], lodStats.submeshesPerLevel[3], lodStats.submeshesPerLevel[4]);
+        for (size_t i = 0; i < app->modelLoadStats.size(); ++i)
+        {
+            const ModelLoadStats& stats = app->modelLoadStats[i];
+            if (stats.fromCache)
+                ImGui::Text("%s: %.2f ms warm (%.2f ms cold), upload %.2f ms", stats.filepath.c_str(), stats.loadMs, stats.coldLoadMs, stats.uploadMs);
+            else
+                ImGui::Text("%s: %.2f ms cold, upload %.2f ms", stats.filepath.c_str(), stats.loadMs, stats.uploadMs);
+
+            // Frees the current geometry ranges once the new import is finalized
+            ImGui::SameLine();
+            ImGui::PushID((int)i);
+            if (ImGui::Button("Reload"))
+            {
+                const u32 modelIdx = AssetRegistryManager::Find(app->assets, AssetType_Model, stats.filepath.c_str());
+                ModelLoader::ReloadModel(app, modelIdx, stats.filepath.c_str(), stats.vertexQuantization, (GeometryResidency)stats.residency);
+            }
+            ImGui::PopID();
+
+            ImGui::Text("    CPU geometry (%s): %u KB resident, %u KB reclaimed", ModelLoader::GetGeometryResidencyName((GeometryResidency)stats.residency),
+                        (u32)(stats.residentGeometryBytes / 1024), (u32)(stats.reclaimedGeometryBytes / 1024));
+            const VertexQuantizationStats& quantization = stats.quantization;
+            ImGui::Text("    vertices %u KB -> %u KB, max error pos %.4f nrm %.2f deg uv %.5f",
+                        quantization.rawVertexBytes / 1024, quantization.vertexBytes / 1024,
+                        quantization.maxPositionError, quantization.maxNormalErrorDegrees, quantization.maxTexCoordError);
+
+            const MeshOptimizationStats& optimization = stats.optimization;
+            ImGui::Text("    ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overdraw %.3f -> %.3f",
+                        optimization.acmrBefore, optimization.acmrAfter, optimization.atvrBefore, optimization.atvrAfter,
+                        optimization.overdrawBefore, optimization.overdrawAfter);
+        }
+    }
+
     if (app->mode == Mode::Mode_Deferred)
     {
 
@@ -408,6 +561,19 @@ void Gui(App* app)
 void Update(App* app)
 {
     // You can handle app->input keyboard/mouse here
+
+    ModelLoader::UpdatePendingModels(app, false);
+    TextureStreamer::Update(app);
+}
+
+void Shutdown(App* app)
+{
+    ModelLoader::UpdatePendingModels(app, true);
+    TextureStreamer::Shutdown(app);
+    TextureArrayManager::Release(app->textureArrays);
+    InstanceBatcher::Release(app->instanceBuffers);
+    JobSystem::Shutdown();
+    AssetPack::Unmount();
 }
 
 glm::mat4 TransformScale(const vec3& scaleFactors)
@@ -419,6 +585,9 @@ glm::mat4 TransformScale(const vec3& scaleFactors)
 
 void Render(App* app)
 {
+    // Every mode draws the geometry once, the shaders write the mip levels they need meanwhile
+    TextureStreamer::BeginFeedback(app);
+
     switch (app->mode)
     {
     case Mode_Forward:
@@ -631,38 +800,103 @@ void Render(App* app)
 
     default:;
     }
+
+    TextureStreamer::EndFeedback(app);
 }
 
 void App::RenderGeometry(const Program& aBindedProgram)
 {
+    // Lays the depth first, the pass below then only shades the visible fragments
+    const Program& depthProgram = programs[depthPrepassShader];
+    const bool isDepthPrepass = aBindedProgram.handle == depthProgram.handle;
+    if (useDepthPrepass && !isDepthPrepass)
+    {
+        glUseProgram(depthProgram.handle);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        RenderGeometry(depthProgram);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glUseProgram(aBindedProgram.handle);
+        glDepthFunc(GL_LEQUAL);
+    }
+
     glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), localUniformBuffer.handle, globalParamsOffset, globalParamsSize);
 
-    for (auto it = entities.begin(); it != entities.end(); ++it)
+    geometryVaoBinds = 0;
+    instancingStats.drawCalls = 0;
+
+    // Every texture is a layer of one of a few arrays, bound once for the whole pass
+    GLuint boundArrays[TEXTURE_ARRAY_BOUND_UNITS];
+    if (!isDepthPrepass)
     {
+        textureArrayStats.boundArrays = TextureArrayManager::BindArrays(textureArrays, aBindedProgram.handle, boundArrays);
+        textureArrayStats.arrayBinds = textureArrayStats.boundArrays;
+    }
 
-        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), localUniformBuffer.handle, it->localParamsOffset, it->localParamsSize);
+    // Mip feedback, see TextureStreamer
+    glUniform1ui(glGetUniformLocation(aBindedProgram.handle, "uFeedbackFrame"), textureFeedback.frame);
 
-        Model& model = models[it->modelIndex];
-        Mesh& mesh = meshes[model.meshIdx];
+    // Matrices, draw parameters and commands of the frame, see InstanceBatcher
+    InstanceBatcher::BindBuffers(instanceBuffers);
 
-        //glUniformMatrix4fv(glGetUniformLocation(texturedMeshProgram.handle, "WVP"), 1, GL_FALSE, &WVP[0][0]);
+    // Submeshes of the same pool share the VAO, it is only rebound when the pool changes
+    GLuint boundVao = 0;
 
-        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    const f64 submitStartTime = glfwGetTime();
+    if (useIndirectDraws)
+    {
+        for (const IndirectRun& run : instanceBuffers.runs)
+        {
+            GeometryPool& pool = geometryPools[run.poolIdx];
+            GLuint vao = FindVAO(pool, aBindedProgram, instanceBuffers);
+            if (vao != boundVao)
+            {
+                glBindVertexArray(vao);
+                boundVao = vao;
+                geometryVaoBinds++;
+            }
+
+            if (!isDepthPrepass && run.bindArrayIdx != UINT32_MAX)
+                TextureArrayManager::BindArray(textureArrays, run.bindArrayIdx, boundArrays, textureArrayStats.arrayBinds);
+
+            const u64 commandOffset = (u64)run.firstCommand * sizeof(DrawElementsIndirectCommand);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, pool.indexType, (void*)commandOffset, run.commandCount, 0);
+            instancingStats.drawCalls++;
+        }
+        instancingStats.indirectSubmitMs = (glfwGetTime() - submitStartTime) * 1000.0;
+    }
+    else
+    {
+        for (const InstanceBatch& batch : instanceBuffers.batches)
         {
-            GLuint vao = FindVAO(mesh, i, aBindedProgram);
-            glBindVertexArray(vao);
+            Model& model = models[batch.modelIdx];
+            SubMesh& submesh = meshes[model.meshIdx].submeshes[batch.submeshIdx];
 
-            u32 subMeshmaterialIdx = model.materialIdx[i];
-            Material& subMeshMaterial = materials[subMeshmaterialIdx];
+            GLuint vao = FindVAO(geometryPools[submesh.poolIdx], aBindedProgram, instanceBuffers);
+            if (vao != boundVao)
+            {
+                glBindVertexArray(vao);
+                boundVao = vao;
+                geometryVaoBinds++;
+            }
 
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, textures[subMeshMaterial.albedoTextureIdx].handle);
-            glUniform1i(texturedMeshProgram_uTexture, 0);
+            if (!isDepthPrepass)
+                TextureArrayManager::BindArray(textureArrays, batch.arrayIdx, boundArrays, textureArrayStats.arrayBinds);
 
-            SubMesh& submesh = mesh.submeshes[i];
-            glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
+            // The base instance steps the instance attribute to the batch's first instance
+            const u32 indexSize = ModelLoader::GetIndexSize(submesh.indexType);
+            for (u32 i = batch.firstCommand; i < batch.firstCommand + batch.commandCount; ++i)
+            {
+                const DrawElementsIndirectCommand& command = instanceBuffers.commands[i];
+                glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.count, submesh.indexType, (void*)((u64)command.firstIndex * indexSize),
+                                                              command.instanceCount, command.baseVertex, command.baseInstance);
+                instancingStats.drawCalls++;
+            }
         }
+        instancingStats.directSubmitMs = (glfwGetTime() - submitStartTime) * 1000.0;
     }
+
+    if (useDepthPrepass && !isDepthPrepass)
+        glDepthFunc(GL_LESS);
 }
 
 const GLuint App::CreateTexture(const bool isFloatingPoint)
@@ -690,7 +924,7 @@ const GLuint App::CreateTexture(const bool isFloatingPoint)
 void App::AddPointLight(u32 modelIndex,vec3 position, vec3 lightcolor)
 {
     Light light = { LightType::LightType_Point,lightcolor,vec3(1.0,1.0,1.0),position };
-    entities.push_back({TransformPositionScale(position, vec3(0.15f)),modelIndex,0,0 });
+    entities.push_back({TransformPositionScale(position, vec3(0.15f)),modelIndex });
     lights.push_back(light);
 
     lights[lights.size()-1].visualRef = entities.size()-1;
@@ -701,7 +935,7 @@ void App::AddDirectionalLight(u32 modelIndex,vec3 position,vec3 direction, vec3
 {
 
     lights.push_back({ LightType::LightType_Directional,lightcolor,direction,position });
-    entities.push_back({TransformPositionScale(position, vec3(0.15f)),modelIndex,0,0 });
+    entities.push_back({TransformPositionScale(position, vec3(0.15f)),modelIndex });
 
     lights[lights.size() - 1].visualRef = entities.size() - 1;
     
@@ -713,7 +947,7 @@ void App::UpdateEntityBuffer()
     float aspectRatio = (float)displaySize.x / (float)displaySize.y;
     float znear = 0.1f;
     float zfar = 1000.0f;
-    glm::mat4 projection = glm::perspective(glm::radians(60.0f), aspectRatio, znear, zfar);
+    glm::mat4 projection = glm::perspective(verticalFov, aspectRatio, znear, zfar);
 
     vec3 xCam = glm::cross(camFront, vec3(0, 1, 0));
     vec3 yCam = glm::cross(xCam, camFront);
@@ -721,10 +955,9 @@ void App::UpdateEntityBuffer()
     HandleCameraInput(yCam);
 
     glm::mat4 view = glm::lookAt(cameraPosition, cameraPosition + camFront, yCam);
+    viewProjection = projection * view;
 
 
-    u32 cont = 0;
-
     BufferManager::MapBuffer(localUniformBuffer, GL_WRITE_ONLY);
 
     //Push Lights
@@ -751,22 +984,10 @@ void App::UpdateEntityBuffer()
 
     globalParamsSize = localUniformBuffer.head - globalParamsOffset;
 
-    for (auto it = entities.begin(); it != entities.end(); ++it)
-    {
-
-        glm::mat4 world = it->worldMatrix;
-        glm::mat4 WVP = projection * view * world;
-
-        Buffer& localBuffer = localUniformBuffer;
-        BufferManager::AlignHead(localBuffer, uniformBlockAlignment);
-        it->localParamsOffset = localBuffer.head;
-        PushMat4(localBuffer, world);
-        PushMat4(localBuffer, WVP);
-        it->localParamsSize = localBuffer.head - it->localParamsOffset;
-        ++cont;
-    }
-
     BufferManager::UnmapBuffer(localUniformBuffer);
+
+    // The entity matrices go to their own buffer, with the batches RenderGeometry draws
+    InstanceBatcher::BuildBatches(this);
 }
 
 void App::HandleCameraInput(vec3& yCam)
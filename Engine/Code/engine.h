@@ -7,6 +7,13 @@
 #include "platform.h"
 #include "BufferSuppFunctions.h"
 #include "ModelLoadingFunctions.h"
+#include "TextureStreamingFunctions.h"
+#include "TextureArrayFunctions.h"
+#include "AssetRegistryFunctions.h"
+#include "AssetPackFunctions.h"
+#include "MeshletFunctions.h"
+#include "MeshSimplifierFunctions.h"
+#include "InstancingFunctions.h"
 #include "Globals.h"
 
 const VertexV3V2 vertices[] = {
@@ -44,6 +51,7 @@ struct App
     void AddDirectionalLight(u32 modelIndex,vec3 position, vec3 direction, vec3 color);
 
     // Loop
+    f64  startupTime;
     f32  deltaTime;
     bool isRunning;
 
@@ -57,18 +65,38 @@ struct App
     ivec2 displaySize;
 
     std::vector<Texture>    textures;
+    std::vector<TextureArray> textureArrays; // storage of every texture, per format and size
     std::vector<Material>   materials;
     std::vector<Mesh>       meshes;
+    std::vector<GeometryPool> geometryPools; // vertices and indices of every mesh, per vertex format
     std::vector<Model>      models;
     std::vector<Program>    programs;
 
+    // Path -> index lookup shared by textures, models, materials and programs
+    AssetRegistry           assets;
+
+    std::vector<PendingModel>   pendingModels;
+    std::vector<TextureUpload*> textureUploads;
+    std::vector<StagingBuffer>  freeStagingBuffers;
+    std::vector<StreamedTexture*> streamedTextures;
+    TextureFeedback             textureFeedback;
+    TextureStreamingStats       textureStreamingStats;
+    u64                         textureStreamingBudget = TEXTURE_STREAMING_DEFAULT_BUDGET;
+    u32                         textureInitialLoads; // streamed textures without any level yet
+    std::vector<ModelLoadStats> modelLoadStats;
+    DeduplicationStats          deduplicationStats;
+    f64                         modelLoadWallMs;
+    u64                         modelLoadPeakMemory;     // process peak once the models are in
+    u64                         modelLoadPeakMemoryGrowth;
+    f64                         textureMipGenerationMs;
+
     // program indices
     u32 renderToBackBufferShader = 0;
     u32 renderToFrameBufferShader = 0;
     u32 framebufferToQuadShader = 0;
+    u32 depthPrepassShader = 0;
 
     u32 patricioModel = 0;
-    GLuint texturedMeshProgram_uTexture;
     
     // texture indices
     u32 diceTexIdx;
@@ -106,6 +134,8 @@ struct App
 
     vec3 camFront = vec3(0.0f, 0.0f, -1.0f);
     vec3 cameraPosition = vec3(0.0, 0.0, 0.0);
+    glm::mat4 viewProjection;
+    f32 verticalFov = glm::radians(60.0f);
     float yaw = -90.0f;
     float pitch = -90.0f;
 
@@ -113,6 +143,33 @@ struct App
     bool useDepth = false;
     bool useNormal = false;
 
+    // Meshlet culling, done by InstanceBatcher when it builds the draws
+    bool useMeshletCulling = true;
+    MeshletCullingStats meshletStats;
+
+    // VAO changes in the last RenderGeometry, at most one per geometry pool when draws share them
+    u32 geometryVaoBinds;
+
+    // Depth only pass before every geometry pass, it fetches the position stream alone
+    bool useDepthPrepass = false;
+
+    // Texture array binds of the last RenderGeometry, one per array up to TEXTURE_ARRAY_BOUND_UNITS
+    TextureArrayStats textureArrayStats;
+
+    // Level of detail selection
+    bool useLods = true;
+    f32 lodErrorThreshold = MESH_SIMPLIFIER_ERROR_THRESHOLD; // pixels
+    LodSelectionStats lodStats;
+
+    // Entities drawn in batches of the same submesh, rebuilt by UpdateEntityBuffer
+    bool useInstancing = true;
+    bool useIndirectDraws = true;
+    InstanceBuffers instanceBuffers;
+    InstancingStats instancingStats;
+
+    // Order of the batches, see RenderQueue
+    RenderQueueStats renderQueueStats;
+
 };
 
 void Init(App* app);
@@ -123,4 +180,6 @@ void Update(App* app);
 
 void Render(App* app);
 
+void Shutdown(App* app);
+
 
@@ -9,10 +9,15 @@
 #define WIN32_LEAN_AND_MEAN
 #define _CRT_SECURE_NO_WARNINGS
 #include <Windows.h>
+#include <psapi.h>
 #else
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/resource.h>
+#include <dirent.h>
 #endif
 
 #include "engine.h"
@@ -29,6 +34,10 @@
 u8* GlobalFrameArenaMemory = NULL;
 u32 GlobalFrameArenaHead = 0;
 
+// Command line tools (Packer...) link the platform layer for its file and
+// logging functions and bring their own main
+#ifndef PLATFORM_TOOL
+
 void OnGlfwError(int errorCode, const char *errorMessage)
 {
 	fprintf(stderr, "glfw failed with error %d: %s\n", errorCode, errorMessage);
@@ -283,6 +292,8 @@ int main()
         GlobalFrameArenaHead = 0;
     }
 
+    Shutdown(&app);
+
     free(GlobalFrameArenaMemory);
 
     ImGui_ImplOpenGL3_Shutdown();
@@ -295,6 +306,8 @@ int main()
     return 0;
 }
 
+#endif // !PLATFORM_TOOL
+
 u32 Strlen(const char* string)
 {
     u32 len = 0;
@@ -420,9 +433,223 @@ u64 GetFileLastWriteTimestamp(const char* filepath)
     return 0;
 }
 
-void LogString(const char* str)
+MappedFile MapFile(const char* filepath)
+{
+    MappedFile file = {};
+
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mappingHandle == NULL)
+    {
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    file.data = (const u8*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (file.data == NULL)
+    {
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    file.size = (u64)fileSize.QuadPart;
+    file.fileHandle = fileHandle;
+    file.mappingHandle = mappingHandle;
+#else
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0)
+        return file;
+
+    struct stat attrib;
+    if (fstat(fd, &attrib) != 0 || attrib.st_size == 0)
+    {
+        close(fd);
+        return file;
+    }
+
+    void* data = mmap(NULL, attrib.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return file;
+
+    file.data = (const u8*)data;
+    file.size = (u64)attrib.st_size;
+#endif
+
+    return file;
+}
+
+void UnmapFile(MappedFile& file)
+{
+    if (file.data == NULL)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(file.data);
+    CloseHandle((HANDLE)file.mappingHandle);
+    CloseHandle((HANDLE)file.fileHandle);
+#else
+    munmap((void*)file.data, file.size);
+#endif
+
+    file = {};
+}
+
+bool WriteBinaryFile(const char* filepath, const void* data, u64 size)
+{
+    FILE* file = fopen(filepath, "wb");
+
+    if (!file)
+    {
+        ELOG("fopen() failed writing file %s", filepath);
+        return false;
+    }
+
+    bool success = fwrite(data, 1, size, file) == size;
+    fclose(file);
+    return success;
+}
+
+void ListFiles(const char* directory, std::vector<std::string>& filepaths)
+{
+#ifdef _WIN32
+    WIN32_FIND_DATAA findData;
+    HANDLE findHandle = FindFirstFileA((std::string(directory) + "\\*").c_str(), &findData);
+    if (findHandle == INVALID_HANDLE_VALUE)
+        return;
+
+    do
+    {
+        if (strcmp(findData.cFileName, ".") == 0 || strcmp(findData.cFileName, "..") == 0)
+            continue;
+
+        std::string path = std::string(directory) + "/" + findData.cFileName;
+        if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            ListFiles(path.c_str(), filepaths);
+        else
+            filepaths.push_back(path);
+    } while (FindNextFileA(findHandle, &findData));
+
+    FindClose(findHandle);
+#else
+    DIR* dir = opendir(directory);
+    if (dir == NULL)
+        return;
+
+    while (dirent* entry = readdir(dir))
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        std::string path = std::string(directory) + "/" + entry->d_name;
+        struct stat attrib;
+        if (stat(path.c_str(), &attrib) != 0)
+            continue;
+
+        if (S_ISDIR(attrib.st_mode))
+            ListFiles(path.c_str(), filepaths);
+        else
+            filepaths.push_back(path);
+    }
+
+    closedir(dir);
+#endif
+}
+
+bool EvictFileFromCache(const char* filepath)
 {
 #ifdef _WIN32
+    // Opening a handle that bypasses the cache makes the cache manager purge the file's pages
+    HANDLE fileHandle = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    CloseHandle(fileHandle);
+    return true;
+#else
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    const bool evicted = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return evicted;
+#endif
+}
+
+u64 GetPeakMemoryUsage()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return (u64)counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return (u64)usage.ru_maxrss * 1024; // kilobytes on Linux
+    return 0;
+#endif
+}
+
+u64 HashBytes(const void* data, u64 size, u64 seed)
+{
+    const u8* bytes = (const u8*)data;
+    u64 hash = seed;
+    for (u64 i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool GetSourceStamp(const char* filepath, SourceStamp& stamp)
+{
+    MappedFile source = MapFile(filepath);
+    if (source.data == NULL)
+        return false;
+
+    stamp.timestamp = GetFileLastWriteTimestamp(filepath);
+    stamp.size = source.size;
+    stamp.hash = HashBytes(source.data, source.size);
+
+    UnmapFile(source);
+    return true;
+}
+
+bool IsSourceUnchanged(const char* filepath, const SourceStamp& stamp)
+{
+    MappedFile source = MapFile(filepath);
+    if (source.data == NULL)
+        return false;
+
+    bool unchanged = source.size == stamp.size;
+    if (unchanged && GetFileLastWriteTimestamp(filepath) != stamp.timestamp)
+    {
+        // The file was touched, but its contents might still be the same
+        unchanged = HashBytes(source.data, source.size) == stamp.hash;
+    }
+
+    UnmapFile(source);
+    return unchanged;
+}
+
+void LogString(const char* str)
+{
+#if defined(_WIN32) && !defined(PLATFORM_TOOL)
     OutputDebugStringA(str);
     OutputDebugStringA("\n");
 #else
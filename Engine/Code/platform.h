@@ -15,6 +15,11 @@
 
 #pragma warning(disable : 4267) // conversion from X to Y, possible loss of data
 
+/**
+ * Allocates from the frame arena, which is reset every frame. Main thread only.
+ */
+void* PushSize(u32 byteCount);
+
 String MakeString(const char *cstr);
 
 String MakePath(String dir, String filename);
@@ -33,6 +38,65 @@ String ReadTextFile(const char *filepath);
  */
 u64 GetFileLastWriteTimestamp(const char *filepath);
 
+/**
+ * Read-only memory mapping of a whole file. The view stays valid until UnmapFile
+ * is called, so its contents can be handed directly to the GL without copies.
+ */
+struct MappedFile
+{
+    const u8* data;
+    u64       size;
+    void*     fileHandle;
+    void*     mappingHandle;
+};
+
+MappedFile MapFile(const char *filepath);
+
+void UnmapFile(MappedFile& file);
+
+/**
+ * Writes a whole binary blob into a file, replacing its previous contents.
+ */
+bool WriteBinaryFile(const char *filepath, const void* data, u64 size);
+
+/**
+ * Appends the path of every file under a directory, recursively, as directory/.../name.
+ */
+void ListFiles(const char* directory, std::vector<std::string>& filepaths);
+
+/**
+ * Drops the pages of a file from the OS file cache so the next read comes from the disk.
+ * Best effort, meant for cold load measurements: pages still mapped somewhere stay.
+ */
+bool EvictFileFromCache(const char* filepath);
+
+/**
+ * Largest resident memory of the process so far, in bytes.
+ */
+u64 GetPeakMemoryUsage();
+
+/**
+ * 64-bit FNV-1a hash. Pass the result of a previous call as seed to hash
+ * several blocks of memory as if they were a single one.
+ */
+u64 HashBytes(const void* data, u64 size, u64 seed = 0xcbf29ce484222325ull);
+
+/**
+ * Identifies the contents of a source asset so derived files (caches, compressed
+ * textures...) can tell whether they are stale. Size and timestamp are checked
+ * first, the content hash only when the timestamp changed.
+ */
+struct SourceStamp
+{
+    u64 timestamp;
+    u64 size;
+    u64 hash;
+};
+
+bool GetSourceStamp(const char *filepath, SourceStamp& stamp);
+
+bool IsSourceUnchanged(const char *filepath, const SourceStamp& stamp);
+
 /**
  * It logs a string to whichever outputs are configured in the platform layer.
  * By default, the string is printed in the output console of VisualStudio.
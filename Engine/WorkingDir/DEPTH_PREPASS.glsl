@@ -0,0 +1,40 @@
+#ifdef DEPTH_PREPASS
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+// Positions only, the VAO of this program binds the position stream alone
+layout(location = 0) in vec3 aPosition;
+
+// Entity and batch of the instance, stepped once per instance from the draw's base instance (see InstanceBatcher)
+layout(location = 5) in uvec2 aInstance;
+
+struct EntityParams
+{
+	mat4 worldMatrix;
+	mat4 worldViewProjectionMatrix;
+};
+
+layout(binding = 1, std430) readonly buffer Entities
+{
+	EntityParams uEntities[];
+};
+
+// Same depth as the geometry passes, which then test with GL_LEQUAL
+invariant gl_Position;
+
+void main()
+{
+	EntityParams entity = uEntities[aInstance.x];
+	float clippingScale = 1.0;
+
+	gl_Position = entity.worldViewProjectionMatrix * vec4(aPosition, clippingScale);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+void main()
+{
+}
+
+#endif
+#endif
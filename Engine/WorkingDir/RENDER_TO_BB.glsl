@@ -23,27 +23,43 @@ layout(binding = 0,std140) uniform GlobalParams
 	Light uLight[16];
 };
 
-layout(binding = 1, std140) uniform LocalParams
+// Entity and batch of the instance, stepped once per instance from the draw's base instance (see InstanceBatcher)
+layout(location = 5) in uvec2 aInstance;
+
+struct EntityParams
+{
+	mat4 worldMatrix;
+	mat4 worldViewProjectionMatrix;
+};
+
+layout(binding = 1, std430) readonly buffer Entities
 {
-	mat4 uWorldMatrix;
-	mat4 uWorldViewProjectionMatrix;
+	EntityParams uEntities[];
 };
 
+flat out uint vBatch; // DrawParams of the fragment
+
 out vec2 vTexCoord;
 out vec3 vPosition; // in worldspace
 out vec3 vNormal;  // in worldspace
 out vec3 vViewDir;
 
+// Matches the depth of DEPTH_PREPASS
+invariant gl_Position;
+
 void main()
 {
+	EntityParams entity = uEntities[aInstance.x];
+	vBatch = aInstance.y;
+
 	vTexCoord = aTexCoord;
 
-	vPosition = vec3(uWorldMatrix * vec4(aPosition,1.0));
-	vNormal = vec3(uWorldMatrix * vec4(aNormal,0.0));
+	vPosition = vec3(entity.worldMatrix * vec4(aPosition,1.0));
+	vNormal = vec3(entity.worldMatrix * vec4(aNormal,0.0));
 	vViewDir = uCameraPosition - vPosition;
 	float clippingScale = 1.0;
 
-	gl_Position = uWorldViewProjectionMatrix * vec4(aPosition, clippingScale);
+	gl_Position = entity.worldViewProjectionMatrix * vec4(aPosition, clippingScale);
 }
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
@@ -68,7 +84,45 @@ in vec3 vPosition; // in worldspace
 in vec3 vNormal;  // in worldspace
 in vec3 vViewDir;
 
-uniform sampler2D uTexture;
+// Every texture is a layer of a texture array, bound to one of the units of uTextures (TEXTURE_ARRAY_BOUND_UNITS)
+uniform sampler2DArray uTextures[16];
+
+// Per batch parameters, the same for every fragment of a draw
+struct DrawParams
+{
+	uvec2 textureLayer; // unit in uTextures, layer
+	uint materialIdx;
+	vec2 textureSize; // largest level 0 size of the streamed textures of the material, 0 when none is
+};
+
+layout(binding = 2, std430) readonly buffer Draws
+{
+	DrawParams uDraws[];
+};
+
+flat in uint vBatch;
+
+// Mip feedback for the texture streamer: the finest level of its texture each material needs
+layout(binding = 0, std430) buffer MipFeedback
+{
+	uint uRequestedMip[];
+};
+
+uniform uint uFeedbackFrame;
+
+void WriteMipFeedback(DrawParams draw)
+{
+	// Derivatives before any branch, they need the whole quad
+	vec2 texels = vTexCoord * draw.textureSize;
+	vec2 dx = dFdx(texels);
+	vec2 dy = dFdy(texels);
+	float lod = max(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0.0);
+
+	// One pixel of every 4x4 tile, a different one each frame, keeps the atomics cheap
+	uvec2 pixel = uvec2(gl_FragCoord.xy) & 3u;
+	if (draw.textureSize.x > 0.0 && pixel.x + pixel.y * 4u == (uFeedbackFrame & 15u))
+		atomicMin(uRequestedMip[draw.materialIdx], uint(lod));
+}
 layout(location = 0) out vec4 oColor;
 
 void CalculateBlitVars(in Light light ,out vec3 ambient,out vec3 diffuse, out vec3 specular)
@@ -91,7 +145,10 @@ void CalculateBlitVars(in Light light ,out vec3 ambient,out vec3 diffuse, out ve
 void main()
 {
 
-	vec4 textureColor = texture(uTexture, vTexCoord);
+	DrawParams draw = uDraws[vBatch];
+
+	WriteMipFeedback(draw);
+	vec4 textureColor = texture(uTextures[draw.textureLayer.x], vec3(vTexCoord, float(draw.textureLayer.y)));
 	vec4 finalColor = vec4(0.0);
 	
 	for(int i = 0;i< uLightCount; ++i)